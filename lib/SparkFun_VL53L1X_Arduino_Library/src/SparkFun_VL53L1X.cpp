@@ -349,6 +349,16 @@ void SFEVL53L1X::startTemperatureUpdate()
 	_device->VL53L1X_StartTemperatureUpdate();
 }
 
+void SFEVL53L1X::beginTemperatureUpdate()
+{
+	_device->VL53L1X_BeginTemperatureUpdate();
+}
+
+void SFEVL53L1X::endTemperatureUpdate()
+{
+	_device->VL53L1X_FinishTemperatureUpdate();
+}
+
 void SFEVL53L1X::calibrateOffset(uint16_t targetDistanceInMm)
 {
 	int16_t offset = getOffset();
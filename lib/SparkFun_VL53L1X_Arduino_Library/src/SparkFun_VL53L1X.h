@@ -105,6 +105,8 @@ class SFEVL53L1X
 	void setSigmaThreshold(uint16_t sigmaThreshold); //Programs a new sigma threshold in mm. (default=15 mm)
 	uint16_t getSigmaThreshold(); //Returns the current sigma threshold.
 	void startTemperatureUpdate(); //Recalibrates the sensor for temperature changes. Run this any time the temperature has changed by more than 8°C
+	void beginTemperatureUpdate(); //Non-blocking temperature recalibration. Stop ranging first, poll checkForDataReady() and then call endTemperatureUpdate()
+	void endTemperatureUpdate(); //Completes (or abandons) a temperature recalibration started with beginTemperatureUpdate() and stops ranging
 	void calibrateOffset(uint16_t targetDistanceInMm); //Autocalibrate the offset by placing a target a known distance away from the sensor and passing this known distance into the function.
 	void calibrateXTalk(uint16_t targetDistanceInMm); //Autocalibrate the crosstalk by placing a target a known distance away from the sensor and passing this known distance into the function.
 	private:
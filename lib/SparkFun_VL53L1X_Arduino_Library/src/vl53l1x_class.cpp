@@ -794,15 +794,37 @@ VL53L1X_ERROR VL53L1X::VL53L1X_StartTemperatureUpdate()
 {
 	VL53L1X_ERROR status = 0;
 	uint8_t tmp = 0;
+	uint32_t started;
 
-	status = VL53L1_WrByte(Device, VL53L1_VHV_CONFIG__TIMEOUT_MACROP_LOOP_BOUND, 0x81); /* full VHV */
-	status = VL53L1_WrByte(Device, 0x0B, 0x92);
-	status = VL53L1X_StartRanging();
+	status = VL53L1X_BeginTemperatureUpdate();
+	started = millis();
 	while (tmp == 0)
 	{
 		status = VL53L1X_CheckForDataReady(&tmp);
+		if (millis() - started > 1000)
+		{
+			VL53L1X_FinishTemperatureUpdate();
+			return VL53L1_ERROR_TIME_OUT;
+		}
 	}
-	tmp = 0;
+	status = VL53L1X_FinishTemperatureUpdate();
+	return status;
+}
+
+VL53L1X_ERROR VL53L1X::VL53L1X_BeginTemperatureUpdate()
+{
+	VL53L1X_ERROR status = 0;
+
+	status = VL53L1_WrByte(Device, VL53L1_VHV_CONFIG__TIMEOUT_MACROP_LOOP_BOUND, 0x81); /* full VHV */
+	status = VL53L1_WrByte(Device, 0x0B, 0x92);
+	status = VL53L1X_StartRanging();
+	return status;
+}
+
+VL53L1X_ERROR VL53L1X::VL53L1X_FinishTemperatureUpdate()
+{
+	VL53L1X_ERROR status = 0;
+
 	status = VL53L1X_ClearInterrupt();
 	status = VL53L1X_StopRanging();
 	status = VL53L1_WrByte(Device, VL53L1_VHV_CONFIG__TIMEOUT_MACROP_LOOP_BOUND, 0x09); /* two bounds VHV */
@@ -814,9 +836,10 @@ VL53L1X_ERROR VL53L1X::VL53L1X_StartTemperatureUpdate()
 
 int8_t VL53L1X::VL53L1X_CalibrateOffset(uint16_t TargetDistInMm, int16_t *offset)
 {
-	uint8_t i = 0, tmp;
-	int16_t AverageDistance = 0;
+	uint8_t i = 0, tmp = 0;
+	int32_t AverageDistance = 0; /* 50 x 16 bit distances overflow an int16_t */
 	uint16_t distance;
+	uint32_t started;
 	VL53L1X_ERROR status = 0;
 
 	status = VL53L1_WrWord(Device, ALGO__PART_TO_PART_RANGE_OFFSET_MM, 0x0);
@@ -825,9 +848,15 @@ int8_t VL53L1X::VL53L1X_CalibrateOffset(uint16_t TargetDistInMm, int16_t *offset
 	status = VL53L1X_StartRanging(); /* Enable VL53L1X sensor */
 	for (i = 0; i < 50; i++)
 	{
+		started = millis();
 		while (tmp == 0)
 		{
 			status = VL53L1X_CheckForDataReady(&tmp);
+			if (millis() - started > 1000)
+			{
+				VL53L1X_StopRanging();
+				return VL53L1_ERROR_TIME_OUT;
+			}
 		}
 		tmp = 0;
 		status = VL53L1X_GetDistance(&distance);
@@ -836,7 +865,7 @@ int8_t VL53L1X::VL53L1X_CalibrateOffset(uint16_t TargetDistInMm, int16_t *offset
 	}
 	status = VL53L1X_StopRanging();
 	AverageDistance = AverageDistance / 50;
-	*offset = TargetDistInMm - AverageDistance;
+	*offset = (int16_t)(TargetDistInMm - AverageDistance);
 	status = VL53L1_WrWord(Device, ALGO__PART_TO_PART_RANGE_OFFSET_MM, *offset * 4);
 	return status;
 }
@@ -849,15 +878,22 @@ int8_t VL53L1X::VL53L1X_CalibrateXtalk(uint16_t TargetDistInMm, uint16_t *xtalk)
 	float AverageSpadNb = 0;
 	uint16_t distance = 0, spadNum;
 	uint16_t sr;
+	uint32_t started;
 	VL53L1X_ERROR status = 0;
 
 	status = VL53L1_WrWord(Device, 0x0016, 0);
 	status = VL53L1X_StartRanging();
 	for (i = 0; i < 50; i++)
 	{
+		started = millis();
 		while (tmp == 0)
 		{
 			status = VL53L1X_CheckForDataReady(&tmp);
+			if (millis() - started > 1000)
+			{
+				VL53L1X_StopRanging();
+				return VL53L1_ERROR_TIME_OUT;
+			}
 		}
 		tmp = 0;
 		status = VL53L1X_GetSignalRate(&sr);
@@ -491,6 +491,19 @@ class VL53L1X : public RangeSensor
 	 */
 	VL53L1X_ERROR VL53L1X_StartTemperatureUpdate();
 
+	/**
+	 * @brief Non-blocking version of VL53L1X_StartTemperatureUpdate() - programs a full VHV search and starts ranging.\n
+	 * Ranging must be stopped before calling. Poll VL53L1X_CheckForDataReady() and then call
+	 * VL53L1X_FinishTemperatureUpdate() (also when the caller gives up waiting).
+	 */
+	VL53L1X_ERROR VL53L1X_BeginTemperatureUpdate();
+
+	/**
+	 * @brief Completes a temperature update started with VL53L1X_BeginTemperatureUpdate().\n
+	 * Clears the interrupt, stops ranging and restores the two bound VHV search used for normal ranging.
+	 */
+	VL53L1X_ERROR VL53L1X_FinishTemperatureUpdate();
+
 
 	/* VL53L1X_calibration.h functions */
 	
@@ -0,0 +1,203 @@
+// Cloud Publisher Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class reports counts off the device without ever publishing from the counting path
+// Crossings are added to an open batch (a few increments); loop() closes the batch every PUBLISH_INTERVAL_MS and sends
+// queued batches several to an event, no faster than the Particle rate limit, backing off when a publish fails
+// When the device is offline the batches wait in a fixed ring - if it fills, the two oldest are merged so totals are never lost
+// When no batch is waiting, the crossing history (CrossingHistory) goes out as its own event once enough has built up
+// Publishing goes through PublishSink so the cloud can be replaced (tools/host/LoopbackPublishSink.h / FilePublishSink.h)
+
+#include "Particle.h"
+#include "CloudPublisher.h"
+#include "CrossingHistory.h"
+
+// Device OS cloud - the default sink. NO_ACK so a publish returns once it is sent rather than waiting on the cloud
+class ParticleSink : public PublishSink {
+public:
+  bool connected() override { return Particle.connected(); }
+  void connect() override { Particle.connect(); }
+  bool publish(const char *event, const char *data) override { return Particle.publish(event, data, PRIVATE | NO_ACK); }
+};
+
+static ParticleSink particleSink;
+
+static uint32_t secondsNow() {
+  return Time.isValid() ? (uint32_t)Time.now() : System.uptime();
+}
+
+static uint16_t saturate16(uint32_t value) {
+  return (value > 65535UL) ? 65535 : (uint16_t)value;
+}
+
+static char payload[PUBLISH_DATA_LENGTH];           // Static - too big for the application thread's stack
+
+CloudPublisher *CloudPublisher::_instance;
+
+// [static]
+CloudPublisher &CloudPublisher::instance() {
+  if (!_instance) {
+      _instance = new CloudPublisher();
+  }
+  return *_instance;
+}
+
+CloudPublisher::CloudPublisher() {
+  memset(&open, 0, sizeof(open));
+  memset(queue, 0, sizeof(queue));
+  sink = &particleSink;
+}
+
+CloudPublisher::~CloudPublisher() {
+}
+
+void CloudPublisher::setSink(PublishSink *newSink) {
+  sink = newSink ? newSink : &particleSink;
+}
+
+void CloudPublisher::setup(int occupancy) {
+  memset(&open, 0, sizeof(open));
+  unixTime = Time.isValid();
+  open.start = secondsNow();
+  open.count = occupancy;
+  open.peak = occupancy;
+  openActive = false;
+  lastClosedAt = millis();
+  nextAttemptAt = millis();
+}
+
+void CloudPublisher::touch(int occupancy) {
+  if (!openActive) {
+    openActive = true;
+    openedAt = millis();
+  }
+  open.count = occupancy;
+  if (occupancy > open.peak) open.peak = occupancy;
+}
+
+void CloudPublisher::countEntry(int occupancy) {
+  if (open.entries < 65535) open.entries++;
+  touch(occupancy);
+}
+
+void CloudPublisher::countExit(int occupancy) {
+  if (open.exits < 65535) open.exits++;
+  touch(occupancy);
+}
+
+void CloudPublisher::countAborted() {
+  if (open.aborted < 65535) open.aborted++;
+  touch(open.count);
+}
+
+// Moves the open batch to the queue and starts the next one at the current count
+void CloudPublisher::closeBatch() {
+  uint32_t now = secondsNow();
+  open.seconds = saturate16(now - open.start);
+
+  if (queued == PUBLISH_QUEUE_SIZE) {               // Full - fold the oldest into the next so the totals survive
+    PublishBatch &older = queue[oldest];
+    uint16_t next = (oldest + 1) % PUBLISH_QUEUE_SIZE;
+    PublishBatch &newer = queue[next];
+    newer.seconds = saturate16(newer.start + newer.seconds - older.start);
+    newer.start = older.start;
+    newer.entries = saturate16((uint32_t)newer.entries + older.entries);
+    newer.exits = saturate16((uint32_t)newer.exits + older.exits);
+    newer.aborted = saturate16((uint32_t)newer.aborted + older.aborted);
+    if (older.peak > newer.peak) newer.peak = older.peak;
+    oldest = next;
+    queued--;
+    merged++;
+  }
+  queue[(oldest + queued) % PUBLISH_QUEUE_SIZE] = open;
+  queued++;
+
+  int16_t count = open.count;
+  memset(&open, 0, sizeof(open));
+  open.start = now;
+  open.count = count;
+  open.peak = count;
+  openActive = false;
+  lastClosedAt = millis();
+}
+
+// The clock was set - moves the open batch and everything queued to Unix time, as OccupancySeries does with its buckets
+// Otherwise the first batch of every boot would go out with an uptime start and a window of 65535 seconds
+void CloudPublisher::rebase() {
+  uint32_t offset = (uint32_t)Time.now() - System.uptime();
+  open.start += offset;
+  for (uint16_t i = 0; i < queued; i++) queue[(oldest + i) % PUBLISH_QUEUE_SIZE].start += offset;
+  unixTime = true;
+}
+
+void CloudPublisher::loop() {
+  unsigned long now = millis();
+
+  if (!unixTime && Time.isValid()) rebase();
+
+  if ((openActive && now - openedAt >= PUBLISH_INTERVAL_MS) || now - lastClosedAt >= PUBLISH_SNAPSHOT_INTERVAL_MS) closeBatch();
+  if (!queued && !CrossingHistory::instance().uploadDue()) return;
+
+  if (!sink->connected()) {
+    #if PUBLISH_AUTO_CONNECT
+    if (!connectRequested) {
+      sink->connect();                              // Returns at once with SYSTEM_THREAD - we just look again next pass
+      connectRequested = true;
+    }
+    #endif
+    return;
+  }
+  connectRequested = false;
+  if ((long)(now - nextAttemptAt) < 0) return;      // Rate limit or backoff
+
+  // Counts first - the history is the detail behind them and can wait for a quiet moment
+  bool sent;
+  if (queued) {
+    uint16_t batches = format(PUBLISH_BATCHES_PER_EVENT, payload, sizeof(payload));
+    sent = batches && sink->publish(PUBLISH_EVENT_NAME, payload);
+    if (sent) {
+      oldest = (oldest + batches) % PUBLISH_QUEUE_SIZE;
+      queued -= batches;
+    }
+  }
+  else {
+    uint16_t records = CrossingHistory::instance().format(payload, sizeof(payload));
+    sent = records && sink->publish(PUBLISH_HISTORY_EVENT_NAME, payload);
+    if (sent) {
+      CrossingHistory::instance().markSent(records);
+      historyPublished++;
+    }
+  }
+
+  if (sent) {
+    published++;
+    backoff = 0;
+    nextAttemptAt = now + PUBLISH_MIN_SPACING_MS;
+  }
+  else {
+    failures++;
+    backoff = (backoff == 0) ? PUBLISH_RETRY_MIN_MS : ((backoff * 2 > PUBLISH_RETRY_MAX_MS) ? PUBLISH_RETRY_MAX_MS : backoff * 2);
+    nextAttemptAt = now + backoff;
+  }
+}
+
+uint16_t CloudPublisher::format(uint16_t batches, char *buffer, size_t length) const {
+  size_t used = 0;
+  uint16_t written = 0;
+
+  if (length < 3) return 0;
+  buffer[used++] = '[';
+  for (uint16_t i = 0; i < batches && i < queued; i++) {
+    const PublishBatch &batch = queue[(oldest + i) % PUBLISH_QUEUE_SIZE];
+    char entry[64];
+    int entryLength = snprintf(entry, sizeof(entry), "%s[%lu,%u,%u,%u,%u,%d,%d]", written ? "," : "", (unsigned long)batch.start, batch.seconds, batch.entries, batch.exits, batch.aborted, batch.count, batch.peak);
+    if (entryLength < 0 || used + entryLength + 2 > length) break;        // Room for "]" and the terminator
+    memcpy(buffer + used, entry, entryLength);
+    used += entryLength;
+    written++;
+  }
+  buffer[used++] = ']';
+  buffer[used] = '\0';
+  return written;
+}
@@ -0,0 +1,161 @@
+// Cloud Publisher Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class reports counts off the device without ever publishing from the counting path
+// Crossings are added to an open batch (a few increments); loop() closes the batch every PUBLISH_INTERVAL_MS and sends
+// queued batches several to an event, no faster than the Particle rate limit, backing off when a publish fails
+// When the device is offline the batches wait in a fixed ring - if it fills, the two oldest are merged so totals are never lost
+// When no batch is waiting, the crossing history (CrossingHistory) goes out as its own event once enough has built up
+// Publishing goes through PublishSink so the cloud can be replaced (tools/host/LoopbackPublishSink.h / FilePublishSink.h)
+
+#ifndef __CLOUDPUBLISHER_H
+#define __CLOUDPUBLISHER_H
+
+#include "Particle.h"
+
+#define PUBLISH_EVENT_NAME "occupancy"
+#define PUBLISH_HISTORY_EVENT_NAME "occupancy-history"   // Base64 CrossingHistory batches - tools/history/HistoryDecode.cpp reads them
+#define PUBLISH_INTERVAL_MS (60UL * 1000UL)         // A batch closes this long after its first crossing - at most one event per window
+#define PUBLISH_SNAPSHOT_INTERVAL_MS (15UL * 60UL * 1000UL)   // With no crossings an empty batch still goes out this often (a heartbeat with the count)
+#define PUBLISH_QUEUE_SIZE 16                       // Closed batches waiting to be sent
+#define PUBLISH_BATCHES_PER_EVENT 8                 // Most batches sent in one event
+#define PUBLISH_MIN_SPACING_MS 1000                 // Particle allows one publish a second on average
+#define PUBLISH_RETRY_MIN_MS 5000                   // First retry after a failed publish - doubles on each failure
+#define PUBLISH_RETRY_MAX_MS (5UL * 60UL * 1000UL)
+#define PUBLISH_DATA_LENGTH 622                     // Largest event payload
+#define PUBLISH_AUTO_CONNECT 1                      // Ask for a cloud connection when there is something to send (the demo runs in MANUAL mode)
+
+/**
+ * @brief Crossings over one window - 16 bytes
+ */
+struct PublishBatch {
+    uint32_t start;                         // Seconds (uptime until the clock is set, then moved to Unix time)
+    uint16_t seconds;                       // Length of the window
+    uint16_t entries;
+    uint16_t exits;
+    uint16_t aborted;
+    int16_t count;                          // Occupancy when the batch closed
+    int16_t peak;                           // Highest occupancy during the window
+};
+
+/**
+ * @brief Where events go - the Particle cloud on the device, memory or a file on a desktop
+ */
+class PublishSink {
+public:
+    virtual ~PublishSink() {}
+    virtual bool connected() = 0;
+    virtual void connect() {}
+    virtual bool publish(const char *event, const char *data) = 0;
+};
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From global application setup you must call:
+ * CloudPublisher::instance().setup();
+ *
+ * From global application loop you must call:
+ * CloudPublisher::instance().loop();
+ */
+class CloudPublisher {
+public:
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use CloudPublisher::instance() to instantiate the singleton.
+     */
+    static CloudPublisher &instance();
+
+    /**
+     * @brief Starts the first batch at the current count
+     *
+     * You typically use CloudPublisher::instance().setup(count);
+     */
+    void setup(int occupancy = 0);
+
+    /**
+     * @brief Closes batches that are due and sends what the rate limit and backoff allow - at most one publish per call
+     *
+     * You typically use CloudPublisher::instance().loop();
+     */
+    void loop();
+
+    /**
+     * @brief Called by PeopleCounter as passes are counted - only updates the open batch
+     */
+    void countEntry(int occupancy);
+    void countExit(int occupancy);
+    void countAborted();
+
+    /**
+     * @brief Formats queued batches as JSON, oldest first - [[start,seconds,entries,exits,aborted,count,peak],...]
+     *
+     * @return The number of batches written (stops early rather than truncate one)
+     */
+    uint16_t format(uint16_t batches, char *buffer, size_t length) const;
+
+    /**
+     * @brief Replaces the sink (the Particle cloud by default) - call before setup()
+     */
+    void setSink(PublishSink *sink);
+
+    uint16_t getQueued() const { return queued; }
+    uint32_t getPublished() const { return published; }
+    uint32_t getHistoryPublished() const { return historyPublished; }
+    uint32_t getFailures() const { return failures; }
+    uint32_t getMerged() const { return merged; }
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use CloudPublisher::instance() to instantiate the singleton.
+     */
+    CloudPublisher();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~CloudPublisher();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    CloudPublisher(const CloudPublisher&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    CloudPublisher& operator=(const CloudPublisher&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static CloudPublisher *_instance;
+
+    void touch(int occupancy);
+    void closeBatch();
+    void rebase();
+
+    PublishSink *sink = NULL;
+    PublishBatch open;                      // Collecting crossings
+    bool unixTime = false;                  // Batch starts are Unix time - uptime until the cloud sets the clock
+    bool openActive = false;                // Has a crossing since it opened
+    unsigned long openedAt = 0;             // millis() of the first crossing in the open batch
+    unsigned long lastClosedAt = 0;
+    PublishBatch queue[PUBLISH_QUEUE_SIZE];
+    uint16_t oldest = 0;
+    uint16_t queued = 0;
+    unsigned long nextAttemptAt = 0;
+    unsigned long backoff = 0;              // 0 until a publish fails
+    bool connectRequested = false;
+    uint32_t published = 0;
+    uint32_t historyPublished = 0;          // Of which crossing history events
+    uint32_t failures = 0;
+    uint32_t merged = 0;                    // Batches folded together because the queue was full
+};
+#endif  /* __CLOUDPUBLISHER_H */
@@ -0,0 +1,241 @@
+// Config Store Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class holds the tunable settings that used to be compile-time macros (the macros are now the defaults)
+// - Every value is typed and checked against its range before it is accepted
+// - Changes are staged and applied together at a frame boundary (TofSensor::loop() calls apply()) so a frame never
+//   sees half of an update, and acquisition keeps running
+// - Applied values are persisted (PersistentStore block) and restored on the next boot
+// Values can be set from code, from the "config" cloud function or from the serial console with "name=value[,name=value]"
+
+#include <stddef.h>
+#include "Particle.h"
+#include "TofSensorConfig.h"
+#include "PeopleCounterConfig.h"
+#include "PersistentStore.h"
+#include "PowerProfile.h"
+#include "ConfigStore.h"
+
+// One row per ConfigId - where the value lives, its width, range, default and what changing it affects
+struct ConfigParam {
+  const char *name;
+  uint8_t offset;
+  uint8_t size;                                     // 1 or 2 bytes
+  bool isSigned;
+  int32_t low;
+  int32_t high;
+  int32_t defaultValue;
+  uint32_t change;
+};
+
+#define CONFIG_FIELD(field) offsetof(ConfigValues, field), sizeof(((ConfigValues *)0)->field)
+
+static const ConfigParam configParams[CONFIG_ID_COUNT] = {
+  {"threshold",        CONFIG_FIELD(personThreshold), false, 2,   100,                   PERSON_THRESHOLD,      CONFIG_CHANGED_DETECTION},
+  {"calibrationLoops", CONFIG_FIELD(calibrationLoops), false, 5,  NUM_CALIBRATION_LOOPS, NUM_CALIBRATION_LOOPS, CONFIG_CHANGED_CALIBRATION},
+  {"sensorTimeout",    CONFIG_FIELD(sensorTimeoutMs), false, 50,  5000,                  SENSOR_TIMEOUT,        CONFIG_CHANGED_TIMING},
+  {"timingBudget",     CONFIG_FIELD(timingBudgetMs), false, 20,   500,                   20,                    CONFIG_CHANGED_TIMING},
+  {"zoneHeight",       CONFIG_FIELD(zoneHeight), false, 4,        16,                    COLUMNS_OF_SPADS,      CONFIG_CHANGED_LAYOUT},
+  {"zoneWidth",        CONFIG_FIELD(zoneWidth), false, 4,         16,                    ROWS_OF_SPADS,         CONFIG_CHANGED_LAYOUT},
+  {"frontCenter",      CONFIG_FIELD(frontCenter), false, 0,       255,                   FRONT_ZONE_CENTER,     CONFIG_CHANGED_LAYOUT},
+  {"backCenter",       CONFIG_FIELD(backCenter), false, 0,        255,                   BACK_ZONE_CENTER,      CONFIG_CHANGED_LAYOUT},
+  {"peopleLimit",      CONFIG_FIELD(peopleLimit), true, 0,        1000,                  DEFAULT_PEOPLE_LIMIT,  CONFIG_CHANGED_COUNTING},
+  {"mountedInside",    CONFIG_FIELD(mountedInside), false, 0,     1,                     MOUNTED_INSIDE,        CONFIG_CHANGED_COUNTING},
+  {"profile",          CONFIG_FIELD(profile), false, 0,           PROFILE_COUNT - 1,     PROFILE_AUTO,          CONFIG_CHANGED_TIMING}
+};
+
+// The timing budgets the VL53L1X accepts in long distance mode
+static bool validTimingBudget(int32_t value) {
+  return value == 20 || value == 33 || value == 50 || value == 100 || value == 200 || value == 500;
+}
+
+// Same table as TofSensorConfig.h - rows 0-7 count up from 128, rows 8-15 count down from 127
+static void spadPosition(uint8_t center, int &row, int &column) {
+  if (center >= 128) {
+    column = (center - 128) / 8;
+    row = (center - 128) % 8;
+  }
+  else {
+    column = (127 - center) / 8;
+    row = 8 + (127 - center) % 8;
+  }
+}
+
+// Both zones on the 16x16 array without overlapping, placed as TofSensor places them (the center is right of and above the
+// true center). Above 10 SPADs the sensor ignores the center and measures the middle of the array, so both zones would be one.
+static bool validLayout(const ConfigValues &values) {
+  int height = values.zoneHeight, width = values.zoneWidth;
+  if (height > 10 || width > 10) return false;
+
+  int top[2], left[2];
+  const uint8_t centers[2] = {values.frontCenter, values.backCenter};
+  for (int zone = 0; zone < 2; zone++) {
+    int row, column;
+    spadPosition(centers[zone], row, column);
+    top[zone] = row - (height / 2 - 1);
+    left[zone] = column - width / 2;
+    if (top[zone] < 0 || top[zone] + height > 16 || left[zone] < 0 || left[zone] + width > 16) return false;
+  }
+  return top[0] + height <= top[1] || top[1] + height <= top[0] || left[0] + width <= left[1] || left[1] + width <= left[0];
+}
+
+static int32_t readField(const ConfigValues &values, const ConfigParam &param) {
+  const uint8_t *field = (const uint8_t *)&values + param.offset;
+  if (param.size == 1) return param.isSigned ? (int32_t)*(const int8_t *)field : (int32_t)*field;
+  uint16_t raw;
+  memcpy(&raw, field, sizeof(raw));
+  return param.isSigned ? (int32_t)(int16_t)raw : (int32_t)raw;
+}
+
+static void writeField(ConfigValues &values, const ConfigParam &param, int32_t value) {
+  uint8_t *field = (uint8_t *)&values + param.offset;
+  if (param.size == 1) *field = (uint8_t)value;
+  else {
+    uint16_t raw = (uint16_t)value;
+    memcpy(field, &raw, sizeof(raw));
+  }
+}
+
+static bool inRange(ConfigId id, int32_t value) {
+  const ConfigParam &param = configParams[id];
+  if (value < param.low || value > param.high) return false;
+  if (id == CONFIG_TIMING_BUDGET && !validTimingBudget(value)) return false;
+  return true;
+}
+
+ConfigStore *ConfigStore::_instance;
+
+// [static]
+ConfigStore &ConfigStore::instance() {
+  if (!_instance) {
+      _instance = new ConfigStore();
+  }
+  return *_instance;
+}
+
+ConfigStore::ConfigStore() {
+  for (int id = 0; id < CONFIG_ID_COUNT; id++) writeField(active, configParams[id], configParams[id].defaultValue);
+  active.reserved = 0;
+  staged = active;
+}
+
+ConfigStore::~ConfigStore() {
+}
+
+void ConfigStore::setup() {
+  ConfigValues saved;
+  if (PersistentStore::instance().loadBlock(CONFIG_BLOCK, &saved, sizeof(saved))) {
+    for (int id = 0; id < CONFIG_ID_COUNT; id++) {                // Anything zeroed (newer field) or out of range keeps its default
+      int32_t value = readField(saved, configParams[id]);
+      if (inRange((ConfigId)id, value)) writeField(active, configParams[id], value);
+    }
+    if (!validLayout(active)) {                                    // Saved by firmware that did not check the combination
+      for (int id = 0; id < CONFIG_ID_COUNT; id++) {
+        if (configParams[id].change & CONFIG_CHANGED_LAYOUT) writeField(active, configParams[id], configParams[id].defaultValue);
+      }
+    }
+    Log.info("Configuration restored");
+  }
+  else {
+    const PersistentState &state = PersistentStore::instance().state();
+    ConfigValues migrated = active;
+    if (state.zoneLayoutValid) {                                   // A layout placed before settings were stored
+      migrated.frontCenter = state.zoneCenters[0];
+      migrated.backCenter = state.zoneCenters[1];
+      migrated.zoneWidth = state.zoneWidth;
+      if (validLayout(migrated)) active = migrated;
+    }
+  }
+  staged = active;
+  pending = false;
+
+  Particle.function("config", &ConfigStore::cloudConfig, this);
+}
+
+// "name=value[,...]" stages the values, "name" alone is answered with the value - returns the value or the set() result
+int ConfigStore::cloudConfig(String command) {
+  int32_t value;
+  if (strchr(command.c_str(), '=') == NULL) return getValue(command.c_str(), value) ? (int)value : -1;
+  return set(command.c_str());
+}
+
+int ConfigStore::set(ConfigId id, int32_t value) {
+  if (id >= CONFIG_ID_COUNT || !inRange(id, value)) return -1;
+  ConfigValues candidate = staged;
+  writeField(candidate, configParams[id], value);
+  if (!validLayout(candidate)) return CONFIG_REJECTED_LAYOUT;
+  staged = candidate;
+  pending = true;
+  return 0;
+}
+
+int ConfigStore::set(const char *assignments) {
+  ConfigValues candidate = staged;
+  const char *cursor = assignments;
+
+  for (int pair = 0; *cursor; pair++) {
+    char name[24];
+    size_t length = strcspn(cursor, "=");
+    if (cursor[length] != '=' || length == 0 || length >= sizeof(name)) return -(pair + 1);
+    memcpy(name, cursor, length);
+    name[length] = '\0';
+
+    char *end;
+    long value = strtol(cursor + length + 1, &end, 0);
+    ConfigId id = find(name);
+    if (id == CONFIG_ID_COUNT || end == cursor + length + 1 || (*end != ',' && *end != '\0') || !inRange(id, value)) return -(pair + 1);
+    writeField(candidate, configParams[id], value);
+    cursor = (*end == ',') ? end + 1 : end;
+  }
+  if (!validLayout(candidate)) return CONFIG_REJECTED_LAYOUT;
+
+  staged = candidate;
+  pending = true;
+  return 0;
+}
+
+int32_t ConfigStore::getValue(ConfigId id) const {
+  return (id < CONFIG_ID_COUNT) ? readField(active, configParams[id]) : 0;
+}
+
+bool ConfigStore::getValue(const char *name, int32_t &value) const {
+  ConfigId id = find(name);
+  if (id == CONFIG_ID_COUNT) return false;
+  value = getValue(id);
+  return true;
+}
+
+ConfigId ConfigStore::find(const char *name) const {
+  for (int id = 0; id < CONFIG_ID_COUNT; id++) {
+    if (strcmp(name, configParams[id].name) == 0) return (ConfigId)id;
+  }
+  return CONFIG_ID_COUNT;
+}
+
+const char *ConfigStore::getName(ConfigId id) const {
+  return (id < CONFIG_ID_COUNT) ? configParams[id].name : "";
+}
+
+void ConfigStore::getRange(ConfigId id, int32_t &low, int32_t &high) const {
+  low = (id < CONFIG_ID_COUNT) ? configParams[id].low : 0;
+  high = (id < CONFIG_ID_COUNT) ? configParams[id].high : 0;
+}
+
+uint32_t ConfigStore::apply() {
+  if (!pending) return 0;
+  pending = false;
+
+  uint32_t changes = 0;
+  for (int id = 0; id < CONFIG_ID_COUNT; id++) {
+    if (readField(active, configParams[id]) != readField(staged, configParams[id])) changes |= configParams[id].change;
+  }
+  active = staged;
+  if (changes) PersistentStore::instance().saveBlock(CONFIG_BLOCK, &active, sizeof(active));
+  return changes;
+}
+
+void ConfigStore::restoreDefaults() {
+  for (int id = 0; id < CONFIG_ID_COUNT; id++) writeField(staged, configParams[id], configParams[id].defaultValue);
+  pending = true;
+}
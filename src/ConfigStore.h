@@ -0,0 +1,175 @@
+// Config Store Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class holds the tunable settings that used to be compile-time macros (the macros are now the defaults)
+// - Every value is typed and checked against its range before it is accepted
+// - Changes are staged and applied together at a frame boundary (TofSensor::loop() calls apply()) so a frame never
+//   sees half of an update, and acquisition keeps running
+// - Applied values are persisted (PersistentStore block) and restored on the next boot
+// Values can be set from code, from the "config" cloud function or from the serial console with "name=value[,name=value]"
+
+#ifndef __CONFIGSTORE_H
+#define __CONFIGSTORE_H
+
+#include "Particle.h"
+
+/**
+ * @brief The live settings - append new fields at the end (older saved copies load with them zeroed and are re-defaulted)
+ */
+struct ConfigValues {
+    uint8_t personThreshold;                // kcps/SPAD change from the baseline that means occupied
+    uint8_t calibrationLoops;               // Warm-up window length (at most NUM_CALIBRATION_LOOPS)
+    uint16_t sensorTimeoutMs;               // Give up on a measurement after this long
+    uint16_t timingBudgetMs;                // Per ROI measurement
+    uint8_t zoneHeight;                     // SPADs across the door (was COLUMNS_OF_SPADS)
+    uint8_t zoneWidth;                      // SPADs through the door (was ROWS_OF_SPADS)
+    uint8_t frontCenter;                    // Optical centers
+    uint8_t backCenter;
+    int16_t peopleLimit;
+    uint8_t mountedInside;                  // 1 reverses the count direction
+    uint8_t reserved;
+    uint8_t profile;                        // PowerProfile - 0 lets the traffic decide
+};
+
+/**
+ * @brief Parameter ids - each one has a matching row (name, range, default) in ConfigStore.cpp (keep the two in the same order)
+ */
+enum ConfigId : uint8_t {
+    CONFIG_PERSON_THRESHOLD,
+    CONFIG_CALIBRATION_LOOPS,
+    CONFIG_SENSOR_TIMEOUT,
+    CONFIG_TIMING_BUDGET,
+    CONFIG_ZONE_HEIGHT,
+    CONFIG_ZONE_WIDTH,
+    CONFIG_FRONT_CENTER,
+    CONFIG_BACK_CENTER,
+    CONFIG_PEOPLE_LIMIT,
+    CONFIG_MOUNTED_INSIDE,
+    CONFIG_PROFILE,
+    CONFIG_ID_COUNT
+};
+
+/**
+ * @brief Bits returned by apply() - which groups of settings changed
+ */
+enum ConfigChange : uint32_t {
+    CONFIG_CHANGED_DETECTION = 0x01,        // Threshold
+    CONFIG_CHANGED_CALIBRATION = 0x02,      // Warm-up window
+    CONFIG_CHANGED_TIMING = 0x04,           // Timing budget / timeout / power profile
+    CONFIG_CHANGED_LAYOUT = 0x08,           // Zone centers or size - the baselines no longer apply
+    CONFIG_CHANGED_COUNTING = 0x10          // Limit / mounting
+};
+
+#define CONFIG_BLOCK 0                      // PersistentStore block holding the settings
+#define CONFIG_REJECTED_LAYOUT -100         // set() result - the zones would overlap, run off the SPAD array or be too big to place
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From global application setup you must call (after PersistentStore, before TofSensor and PeopleCounter):
+ * ConfigStore::instance().setup();
+ */
+class ConfigStore {
+public:
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use ConfigStore::instance() to instantiate the singleton.
+     */
+    static ConfigStore &instance();
+
+    /**
+     * @brief Loads the saved settings (defaults for anything missing or out of range) and registers the cloud function
+     *
+     * You typically use ConfigStore::instance().setup();
+     */
+    void setup();
+
+    /**
+     * @brief The applied settings - read these, they only change inside apply()
+     */
+    const ConfigValues &get() const { return active; }
+
+    /**
+     * @brief Stages one value - nothing is staged if it is rejected
+     *
+     * @return 0 on success, -1 if it is out of range, CONFIG_REJECTED_LAYOUT if it breaks the zone layout
+     */
+    int set(ConfigId id, int32_t value);
+
+    /**
+     * @brief Stages "name=value[,name=value...]" - all or nothing
+     *
+     * Zone centers and sizes are checked together once every pair is read, so a layout can be moved in one call.
+     * @return 0 on success, -(position of the first bad pair + 1), or CONFIG_REJECTED_LAYOUT
+     */
+    int set(const char *assignments);
+
+    /**
+     * @brief Applied value by id or name
+     */
+    int32_t getValue(ConfigId id) const;
+    bool getValue(const char *name, int32_t &value) const;
+
+    /**
+     * @brief Looks a name up - CONFIG_ID_COUNT if there is no such setting
+     */
+    ConfigId find(const char *name) const;
+    const char *getName(ConfigId id) const;
+    void getRange(ConfigId id, int32_t &low, int32_t &high) const;
+
+    /**
+     * @brief Staged changes waiting for the next apply()
+     */
+    bool isPending() const { return pending; }
+
+    /**
+     * @brief Makes the staged settings live and saves them - call between frames
+     *
+     * @return ConfigChange bits for what changed (0 if nothing was staged)
+     */
+    uint32_t apply();
+
+    /**
+     * @brief Stages the compiled in defaults for everything
+     */
+    void restoreDefaults();
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use ConfigStore::instance() to instantiate the singleton.
+     */
+    ConfigStore();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~ConfigStore();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    ConfigStore(const ConfigStore&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    ConfigStore& operator=(const ConfigStore&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static ConfigStore *_instance;
+
+    int cloudConfig(String command);
+
+    ConfigValues active;
+    ConfigValues staged;
+    volatile bool pending = false;
+};
+#endif  /* __CONFIGSTORE_H */
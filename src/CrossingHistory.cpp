@@ -0,0 +1,366 @@
+// Crossing History Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class keeps every counted pass as varint deltas in a bounded ring in retained memory, and cuts it into batches for upload
+// The format is described in CrossingHistory.h - tools/history/HistoryDecode.cpp reads it back on a desktop
+
+#include "Particle.h"
+#include "CrossingHistory.h"
+
+#define HISTORY_MAGIC 0x48495354                    // "HIST"
+#define HISTORY_BATCH_BYTES 480                     // Largest batch format() encodes - 640 characters of base64
+
+// The ring and its anchor - retained so a warm restart keeps the passes not yet uploaded
+// No constructors in here: a retained variable with one would be reset at boot
+struct HistoryRing {
+  uint32_t magic;
+  uint32_t epoch;                                   // Seconds - Unix time if epochIsUnix, uptime otherwise
+  uint8_t epochIsUnix;
+  uint32_t tailTicks;                               // The anchor - time and count before the oldest record
+  int32_t tailCount;
+  uint32_t headTicks;                               // The newest record - what the next one is written against
+  int32_t headCount;
+  uint16_t tail;                                    // Offset of the oldest record
+  uint16_t used;
+  uint16_t records;
+  uint16_t sent;                                    // The oldest records that have been uploaded ...
+  uint16_t sentBytes;                               // ... and the bytes they take
+  uint8_t bytes[HISTORY_BYTES];
+};
+
+retained static HistoryRing ring;
+
+static uint8_t batch[HISTORY_BATCH_BYTES];          // Static - too big for the application thread's stack
+
+static uint32_t secondsNow() {
+  return Time.isValid() ? (uint32_t)Time.now() : System.uptime();
+}
+
+static inline int32_t unzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static size_t base64(const uint8_t *data, size_t length, char *out) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t written = 0;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t group = (uint32_t)data[i] << 16;
+    if (i + 1 < length) group |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < length) group |= data[i + 2];
+    out[written++] = alphabet[(group >> 18) & 0x3F];
+    out[written++] = alphabet[(group >> 12) & 0x3F];
+    out[written++] = (i + 1 < length) ? alphabet[(group >> 6) & 0x3F] : '=';
+    out[written++] = (i + 2 < length) ? alphabet[group & 0x3F] : '=';
+  }
+  out[written] = '\0';
+  return written;
+}
+
+// [static]
+size_t HistoryEncoder::putVarint(uint32_t value, uint8_t *out) {
+  size_t length = 0;
+  while (value >= 0x80) {
+    out[length++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[length++] = (uint8_t)value;
+  return length;
+}
+
+size_t HistoryEncoder::encode(const HistoryRecord &record, uint8_t *out) {
+  uint32_t delta = record.ticks - lastTicks;
+  if (delta > 0x0FFFFFFF) delta = 0x0FFFFFFF;         // Over 300 days apart - the field tops out, the later times shift
+  uint8_t kind = record.kind & 0x03;
+  uint8_t quarter = (record.confidence >= 75) ? 3 : record.confidence / 25;
+  if (kind == HISTORY_COUNT_SET) quarter = 0;
+
+  size_t length = putVarint((delta << 4) | (kind << 2) | quarter, out);
+  if (kind == HISTORY_COUNT_SET) length += putVarint(zigzag(record.count), out + length);
+
+  // Follow what the decoder will make of it
+  lastTicks += delta;
+  if (kind == HISTORY_ENTERED) lastCount++;
+  else if (kind == HISTORY_EXITED) lastCount--;
+  else if (kind == HISTORY_COUNT_SET) lastCount = record.count;
+  return length;
+}
+
+size_t HistoryEncoder::header(uint32_t epoch, uint32_t ticks, int32_t count, uint8_t *out) {
+  size_t length = putVarint(HISTORY_FORMAT_VERSION, out);
+  length += putVarint(epoch, out + length);
+  length += putVarint(ticks, out + length);
+  length += putVarint(zigzag(count), out + length);
+  start(ticks, count);
+  return length;
+}
+
+void HistoryDecoder::start(uint32_t ticks, int32_t count) {
+  stage = STAGE_RECORD;
+  value = 0;
+  shift = 0;
+  record.ticks = ticks;
+  record.kind = HISTORY_ABORTED;
+  record.confidence = 0;
+  record.count = count;
+}
+
+void HistoryDecoder::startBatch() {
+  start(0, 0);
+  stage = STAGE_VERSION;
+  epoch = 0;
+}
+
+bool HistoryDecoder::feed(uint8_t byte) {
+  if (stage == STAGE_ERROR) return false;
+  if (shift > 28) {                                 // Longer than a 32 bit varint - this is not a history
+    stage = STAGE_ERROR;
+    return false;
+  }
+  value |= (uint32_t)(byte & 0x7F) << shift;
+  if (byte & 0x80) {
+    shift += 7;
+    return false;
+  }
+  uint32_t complete = value;
+  value = 0;
+  shift = 0;
+  return field(complete);
+}
+
+// A whole varint - the header fields in order, then records
+bool HistoryDecoder::field(uint32_t value) {
+  switch (stage) {
+    case STAGE_VERSION:
+      stage = (value == HISTORY_FORMAT_VERSION) ? STAGE_EPOCH : STAGE_ERROR;
+      return false;
+    case STAGE_EPOCH:
+      epoch = value;
+      stage = STAGE_TICKS;
+      return false;
+    case STAGE_TICKS:
+      record.ticks = value;
+      stage = STAGE_COUNT;
+      return false;
+    case STAGE_COUNT:
+      record.count = unzigzag(value);
+      stage = STAGE_RECORD;
+      return false;
+    case STAGE_RECORD:
+      record.ticks += value >> 4;
+      record.kind = (HistoryKind)((value >> 2) & 0x03);
+      record.confidence = (value & 0x03) * 25;
+      if (record.kind == HISTORY_ENTERED) record.count++;
+      else if (record.kind == HISTORY_EXITED) record.count--;
+      else if (record.kind == HISTORY_COUNT_SET) {
+        stage = STAGE_SET_COUNT;
+        return false;
+      }
+      return true;
+    case STAGE_SET_COUNT:
+      record.count = unzigzag(value);
+      stage = STAGE_RECORD;
+      return true;
+    default:
+      return false;
+  }
+}
+
+CrossingHistory *CrossingHistory::_instance;
+
+// [static]
+CrossingHistory &CrossingHistory::instance() {
+  if (!_instance) {
+      _instance = new CrossingHistory();
+  }
+  return *_instance;
+}
+
+CrossingHistory::CrossingHistory() {
+  memset(&stats, 0, sizeof(stats));
+}
+
+CrossingHistory::~CrossingHistory() {
+}
+
+void CrossingHistory::setup(int occupancy) {
+  memset(&stats, 0, sizeof(stats));
+
+  // Times are ticks from the epoch - after a restart only a real clock says how far on we are
+  uint32_t now = secondsNow();
+  if (!validate() || !ring.epochIsUnix || !Time.isValid() || now < ring.epoch) {
+    clear(occupancy);
+    return;
+  }
+
+  uint32_t elapsed = (now - ring.epoch) * (1000 / HISTORY_TICK_MS);
+  uint32_t since = (elapsed > ring.headTicks) ? elapsed - ring.headTicks : 0;
+  headAt = millis() - since * HISTORY_TICK_MS;
+  unsentSince = millis();
+  stats.restored = true;
+  record(HISTORY_COUNT_SET, 0, occupancy);          // Only written if the count was restored from flash or set while we were down
+}
+
+void CrossingHistory::clear(int occupancy) {
+  memset(&ring, 0, sizeof(ring));
+  ring.magic = HISTORY_MAGIC;
+  ring.epoch = secondsNow();
+  ring.epochIsUnix = Time.isValid();
+  ring.tailCount = occupancy;
+  ring.headCount = occupancy;
+  headAt = millis();
+  unsentSince = millis();
+}
+
+// The ring decodes end to end into exactly the records the anchor and head say it holds
+bool CrossingHistory::validate() const {
+  if (ring.magic != HISTORY_MAGIC || ring.tail >= HISTORY_BYTES || ring.used > HISTORY_BYTES || ring.sent > ring.records) return false;
+
+  HistoryDecoder decoder;
+  decoder.start(ring.tailTicks, ring.tailCount);
+  uint16_t records = 0;
+  size_t sentBytes = 0;
+  for (size_t offset = 0; offset < ring.used; offset++) {
+    if (!decoder.feed(ring.bytes[(ring.tail + offset) % HISTORY_BYTES])) continue;
+    if (++records == ring.sent) sentBytes = offset + 1;
+  }
+  return !decoder.failed() && decoder.atRecordBoundary() && records == ring.records && sentBytes == ring.sentBytes &&
+         decoder.get().ticks == ring.headTicks && decoder.get().count == ring.headCount;
+}
+
+void CrossingHistory::record(HistoryKind kind, uint8_t confidence, int occupancy) {
+  // A count that moved some other way first gets a record of its own, so entries and exits still add up
+  int step = (kind == HISTORY_ENTERED) ? 1 : (kind == HISTORY_EXITED) ? -1 : 0;
+  if (kind == HISTORY_COUNT_SET && ring.headCount == occupancy) return;
+  if (kind != HISTORY_COUNT_SET && ring.headCount + step != occupancy) record(HISTORY_COUNT_SET, 0, occupancy - step);
+
+  unsigned long elapsed = (millis() - headAt) / HISTORY_TICK_MS;
+  headAt += elapsed * HISTORY_TICK_MS;                  // Keep the part of a tick that has not passed yet
+
+  if (!ring.epochIsUnix && Time.isValid()) {            // The clock was set - move the epoch to Unix time, the ticks stay as they are
+    uint32_t ticks = ring.headTicks + elapsed;
+    ring.epoch = (uint32_t)Time.now() - ticks / (1000 / HISTORY_TICK_MS);
+    ring.epochIsUnix = true;
+  }
+
+  HistoryRecord entry = {ring.headTicks + (uint32_t)elapsed, kind, confidence, occupancy};
+  HistoryEncoder encoder;
+  encoder.start(ring.headTicks, ring.headCount);
+  uint8_t bytes[HISTORY_RECORD_MAX_BYTES];
+  size_t length = encoder.encode(entry, bytes);
+
+  while ((size_t)(HISTORY_BYTES - ring.used) < length) dropOldest();
+  for (size_t i = 0; i < length; i++) ring.bytes[(ring.tail + ring.used + i) % HISTORY_BYTES] = bytes[i];
+  ring.used += length;
+  ring.records++;
+  ring.headTicks = encoder.lastTicks;
+  ring.headCount = encoder.lastCount;
+  if (ring.records - ring.sent == 1) unsentSince = millis();
+
+  stats.written++;
+  stats.writtenBytes += length;
+}
+
+// Decodes the oldest record into the anchor and frees its bytes
+void CrossingHistory::dropOldest() {
+  HistoryDecoder decoder;
+  decoder.start(ring.tailTicks, ring.tailCount);
+  size_t length = 0;
+  while (length < ring.used) {
+    if (decoder.feed(ring.bytes[(ring.tail + length++) % HISTORY_BYTES])) break;
+  }
+
+  ring.tail = (ring.tail + length) % HISTORY_BYTES;
+  ring.used -= length;
+  ring.records--;
+  ring.tailTicks = decoder.get().ticks;
+  ring.tailCount = decoder.get().count;
+  stats.dropped++;
+  if (ring.sent) {
+    ring.sent--;
+    ring.sentBytes -= length;
+  }
+  else stats.lost++;
+}
+
+// Decodes the oldest records - returns the offset after them, the decoder holds the last one (or the anchor)
+size_t CrossingHistory::walk(uint16_t records, HistoryDecoder &decoder) const {
+  decoder.start(ring.tailTicks, ring.tailCount);
+  size_t offset = 0;
+  for (uint16_t done = 0; done < records && offset < ring.used; ) {
+    if (decoder.feed(ring.bytes[(ring.tail + offset++) % HISTORY_BYTES])) done++;
+  }
+  return offset;
+}
+
+bool CrossingHistory::uploadDue() const {
+  if (ring.records == ring.sent) return false;
+  return (ring.used - ring.sentBytes >= HISTORY_UPLOAD_BYTES) || (millis() - unsentSince >= HISTORY_UPLOAD_INTERVAL_MS);
+}
+
+uint16_t CrossingHistory::exportBatch(uint8_t *out, size_t length, size_t &used) const {
+  used = 0;
+  if (ring.records == ring.sent || length < HISTORY_RECORD_MAX_BYTES * 2) return 0;
+
+  HistoryDecoder decoder;
+  size_t offset = walk(ring.sent, decoder);
+  HistoryEncoder encoder;
+  used = encoder.header(ring.epoch, decoder.get().ticks, decoder.get().count, out);
+
+  // The records go out as they are - each is relative to the one before, and the first to the header
+  uint16_t records = 0;
+  size_t recordStart = offset;
+  while (offset < ring.used) {
+    if (!decoder.feed(ring.bytes[(ring.tail + offset++) % HISTORY_BYTES])) continue;
+    size_t recordLength = offset - recordStart;
+    if (used + recordLength > length) break;
+    for (size_t i = 0; i < recordLength; i++) out[used++] = ring.bytes[(ring.tail + recordStart + i) % HISTORY_BYTES];
+    recordStart = offset;
+    records++;
+  }
+  if (!records) used = 0;
+  return records;
+}
+
+uint16_t CrossingHistory::format(char *buffer, size_t length) const {
+  if (length < 5) return 0;
+  size_t capacity = (length - 1) / 4 * 3;              // Room for the terminator
+  if (capacity > sizeof(batch)) capacity = sizeof(batch);
+
+  size_t used;
+  uint16_t records = exportBatch(batch, capacity, used);
+  base64(batch, used, buffer);
+  return records;
+}
+
+void CrossingHistory::markSent(uint16_t records) {
+  uint16_t unsent = ring.records - ring.sent;
+  if (records > unsent) records = unsent;
+  HistoryDecoder decoder;
+  ring.sentBytes = walk(ring.sent + records, decoder);
+  ring.sent += records;
+}
+
+bool CrossingHistory::getRecord(uint16_t index, HistoryRecord &record) const {
+  if (index >= ring.records) return false;
+  HistoryDecoder decoder;
+  walk(index + 1, decoder);
+  record = decoder.get();
+  return true;
+}
+
+uint16_t CrossingHistory::getRecords() const {
+  return ring.records;
+}
+
+uint16_t CrossingHistory::getUnsent() const {
+  return ring.records - ring.sent;
+}
+
+size_t CrossingHistory::getBytes() const {
+  return ring.used;
+}
+
+uint32_t CrossingHistory::getEpoch() const {
+  return ring.epoch;
+}
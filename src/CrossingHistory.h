@@ -0,0 +1,229 @@
+// Crossing History Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class keeps every counted pass - when, which way, how confident - as a compact event history for upload and storage
+// Each record is one varint: the time since the record before it in HISTORY_TICK_MS ticks, the kind and the confidence in
+// quarters, so a pass on a busy door takes two bytes where a JSON event would take forty. The records sit in a bounded
+// ring in retained memory - when it fills, the oldest are decoded away into the anchor (the time and count before the
+// first record), so the ring always decodes on its own and a warm restart keeps it.
+// An upload is a batch - a header with the anchor, then the records copied as they are - sent base64 by CloudPublisher
+// Batches are decoded on a desktop with tools/history/HistoryDecode.cpp
+//
+// Format (version 1), every field an unsigned LEB128 varint, signed fields zigzag encoded:
+//   batch:  version, epoch seconds (Unix time once the clock is set, uptime before), anchor ticks, anchor count (signed), records...
+//   record: (ticks since the previous record << 4) | (kind << 2) | confidence quarter
+//           HISTORY_COUNT_SET is followed by the new count (signed) - the count is otherwise carried by entries and exits
+
+#ifndef __CROSSINGHISTORY_H
+#define __CROSSINGHISTORY_H
+
+#include "Particle.h"
+
+#define HISTORY_FORMAT_VERSION 1
+#define HISTORY_BYTES 2048                          // Ring size - about a thousand passes at a busy door
+#define HISTORY_TICK_MS 100                         // Time resolution of a record
+#define HISTORY_RECORD_MAX_BYTES 10                 // A count set record - two five byte varints
+#define HISTORY_UPLOAD_BYTES 384                    // Unsent records worth an event on their own ...
+#define HISTORY_UPLOAD_INTERVAL_MS (15UL * 60UL * 1000UL)   // ... otherwise they wait this long for company
+
+/**
+ * @brief What a record says happened
+ */
+enum HistoryKind : uint8_t {
+    HISTORY_ABORTED,                        // Turned back - the count is unchanged
+    HISTORY_ENTERED,
+    HISTORY_EXITED,
+    HISTORY_COUNT_SET                       // The count was set by hand or restored to something else
+};
+
+/**
+ * @brief One decoded record
+ */
+struct HistoryRecord {
+    uint32_t ticks;                         // HISTORY_TICK_MS since the epoch
+    HistoryKind kind;
+    uint8_t confidence;                     // 0 - 100, to the quarter it was stored at (0, 25, 50 or 75)
+    int32_t count;                          // Occupancy after the record
+};
+
+/**
+ * @brief Streaming encoder - each record is written relative to the one before
+ */
+class HistoryEncoder {
+public:
+    /**
+     * @brief Sets the time and count the next record follows
+     */
+    void start(uint32_t ticks, int32_t count) { lastTicks = ticks; lastCount = count; }
+
+    /**
+     * @brief Writes one record (at most HISTORY_RECORD_MAX_BYTES) - returns the length
+     *
+     * Only a count set record carries its count - an entry or exit is one more or one less than the record before.
+     */
+    size_t encode(const HistoryRecord &record, uint8_t *out);
+
+    /**
+     * @brief Writes a batch header - at most HISTORY_RECORD_MAX_BYTES * 2 - and starts at its anchor
+     */
+    size_t header(uint32_t epoch, uint32_t ticks, int32_t count, uint8_t *out);
+
+    static size_t putVarint(uint32_t value, uint8_t *out);
+    static uint32_t zigzag(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+
+    uint32_t lastTicks = 0;
+    int32_t lastCount = 0;
+};
+
+/**
+ * @brief Streaming decoder - feed it bytes as they arrive, a record is ready each time feed() returns true
+ */
+class HistoryDecoder {
+public:
+    /**
+     * @brief Decodes bare records following this time and count (the ring)
+     */
+    void start(uint32_t ticks, int32_t count);
+
+    /**
+     * @brief Decodes a batch - the header comes first
+     */
+    void startBatch();
+
+    /**
+     * @brief Takes one byte - true when it completes a record
+     */
+    bool feed(uint8_t byte);
+
+    const HistoryRecord &get() const { return record; }
+    uint32_t getEpoch() const { return epoch; }
+    bool failed() const { return stage == STAGE_ERROR; }
+
+    /**
+     * @brief Between records - a batch that ends anywhere else was cut short
+     */
+    bool atRecordBoundary() const { return stage == STAGE_RECORD && shift == 0; }
+
+protected:
+    enum Stage : uint8_t { STAGE_VERSION, STAGE_EPOCH, STAGE_TICKS, STAGE_COUNT, STAGE_RECORD, STAGE_SET_COUNT, STAGE_ERROR };
+
+    bool field(uint32_t value);
+
+    Stage stage = STAGE_RECORD;
+    uint32_t value = 0;
+    uint8_t shift = 0;
+    uint32_t epoch = 0;
+    HistoryRecord record = {0, HISTORY_ABORTED, 0, 0};
+};
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From global application setup you must call:
+ * CrossingHistory::instance().setup(count);
+ *
+ * PeopleCounter records the passes; CloudPublisher uploads them when uploadDue().
+ */
+class CrossingHistory {
+public:
+    struct HistoryStats {
+        uint32_t written;                   // Records since boot
+        uint32_t writtenBytes;
+        uint32_t dropped;                   // Pushed out of the ring to make room
+        uint32_t lost;                      // ... before they were uploaded
+        bool restored;                      // The ring survived the restart
+    };
+
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use CrossingHistory::instance() to instantiate the singleton.
+     */
+    static CrossingHistory &instance();
+
+    /**
+     * @brief Keeps the retained ring if it decodes and the clock can carry on from it, otherwise starts an empty one
+     *
+     * You typically use CrossingHistory::instance().setup(count);
+     */
+    void setup(int occupancy = 0);
+
+    /**
+     * @brief Adds a record at the current time - called by PeopleCounter with the count after the change
+     */
+    void record(HistoryKind kind, uint8_t confidence, int occupancy);
+
+    /**
+     * @brief Unsent records have filled HISTORY_UPLOAD_BYTES or waited HISTORY_UPLOAD_INTERVAL_MS
+     */
+    bool uploadDue() const;
+
+    /**
+     * @brief Writes the oldest unsent records as a batch (header and whole records only)
+     *
+     * @return The number of records in the batch - 0 if there is nothing to send or no room
+     */
+    uint16_t exportBatch(uint8_t *out, size_t length, size_t &used) const;
+
+    /**
+     * @brief The same batch base64 encoded and terminated - an event payload
+     */
+    uint16_t format(char *buffer, size_t length) const;
+
+    /**
+     * @brief The oldest records went out - they stay in the ring until it needs the room
+     */
+    void markSent(uint16_t records);
+
+    /**
+     * @brief A record by age from the oldest (0) - decodes the ring up to it
+     */
+    bool getRecord(uint16_t index, HistoryRecord &record) const;
+
+    uint16_t getRecords() const;
+    uint16_t getUnsent() const;
+    size_t getBytes() const;
+    uint32_t getEpoch() const;
+    const HistoryStats &getStats() const { return stats; }
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use CrossingHistory::instance() to instantiate the singleton.
+     */
+    CrossingHistory();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~CrossingHistory();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    CrossingHistory(const CrossingHistory&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    CrossingHistory& operator=(const CrossingHistory&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static CrossingHistory *_instance;
+
+    void clear(int occupancy);
+    bool validate() const;
+    void dropOldest();
+    size_t walk(uint16_t records, HistoryDecoder &decoder) const;
+
+    HistoryStats stats;
+    unsigned long headAt = 0;               // millis() of the newest record's tick
+    unsigned long unsentSince = 0;          // When the oldest unsent record was written
+};
+#endif  /* __CROSSINGHISTORY_H */
@@ -6,5 +6,7 @@
 #define SENSOR_TIMEOUT_ERROR -3
 #define SENSOR_INITIALIZATION_ERROR -4
 #define SENSOR_BUFFRER_NOT_FULL -5
+#define SENSOR_FAULT_ERROR -6
+#define SENSOR_RECOVERING -7
 
 #endif
\ No newline at end of file
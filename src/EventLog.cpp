@@ -0,0 +1,91 @@
+// Event Log Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This is a deferred, allocation-free log for the counting hot path
+// Recording an event only stores an event id, a timestamp and up to four integers in a ring buffer
+// Formatting and output to the log handlers happen later from loop() when the application is idle
+
+#include "Particle.h"
+#include "EventLog.h"
+
+// Format strings indexed by EventLogId - all four arguments are always passed, unused ones are ignored
+static const char * const eventFormats[EVENT_LOG_ID_COUNT] = {
+  "Sensor Timed out",
+  "Occupancy state changed from %ld to %ld (%ldkcps/SPAD / %ldkcps/SPAD)",
+  "Calibration Complete - target zone is clear with zone1 at %ldkcps/SPAD and zone2 at %ldkcps/SPAD",
+  "Calibration Complete - saved baselines were stale, re-learned zone1 at %ldkcps/SPAD and zone2 at %ldkcps/SPAD",
+  "Zone%ld baseline re-learned at %ldkcps/SPAD",
+  "Occupancy %s %ld",
+  "[ERROR WHEN COUNTING] Impossible sequence: %05ld",
+  "Occupancy is now %ld",
+  "Temperature recalibration (reason %ld) paused counting for %ldmS (timed out: %ld)",
+  "Offset calibration complete - zone1 %ldmm zone2 %ldmm",
+  "Crosstalk calibration complete - zone1 %ldcps zone2 %ldcps",
+  "Calibration job %ld timed out with %ld / %ld frames - keeping previous values",
+  "Person too fast (direction %ld) - %ldmm/s, %ldmS across the zones with %ldmS frames",
+  "Crossing (direction %ld) at %ldmm/s, confidence %ld%% (too slow: %ld)",
+  "Depth scan sweep %ld complete - %ld obstructed tiles",
+  "Zone placement chose centers %ld / %ld, %ld SPADs wide (score %ld)",
+  "Occupancy limit alert level %ld (was %ld) - count %ld, limit %ld",
+  "Sensor recovery step %ld (answered: %ld) took %ldmS",
+  "Sensor recovered after step %ld - %ldmS without counting",
+  "Learned signature %ld from %ld episodes of %ld frames",
+  "Masked an episode matching signature %ld at frame %ld",
+  "Task %ld overran %ld times and ran late %ld times, longest %ldus",
+  "Power profile %ld (was %ld), %lds since anyone passed"
+};
+
+static_assert(EVENT_LOG_SIZE && !(EVENT_LOG_SIZE & (EVENT_LOG_SIZE - 1)), "EVENT_LOG_SIZE must be a power of two");
+
+EventLog *EventLog::_instance;
+
+// [static]
+EventLog &EventLog::instance() {
+  if (!_instance) {
+      _instance = new EventLog();
+  }
+  return *_instance;
+}
+
+EventLog::EventLog() {
+  for (int i = 0; i < EVENT_LOG_ID_COUNT; i++) renderers[i] = NULL;
+}
+
+EventLog::~EventLog() {
+}
+
+void EventLog::setup() {
+}
+
+void EventLog::setRenderer(EventLogId id, void (*renderer)(const EventLogEntry &entry)) {
+  if (id < EVENT_LOG_ID_COUNT) renderers[id] = renderer;
+}
+
+void EventLog::loop() {
+  char message[128];
+
+  for (int i = 0; i < EVENT_LOG_DRAIN_BUDGET && tail != head; i++) {
+    const EventLogEntry &entry = ring[tail];
+    const int32_t *args = entry.args;
+
+    if (entry.id >= EVENT_LOG_ID_COUNT) Log.info("[%lu] Unknown event %d", (unsigned long)entry.timestamp, entry.id);
+    else if (renderers[entry.id]) renderers[entry.id](entry);
+    else if (entry.id == EVENT_COUNT_CHANGED) {
+      snprintf(message, sizeof(message), eventFormats[entry.id], args[0] ? "increased to" : "decreased to", (long)args[1]);
+      Log.info("[%lu] %s", (unsigned long)entry.timestamp, message);
+    }
+    else {
+      snprintf(message, sizeof(message), eventFormats[entry.id], (long)args[0], (long)args[1], (long)args[2], (long)args[3]);
+      Log.info("[%lu] %s", (unsigned long)entry.timestamp, message);
+    }
+
+    tail = (tail + 1) & (EVENT_LOG_SIZE - 1);            // Only release the slot once we are done with it
+  }
+
+  uint32_t droppedNow = dropped;
+  if (droppedNow != droppedReported) {
+    Log.info("Event log full - dropped %lu events (%lu total)", (unsigned long)(droppedNow - droppedReported), (unsigned long)droppedNow);
+    droppedReported = droppedNow;
+  }
+}
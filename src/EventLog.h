@@ -0,0 +1,163 @@
+// Event Log Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This is a deferred, allocation-free log for the counting hot path
+// Recording an event only stores an event id, a timestamp and up to four integers in a ring buffer
+// Formatting and output to the log handlers happen later from loop() when the application is idle
+
+#ifndef __EVENTLOG_H
+#define __EVENTLOG_H
+
+#include "Particle.h"
+
+#define EVENT_LOG_SIZE 64                   // Entries in the ring - must be a power of two
+#define EVENT_LOG_DRAIN_BUDGET 4            // Maximum entries formatted per call to loop()
+
+/**
+ * @brief Event ids - each one has a matching format string in EventLog.cpp (keep the two in the same order)
+ */
+enum EventLogId : uint8_t {
+    EVENT_SENSOR_TIMEOUT,               // no args
+    EVENT_OCCUPANCY_STATE,              // old state, new state, zone1 signal, zone2 signal
+    EVENT_CALIBRATION_COMPLETE,         // zone1 baseline, zone2 baseline
+    EVENT_CALIBRATION_RELEARNED,        // zone1 baseline, zone2 baseline
+    EVENT_BASELINE_RELEARNED,           // zone, baseline
+    EVENT_COUNT_CHANGED,                // 1 increased / 0 decreased, new count
+    EVENT_IMPOSSIBLE_SEQUENCE,          // sequence as a five digit number
+    EVENT_BIG_NUMBER,                   // count - rendered by PeopleCounter when TENFOOTDISPLAY is set
+    EVENT_VHV_RECALIBRATED,             // reason (1 elapsed time / 2 signal drift), pause in ms, 1 if it timed out
+    EVENT_OFFSET_CALIBRATED,            // zone1 offset, zone2 offset (mm)
+    EVENT_XTALK_CALIBRATED,             // zone1 crosstalk, zone2 crosstalk (cps)
+    EVENT_CALIBRATION_JOB_TIMEOUT,      // job type (1 offset / 2 crosstalk), zone1 frames, zone2 frames
+    EVENT_PERSON_TOO_FAST,              // direction (1 in / -1 out), speed mm/s (0 if too quick to time), transit ms, frame interval ms
+    EVENT_CROSSING,                     // direction (1 in / -1 out / 0 none), speed mm/s, confidence %, 1 if implausibly slow
+    EVENT_DEPTH_SCAN_SWEEP,             // sweeps completed, obstructed tiles
+    EVENT_ZONE_PLACEMENT,               // front center, back center (0 if nothing scored), width, score x10
+    EVENT_LIMIT_LEVEL,                  // new level, previous level, count, limit
+    EVENT_SENSOR_RECOVERY,              // recovery step (RecoveryStep), 1 if the sensor answered afterwards, ms taken
+    EVENT_SENSOR_RECOVERED,             // last recovery step needed, outage ms
+    EVENT_SIGNATURE_LEARNED,            // slot, occurrences, frames
+    EVENT_SIGNATURE_MASKED,             // slot, frame of the episode it matched at
+    EVENT_TASK_OVERRUN,                 // task, overruns, late runs (since the last report), longest run us
+    EVENT_PROFILE_CHANGED,              // new profile, previous profile, seconds since the last occupied frame
+    EVENT_LOG_ID_COUNT
+};
+
+/**
+ * @brief A single entry in the ring - fixed size, no pointers
+ */
+struct EventLogEntry {
+    uint32_t timestamp;                 // millis() when the event was recorded
+    uint8_t id;                         // EventLogId
+    int32_t args[4];
+};
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From global application setup you must call:
+ * EventLog::instance().setup();
+ *
+ * From global application loop you must call (ideally when there is nothing else to do):
+ * EventLog::instance().loop();
+ */
+class EventLog {
+public:
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use EventLog::instance() to instantiate the singleton.
+     */
+    static EventLog &instance();
+
+    /**
+     * @brief Perform setup operations; call this from global application setup()
+     *
+     * You typically use EventLog::instance().setup();
+     */
+    void setup();
+
+    /**
+     * @brief Formats and outputs up to EVENT_LOG_DRAIN_BUDGET pending entries
+     *
+     * Call this when the acquisition loop is idle. Also reports entries dropped since the last call.
+     */
+    void loop();
+
+    /**
+     * @brief Records an event - a handful of stores, never formats, never blocks
+     *
+     * If the ring is full the event is dropped and counted rather than overwriting unread entries.
+     */
+    inline void record(EventLogId id, int32_t a = 0, int32_t b = 0, int32_t c = 0, int32_t d = 0) {
+        uint16_t next = (head + 1) & (EVENT_LOG_SIZE - 1);
+        if (next == tail) {
+            dropped++;
+            return;
+        }
+        EventLogEntry &entry = ring[head];
+        entry.timestamp = millis();
+        entry.id = id;
+        entry.args[0] = a;
+        entry.args[1] = b;
+        entry.args[2] = c;
+        entry.args[3] = d;
+        head = next;
+    }
+
+    /**
+     * @brief Registers a function that renders an event instead of its format string
+     *
+     * Used for multi-line output such as the ten foot display.
+     */
+    void setRenderer(EventLogId id, void (*renderer)(const EventLogEntry &entry));
+
+    /**
+     * @brief Returns true if there are entries waiting to be output
+     */
+    bool isPending() const { return head != tail; }
+
+    /**
+     * @brief Total number of events dropped because the ring was full
+     */
+    uint32_t getDropped() const { return dropped; }
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use EventLog::instance() to instantiate the singleton.
+     */
+    EventLog();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~EventLog();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    EventLog(const EventLog&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    EventLog& operator=(const EventLog&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static EventLog *_instance;
+
+    EventLogEntry ring[EVENT_LOG_SIZE];
+    volatile uint16_t head = 0;                 // Next slot to write - only changed by record()
+    volatile uint16_t tail = 0;                 // Next slot to output - only changed by loop()
+    volatile uint32_t dropped = 0;
+    uint32_t droppedReported = 0;
+    void (*renderers[EVENT_LOG_ID_COUNT])(const EventLogEntry &entry);
+};
+#endif  /* __EVENTLOG_H */
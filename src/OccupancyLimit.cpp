@@ -0,0 +1,111 @@
+// Occupancy Limit Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class acts on the occupancy limit - the alert level is raised on the frame the count crosses it
+// update() is a few comparisons, called by PeopleCounter whenever the count changes; loop() handles the timers
+// (hold-off before an alert clears, escalation when the room stays over the limit) and drives the LED and alert pin
+// Levels only drop once the count is LIMIT_HYSTERESIS below the threshold for LIMIT_HOLDOFF_MS so a busy door does not flap
+
+#include "Particle.h"
+#include "PeopleCounterConfig.h"
+#include "OccupancyLimit.h"
+#include "ConfigStore.h"
+#include "EventLog.h"
+
+OccupancyLimit *OccupancyLimit::_instance;
+
+// [static]
+OccupancyLimit &OccupancyLimit::instance() {
+  if (!_instance) {
+      _instance = new OccupancyLimit();
+  }
+  return *_instance;
+}
+
+OccupancyLimit::OccupancyLimit() {
+}
+
+OccupancyLimit::~OccupancyLimit() {
+}
+
+void OccupancyLimit::setup(int occupancy) {
+  pinMode(LIMIT_ALERT_PIN, OUTPUT);
+  digitalWrite(LIMIT_ALERT_PIN, LOW);
+  limit = ConfigStore::instance().get().peopleLimit;
+  count = occupancy;
+  level = levelFor(occupancy);                      // A restart does not re-announce an alert, it just resumes it
+  overSince = (limit && occupancy > limit) ? millis() : 0;
+  lowerSince = 0;
+  digitalWrite(LIMIT_ALERT_PIN, (level >= LIMIT_OVER) ? HIGH : LOW);
+}
+
+void OccupancyLimit::setCallback(void (*newCallback)(LimitLevel level, LimitLevel previous, int occupancy, int limit)) {
+  callback = newCallback;
+}
+
+// The level a count calls for, without hysteresis or timers - a limit of 0 means there is no limit
+LimitLevel OccupancyLimit::levelFor(int occupancy) const {
+  if (limit <= 0 || occupancy < limit) return LIMIT_NORMAL;
+  if (occupancy == limit) return LIMIT_AT_CAPACITY;
+  if (occupancy >= limit + LIMIT_CRITICAL_MARGIN) return LIMIT_ESCALATED;
+  return LIMIT_OVER;
+}
+
+void OccupancyLimit::update(int occupancy) {
+  count = occupancy;
+
+  if (limit > 0 && occupancy > limit) {
+    if (!overSince) overSince = millis() | 1;       // Never 0 - that means "not over"
+  }
+  else overSince = 0;
+
+  LimitLevel target = levelFor(occupancy);
+  if (target > level) {                             // Up - at once
+    lowerSince = 0;
+    changeLevel(target);
+    return;
+  }
+
+  // Down - only once the count is clear of the threshold by the hysteresis (escalation by time holds while still over)
+  bool mayLower = levelFor(occupancy + LIMIT_HYSTERESIS) < level && !(level == LIMIT_ESCALATED && overSince);
+  if (!mayLower) lowerSince = 0;
+  else if (!lowerSince) lowerSince = millis() | 1;
+}
+
+void OccupancyLimit::changeLevel(LimitLevel newLevel) {
+  LimitLevel previous = level;
+  level = newLevel;
+
+  digitalWrite(LIMIT_ALERT_PIN, (level >= LIMIT_OVER) ? HIGH : LOW);
+  ledOn = (level != LIMIT_NORMAL);
+  digitalWrite(LIMIT_LED_PIN, ledOn ? HIGH : LOW);
+  lastBlink = millis();
+
+  EventLog::instance().record(EVENT_LIMIT_LEVEL, level, previous, count, limit);
+  if (callback) callback(level, previous, count, limit);
+}
+
+void OccupancyLimit::loop() {
+  unsigned long now = millis();
+
+  int configured = ConfigStore::instance().get().peopleLimit;
+  if (configured != limit) {                        // Limit changed at runtime - judge the current count against it
+    limit = configured;
+    update(count);
+  }
+
+  if (lowerSince && now - lowerSince >= LIMIT_HOLDOFF_MS) {
+    lowerSince = 0;
+    changeLevel(levelFor(count));
+  }
+  if (level == LIMIT_OVER && overSince && now - overSince >= LIMIT_ESCALATE_MS) changeLevel(LIMIT_ESCALATED);
+
+  // At capacity - steady, over - slow blink, escalated - fast blink
+  unsigned long blinkMs = (level == LIMIT_OVER) ? LIMIT_BLINK_SLOW_MS : (level == LIMIT_ESCALATED) ? LIMIT_BLINK_FAST_MS : 0;
+  if (blinkMs && now - lastBlink >= blinkMs) {
+    ledOn = !ledOn;
+    digitalWrite(LIMIT_LED_PIN, ledOn ? HIGH : LOW);
+    lastBlink = now;
+  }
+}
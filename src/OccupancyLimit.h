@@ -0,0 +1,116 @@
+// Occupancy Limit Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class acts on the occupancy limit - the alert level is raised on the frame the count crosses it
+// update() is a few comparisons, called by PeopleCounter whenever the count changes; loop() handles the timers
+// (hold-off before an alert clears, escalation when the room stays over the limit) and drives the LED and alert pin
+// Levels only drop once the count is LIMIT_HYSTERESIS below the threshold for LIMIT_HOLDOFF_MS so a busy door does not flap
+
+#ifndef __OCCUPANCYLIMIT_H
+#define __OCCUPANCYLIMIT_H
+
+#include "Particle.h"
+
+/**
+ * @brief Alert levels, lowest to highest
+ */
+enum LimitLevel : uint8_t {
+    LIMIT_NORMAL,                           // Below the limit
+    LIMIT_AT_CAPACITY,                      // At the limit - the next person in is one too many
+    LIMIT_OVER,                             // Above the limit
+    LIMIT_ESCALATED                         // Over for LIMIT_ESCALATE_MS or by LIMIT_CRITICAL_MARGIN
+};
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From global application setup you must call (after PeopleCounter):
+ * OccupancyLimit::instance().setup(count);
+ *
+ * From global application loop you must call:
+ * OccupancyLimit::instance().loop();
+ */
+class OccupancyLimit {
+public:
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use OccupancyLimit::instance() to instantiate the singleton.
+     */
+    static OccupancyLimit &instance();
+
+    /**
+     * @brief Sets up the outputs and takes the level for the restored count (no hold-off)
+     *
+     * You typically use OccupancyLimit::instance().setup(PeopleCounter::instance().getCount());
+     */
+    void setup(int occupancy);
+
+    /**
+     * @brief Runs the hold-off and escalation timers, picks up a changed limit and drives the LED
+     *
+     * You typically use OccupancyLimit::instance().loop();
+     */
+    void loop();
+
+    /**
+     * @brief Re-evaluates for a new count - raising the level happens here, on the same frame
+     */
+    void update(int occupancy);
+
+    /**
+     * @brief Called on every level change with the new and previous levels
+     */
+    void setCallback(void (*callback)(LimitLevel level, LimitLevel previous, int occupancy, int limit));
+
+    LimitLevel getLevel() const { return level; }
+
+    /**
+     * @brief True while the alert owns the LED - the application's heartbeat blink should stand aside
+     */
+    bool isDrivingLed() const { return level != LIMIT_NORMAL; }
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use OccupancyLimit::instance() to instantiate the singleton.
+     */
+    OccupancyLimit();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~OccupancyLimit();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    OccupancyLimit(const OccupancyLimit&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    OccupancyLimit& operator=(const OccupancyLimit&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static OccupancyLimit *_instance;
+
+    LimitLevel levelFor(int occupancy) const;
+    void changeLevel(LimitLevel newLevel);
+
+    LimitLevel level = LIMIT_NORMAL;
+    int count = 0;
+    int limit = 0;                          // The limit the level was worked out against
+    unsigned long overSince = 0;            // millis() when the count went over the limit
+    unsigned long lowerSince = 0;           // millis() when the count first qualified for a lower level (0 - it does not)
+    unsigned long lastBlink = 0;
+    bool ledOn = false;
+    void (*callback)(LimitLevel level, LimitLevel previous, int occupancy, int limit) = NULL;
+};
+#endif  /* __OCCUPANCYLIMIT_H */
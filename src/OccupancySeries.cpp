@@ -0,0 +1,162 @@
+// Occupancy Series Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class bins entries, exits, peak occupancy and aborted passes into per-minute, per-hour and per-day buckets
+// Each resolution is a fixed size ring - the oldest bucket is reused when time moves on, nothing is ever allocated
+// Uploading a handful of buckets replaces a publish per person
+
+#include "Particle.h"
+#include "OccupancySeries.h"
+
+// Unix time once the cloud has set the clock - seconds since boot until then
+static uint32_t seriesNow() {
+  return Time.isValid() ? (uint32_t)Time.now() : System.uptime();
+}
+
+static void clearBin(OccupancyBin &bin, uint32_t start, int occupancy) {
+  bin.start = start;
+  bin.entries = 0;
+  bin.exits = 0;
+  bin.peakOccupancy = (int16_t)occupancy;
+  bin.aborted = 0;
+}
+
+OccupancySeries *OccupancySeries::_instance;
+
+// [static]
+OccupancySeries &OccupancySeries::instance() {
+  if (!_instance) {
+      _instance = new OccupancySeries();
+  }
+  return *_instance;
+}
+
+OccupancySeries::OccupancySeries() {
+  rings[SERIES_MINUTE] = {minuteBins, SERIES_MINUTE_BINS, 0, 0, 60UL};
+  rings[SERIES_HOUR] = {hourBins, SERIES_HOUR_BINS, 0, 0, 3600UL};
+  rings[SERIES_DAY] = {dayBins, SERIES_DAY_BINS, 0, 0, 86400UL};
+}
+
+OccupancySeries::~OccupancySeries() {
+}
+
+void OccupancySeries::setup(int startingOccupancy) {
+  occupancy = startingOccupancy;
+  for (int r = 0; r < SERIES_RESOLUTION_COUNT; r++) rings[r].used = 0;
+  nextBoundary = 0;
+  unixTime = Time.isValid();
+  advance(seriesNow());
+}
+
+void OccupancySeries::loop() {
+  if (!unixTime && Time.isValid()) rebase();
+  uint32_t now = seriesNow();
+  if (now >= nextBoundary) advance(now);
+}
+
+// Moves each ring to the bucket holding now - skipped buckets are cleared, at most one full lap
+void OccupancySeries::advance(uint32_t now) {
+  nextBoundary = UINT32_MAX;
+
+  for (int r = 0; r < SERIES_RESOLUTION_COUNT; r++) {
+    Ring &ring = rings[r];
+    uint32_t slotStart = now - now % ring.period;
+
+    if (ring.used == 0) {
+      ring.head = 0;
+      ring.used = 1;
+      clearBin(ring.bins[0], slotStart, occupancy);
+    }
+    else if (slotStart > ring.bins[ring.head].start) {  // A clock that steps backwards keeps filling the current bucket
+      uint32_t steps = (slotStart - ring.bins[ring.head].start) / ring.period;
+      if (steps > ring.size) steps = ring.size;
+      for (uint32_t step = steps; step > 0; step--) {
+        ring.head = (ring.head + 1) % ring.size;
+        clearBin(ring.bins[ring.head], slotStart - (step - 1) * ring.period, occupancy);
+      }
+      ring.used = (ring.used + steps > ring.size) ? ring.size : ring.used + steps;
+    }
+
+    uint32_t boundary = ring.bins[ring.head].start + ring.period;
+    if (boundary < nextBoundary) nextBoundary = boundary;
+  }
+}
+
+// The clock was set - moves every bucket to Unix time so the first sync does not look like a gap that clears the rings
+// Starts are aligned down to their period; consecutive buckets stay one period apart
+void OccupancySeries::rebase() {
+  uint32_t offset = (uint32_t)Time.now() - System.uptime();
+  for (int r = 0; r < SERIES_RESOLUTION_COUNT; r++) {
+    Ring &ring = rings[r];
+    for (uint16_t age = 0; age < ring.used; age++) {
+      OccupancyBin &bin = ring.bins[(ring.head + ring.size - age) % ring.size];
+      bin.start += offset;
+      bin.start -= bin.start % ring.period;
+    }
+  }
+  unixTime = true;
+  nextBoundary = 0;                                   // Let advance() find the new boundaries
+}
+
+void OccupancySeries::countEntry(int newOccupancy) {
+  loop();
+  occupancy = newOccupancy;
+  for (int r = 0; r < SERIES_RESOLUTION_COUNT; r++) {
+    OccupancyBin &bin = rings[r].bins[rings[r].head];
+    bin.entries++;
+    if (occupancy > bin.peakOccupancy) bin.peakOccupancy = (int16_t)occupancy;
+  }
+}
+
+void OccupancySeries::countExit(int newOccupancy) {
+  loop();
+  occupancy = newOccupancy;
+  for (int r = 0; r < SERIES_RESOLUTION_COUNT; r++) rings[r].bins[rings[r].head].exits++;
+}
+
+void OccupancySeries::countAborted() {
+  loop();
+  for (int r = 0; r < SERIES_RESOLUTION_COUNT; r++) rings[r].bins[rings[r].head].aborted++;
+}
+
+const OccupancyBin *OccupancySeries::getBin(Resolution resolution, uint16_t age) const {
+  const Ring &ring = rings[resolution];
+  if (age >= ring.used) return NULL;
+  return &ring.bins[(ring.head + ring.size - age) % ring.size];
+}
+
+uint16_t OccupancySeries::getTotal(Resolution resolution, uint16_t buckets, OccupancyBin &total) const {
+  uint16_t summed = 0;
+  memset(&total, 0, sizeof(total));
+
+  for (const OccupancyBin *bin; summed < buckets && (bin = getBin(resolution, summed)) != NULL; summed++) {
+    total.start = bin->start;                         // Ends up as the start of the oldest bucket
+    total.entries += bin->entries;
+    total.exits += bin->exits;
+    total.aborted += bin->aborted;
+    if (summed == 0 || bin->peakOccupancy > total.peakOccupancy) total.peakOccupancy = bin->peakOccupancy;
+  }
+  return summed;
+}
+
+size_t OccupancySeries::format(Resolution resolution, uint16_t buckets, char *buffer, size_t length) const {
+  static const char resolutionNames[SERIES_RESOLUTION_COUNT] = {'m', 'h', 'd'};
+  const OccupancyBin *newest = getBin(resolution, 0);
+  if (!newest) return 0;
+
+  int used = snprintf(buffer, length, "{\"r\":\"%c\",\"s\":%lu,\"b\":[", resolutionNames[resolution], (unsigned long)newest->start);
+  if (used < 0 || (size_t)used + 3 > length) return 0;          // Room for the closing "]}" and the terminator
+
+  const OccupancyBin *bin;
+  for (uint16_t age = 0; age < buckets && (bin = getBin(resolution, age)) != NULL; age++) {
+    int added = snprintf(buffer + used, length - used, "%s[%u,%u,%d,%u]", age ? "," : "", bin->entries, bin->exits, bin->peakOccupancy, bin->aborted);
+    if (added < 0 || (size_t)(used + added) + 3 > length) {
+      buffer[used] = '\0';                                      // Drop the partial bucket
+      break;
+    }
+    used += added;
+  }
+  used += snprintf(buffer + used, length - used, "]}");
+  return used;
+}
@@ -0,0 +1,151 @@
+// Occupancy Series Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class bins entries, exits, peak occupancy and aborted passes into per-minute, per-hour and per-day buckets
+// Each resolution is a fixed size ring - the oldest bucket is reused when time moves on, nothing is ever allocated
+// Uploading a handful of buckets replaces a publish per person
+
+#ifndef __OCCUPANCYSERIES_H
+#define __OCCUPANCYSERIES_H
+
+#include "Particle.h"
+
+#define SERIES_MINUTE_BINS 60               // One hour of minutes
+#define SERIES_HOUR_BINS 48                 // Two days of hours
+#define SERIES_DAY_BINS 31                  // A month of days
+
+/**
+ * @brief One bucket - 12 bytes
+ */
+struct OccupancyBin {
+    uint32_t start;                         // Start of the bucket in seconds (uptime until the clock is set, then moved to Unix time)
+    uint16_t entries;
+    uint16_t exits;
+    int16_t peakOccupancy;                  // Highest count seen while the bucket was current
+    uint16_t aborted;                       // Passes that turned back before crossing both zones
+};
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From global application setup you must call:
+ * OccupancySeries::instance().setup();
+ *
+ * From global application loop you must call:
+ * OccupancySeries::instance().loop();
+ */
+class OccupancySeries {
+public:
+    enum Resolution {
+        SERIES_MINUTE,
+        SERIES_HOUR,
+        SERIES_DAY,
+        SERIES_RESOLUTION_COUNT
+    };
+
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use OccupancySeries::instance() to instantiate the singleton.
+     */
+    static OccupancySeries &instance();
+
+    /**
+     * @brief Starts the current bucket at every resolution with the given occupancy as its peak
+     *
+     * You typically use OccupancySeries::instance().setup();
+     */
+    void setup(int occupancy = 0);
+
+    /**
+     * @brief Rolls the rings forward when a bucket boundary passes - a compare when nothing is due
+     *
+     * You typically use OccupancySeries::instance().loop();
+     */
+    void loop();
+
+    /**
+     * @brief Counting hooks - O(1), called by PeopleCounter with the count after the change
+     */
+    void countEntry(int occupancy);
+    void countExit(int occupancy);
+    void countAborted();
+
+    /**
+     * @brief A bucket by age - 0 is the current bucket, 1 the one before and so on
+     *
+     * @return A pointer into the ring (valid until the ring rolls over) or NULL if that bucket does not exist
+     */
+    const OccupancyBin *getBin(Resolution resolution, uint16_t age) const;
+
+    /**
+     * @brief Number of buckets held at a resolution (grows to the ring size, then stays there)
+     */
+    uint16_t getBinCount(Resolution resolution) const { return rings[resolution].used; }
+
+    /**
+     * @brief Sums the newest buckets into one - entries, exits and aborted add up, the peak is the highest
+     *
+     * @return The number of buckets summed
+     */
+    uint16_t getTotal(Resolution resolution, uint16_t buckets, OccupancyBin &total) const;
+
+    /**
+     * @brief Formats the newest buckets as compact JSON into a caller's buffer, newest first
+     *
+     * {"r":"m","s":<start of newest>,"b":[[entries,exits,peak,aborted],...]} - stops early rather than truncate a bucket
+     * @return The length written, 0 if not even the header fits
+     */
+    size_t format(Resolution resolution, uint16_t buckets, char *buffer, size_t length) const;
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use OccupancySeries::instance() to instantiate the singleton.
+     */
+    OccupancySeries();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~OccupancySeries();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    OccupancySeries(const OccupancySeries&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    OccupancySeries& operator=(const OccupancySeries&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static OccupancySeries *_instance;
+
+    struct Ring {
+        OccupancyBin *bins;
+        uint16_t size;
+        uint16_t head;                      // Index of the current bucket
+        uint16_t used;
+        uint32_t period;                    // Seconds per bucket
+    };
+
+    void advance(uint32_t now);
+    void rebase();
+
+    OccupancyBin minuteBins[SERIES_MINUTE_BINS];
+    OccupancyBin hourBins[SERIES_HOUR_BINS];
+    OccupancyBin dayBins[SERIES_DAY_BINS];
+    Ring rings[SERIES_RESOLUTION_COUNT];
+    uint32_t nextBoundary = 0;              // Earliest time any ring needs to roll
+    int occupancy = 0;
+    bool unixTime = false;                  // Bucket starts are Unix time - uptime until the cloud sets the clock
+};
+#endif  /* __OCCUPANCYSERIES_H */
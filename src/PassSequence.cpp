@@ -0,0 +1,85 @@
+// Pass Sequence Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class follows one pass under the sensor through the occupancy states (zone 1 ones, zone 2 twos)
+// A pass runs 0 -> ... -> 0; the sequence is repaired with the magical state map when a state was missed, and on the
+// closing 0 the last five states (newest first) are "01320" for a person walking zone 2 then zone 1, "02310" the other way
+
+#include "Particle.h"
+#include "PassSequence.h"
+
+PassSequence::PassSequence() {
+  stateStack.push(0);                               // The doorway starts empty - PeopleCounter only runs on a change, so no 0 would ever arrive first
+}
+
+// Runs the magical state map over the states so far - returns what, if anything, the new state completed
+TrackResult PassSequence::advance(int newOccupancyState) {
+    int magicalStateMap[4] = {3, 2, 1, 0};                             // Define impossible state transitions (Ex. newOccupancyState cannot equal impossibilityMap[lastOccupancyState])
+    repaired = false;
+
+    switch(stateStack.count()){
+      case 0:
+        if(newOccupancyState == 0){                                     // First value MUST be a 0, ignore others
+          stateStack.push(newOccupancyState);   
+        }                                             
+        break;
+      case 1:
+        if(newOccupancyState != 0){                                     // Second state must NOT be a 0, ignore others
+          stateStack.push(newOccupancyState);                           // Push to the stack without checking for impossibilities
+        }
+        break;                                                           
+      case 2:
+      case 3:                                                           // When the stateStack has 2 or 3 items, we must identify impossible patterns and fix them.
+        if(stateStack.count() == 2 && newOccupancyState == 0){          // If we receive a 0 as the third state, the detected person left the area without walking in or out ...
+          while(stateStack.count() > 1){                                    // ... so reset the stateStack so it only contains 0.
+            stateStack.pop();                           // NOTE: IF IT IS COMMON FOR RANDOM 0s TO COME IN RIGHT HERE, MAY NEED TO LET THIS THROUGH AND FIX IT WITH THE NEXT CHANGE
+          }
+          return TRACK_ABORTED;                                             // ... and wait for the next pass (pushing this 0 as well would leave "00" at the bottom)
+        }
+        tempStack.push(newOccupancyState);                              // Push the new occupancyState to the tempStack
+        while(stateStack.count() > 1){                                  // Go through the stack containing prior states
+          int current = stateStack.pop();                               
+          int after = tempStack.peek();
+          int before = stateStack.peek();
+          if(magicalStateMap[before] == current){                       // If the transition from before --> current is impossible, we must have failed to detect the person at some point ...
+            tempStack.push(current);                                            // ... so push current ...
+            int missedState = magicalStateMap[after];                               // ... consult the magical state map to determine what state was missed ...
+            tempStack.push(missedState);                                                // ... then push that.
+            repaired = true;
+          } else if(magicalStateMap[current] == after) {                // If the transition from current --> after is impossible, we must have failed to detect the person at some point ...
+            int missedState = magicalStateMap[before];                          // ... so consult the magical state map to determine what state was missed ...
+            tempStack.push(missedState);                                            // ... push the missing state ...
+            tempStack.push(current);                                                    // ... then push current.
+            repaired = true;
+          } else {                                                      // If the transition from before --> current is possible ...
+            tempStack.push(current);                                            // ... push current.
+          }
+        }
+        while(!tempStack.isEmpty()){                                            // Then move everything in the tempStack back to the permanent stack
+          stateStack.push(tempStack.pop());
+        }
+        break;
+      case 4:
+      default:                                                          // Two repairs in one pass can leave more than four - without this no pass would ever close again
+        if(newOccupancyState != 0){                                     // If the new occupancy state is NOT 0 ...
+          while(stateStack.count() > 1 && stateStack.peek() != newOccupancyState){  // ... until the top of the stack is equal to the new occupancy state ...
+            stateStack.pop();                                                       // ... remove the top of the stack (never the starting 0).
+          }
+          if(stateStack.count() == 1) stateStack.push(newOccupancyState);           // Not seen this pass - it becomes the newest state
+        } else {                                                         // If the new occupancy state is 0 ...
+          stateStack.push(newOccupancyState);                                   // ... push the final state ...
+          char states[6];                                                           // ... turn it into a string by popping the newest five values off the stack ...
+          for (int i = 0; i < 5; i++) states[i] = '0' + stateStack.pop();
+          states[5] = '\0';
+          while(!stateStack.isEmpty()) stateStack.pop();                        // ... dropping anything older from this pass ...
+          stateStack.push(0);                                                   // ... leaving the 0 that starts the next pass.
+          if(strcmp(states, "01320") == 0) return TRACK_ENTERED;                    // ... then increment the count if the sequence matches the increment secuence.
+          else if(strcmp(states, "02310") == 0) return TRACK_EXITED;                // ... then decrement the count if the sequence matches the decrement secuence.
+          lastSequence = atoi(states);                                              // ... otherwise the caller reports the impossible sequence.
+          return TRACK_IMPOSSIBLE;
+        }
+        break;
+    }
+    return TRACK_PENDING;
+}
@@ -0,0 +1,55 @@
+// Pass Sequence Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class follows one pass under the sensor through the occupancy states (zone 1 ones, zone 2 twos)
+// A pass runs 0 -> ... -> 0; the sequence is repaired with the magical state map when a state was missed, and on the
+// closing 0 the last five states (newest first) are "01320" for a person walking zone 2 then zone 1, "02310" the other way
+// Like ZoneDecision this is plain state so the host tools can run one per configuration - PeopleCounter keeps one per track
+
+#ifndef __PASSSEQUENCE_H
+#define __PASSSEQUENCE_H
+
+#include "Particle.h"
+#include <StackArray.h>
+
+/**
+ * @brief What the state that just arrived completed
+ */
+enum TrackResult { TRACK_PENDING, TRACK_ENTERED, TRACK_EXITED, TRACK_ABORTED, TRACK_IMPOSSIBLE };
+
+class PassSequence {
+public:
+    /**
+     * @brief Starts with the empty doorway - without that 0 the first pass would be ignored
+     */
+    PassSequence();
+
+    /**
+     * @brief Moves the pass on with a new occupancy state - TRACK_ENTERED is zone 2 then zone 1 as the sensor saw it
+     */
+    TrackResult advance(int newOccupancyState);
+
+    /**
+     * @brief The five states (newest first, as digits) of the last pass that closed - for logging an impossible one
+     */
+    int getLastSequence() const { return lastSequence; }
+
+    /**
+     * @brief True if the last state that arrived was only possible with a missed state put back
+     */
+    bool wasRepaired() const { return repaired; }
+
+    int depth() const { return stateStack.count(); }
+
+    PassSequence(const PassSequence&) = delete;                 // The stacks own their storage
+    PassSequence& operator=(const PassSequence&) = delete;
+
+protected:
+    StackArray <int> stateStack;
+    StackArray <int> tempStack;
+    int lastSequence = 0;
+    bool repaired = false;
+};
+
+#endif  /* __PASSSEQUENCE_H */
@@ -11,13 +11,156 @@
 #include "ErrorCodes.h"
 #include "PeopleCounter.h"
 #include "TofSensor.h"
-#include <StackArray.h>
-
-StackArray <int> stateStack;
-StackArray <int> tempStack;
+#include "EventLog.h"
+#include "PersistentStore.h"
+#include "OccupancySeries.h"
+#include "ConfigStore.h"
+#include "CloudPublisher.h"
+#include "CrossingHistory.h"
+#include "OccupancyLimit.h"
+#include "PassSequence.h"
 
 static int occupancyCount = 0;      // How many folks in the room or (if there is more than one door) - net occupancy through this door
-static int occupancyLimit = DEFAULT_PEOPLE_LIMIT;
+
+// One person's pass under the sensor - a single track normally, one per lane when TofSensor splits the zones laterally
+struct Track {
+  PassSequence sequence;
+  CrossingEvent crossing;                           // The pass in progress
+  int lastState;
+  int peakDeviation;                                // Largest signal change seen during the pass (kcps/SPAD)
+  unsigned long completedAt;                        // When the last pass on this track was counted
+  int completedDirection;
+};
+
+#if LATERAL_SPLIT
+static Track tracks[2];
+#else
+static Track tracks[1];
+#endif
+
+// Crossing timing
+static CrossingEvent lastCrossing;                  // The last one completed
+
+// Updates the zone entry / exit times from the state that just arrived - a new pass starts when the first zone fills
+static void trackCrossing(Track &track, int oldState, int newState) {
+  CrossingEvent &crossing = track.crossing;
+  if (oldState == 0 && newState != 0) {
+    memset(&crossing, 0, sizeof(crossing));
+    track.peakDeviation = 0;
+  }
+
+  for (byte zone = 0; zone < 2; zone++) {
+    int bit = 1 << zone;
+    unsigned long stamp = TofSensor::instance().getZoneTimestamp(zone);
+    if ((newState & bit) && !(oldState & bit) && crossing.zoneEntry[zone] == 0) crossing.zoneEntry[zone] = stamp;
+    if (!(newState & bit) && (oldState & bit)) crossing.zoneExit[zone] = stamp;
+  }
+}
+
+// Fills in dwell, speed and confidence for a finished pass and reports it
+// The leading edge (second zone filling) and trailing edge (first zone clearing) each give a transit time across the zone spacing
+static void finishCrossing(Track &track, int direction) {
+  CrossingEvent &crossing = track.crossing;
+  crossing.direction = direction;
+  crossing.result = RESULT_OK;
+
+  for (byte zone = 0; zone < 2; zone++) {
+    if (crossing.zoneEntry[zone] && crossing.zoneExit[zone] > crossing.zoneEntry[zone]) {
+      unsigned long dwell = crossing.zoneExit[zone] - crossing.zoneEntry[zone];
+      crossing.dwell[zone] = (dwell > 65535UL) ? 65535 : (uint16_t)dwell;
+    }
+  }
+
+  if (direction != 0) {
+    int walked = ConfigStore::instance().get().mountedInside ? -direction : direction;     // Zone order as the sensor saw it
+    int first = (walked > 0) ? 1 : 0;                            // Entering walks zone2 (outer) then zone1 (inner)
+    int second = 1 - first;
+    long leading = (long)(crossing.zoneEntry[second] - crossing.zoneEntry[first]);
+    long trailing = (long)(crossing.zoneExit[second] - crossing.zoneExit[first]);
+    if (!crossing.zoneEntry[first] || !crossing.zoneEntry[second]) leading = trailing;    // A repaired sequence can miss an edge - use the other one
+    if (!crossing.zoneExit[first] || !crossing.zoneExit[second]) trailing = leading;
+    long resolution = (long)TofSensor::instance().getFrameInterval();
+    long shortest = (leading < trailing) ? leading : trailing;
+    long longest = (leading < trailing) ? trailing : leading;
+    long transit = (leading + trailing) / 2;
+
+    if (transit <= 0 || shortest <= resolution) {                // Crossed both zones within a frame - too quick to time
+      crossing.result = PERSON_TOO_FAST;
+      crossing.speed = 0;
+      crossing.confidence = 0;
+    }
+    else {
+      // Zones are SPAD_PITCH_DEGREES apart per SPAD - at CROSSING_HEIGHT_MM that is this far across the floor (the layout can change at installation)
+      float halfAngle = TofSensor::instance().getZoneSeparationSpads() * SPAD_PITCH_DEGREES * (float)M_PI / 360.0f;
+      float zoneSpacingMm = 2.0f * (SENSOR_MOUNT_HEIGHT_MM - CROSSING_HEIGHT_MM) * tanf(halfAngle);
+      float speed = zoneSpacingMm * 1000.0f / transit;
+      crossing.speed = (speed > 65535.0f) ? 65535 : (uint16_t)speed;
+      float agreement = (float)shortest / (float)longest;                                // The two edges should see the same speed
+      float timing = (float)(shortest - resolution) / (float)shortest;                   // A frame of uncertainty on each edge
+      crossing.confidence = (uint8_t)(100.0f * agreement * timing * (crossing.repaired ? 0.5f : 1.0f));
+      if (crossing.speed > MAX_WALKING_SPEED_MM_S) crossing.result = PERSON_TOO_FAST;
+    }
+
+    if (crossing.result == PERSON_TOO_FAST) EventLog::instance().record(EVENT_PERSON_TOO_FAST, direction, crossing.speed, transit, resolution);
+  }
+
+  #if PEOPLECOUNTER_DEBUG
+  EventLog::instance().record(EVENT_CROSSING, direction, crossing.speed, crossing.confidence, (crossing.speed && crossing.speed < MIN_WALKING_SPEED_MM_S) ? 1 : 0);
+  #endif
+
+  lastCrossing = crossing;
+}
+
+// Moves one track's pass on - returns what, if anything, the new state completed
+static TrackResult advanceTrack(Track &track, int newOccupancyState) {
+    trackCrossing(track, track.lastState, newOccupancyState);          // Time the zone transitions whatever the sequence makes of them
+    track.lastState = newOccupancyState;
+
+    TrackResult result = track.sequence.advance(newOccupancyState);
+    if (track.sequence.wasRepaired()) track.crossing.repaired = true;
+    if (result == TRACK_IMPOSSIBLE) EventLog::instance().record(EVENT_IMPOSSIBLE_SEQUENCE, track.sequence.getLastSequence());
+    return result;
+}
+
+// Applies a finished pass to the count - with lateral lanes a pass seen by both lanes at once is only a second person
+// if both lanes saw a whole body (LANE_FULL_THRESHOLD); one person down the middle covers half of each
+static void completeTrack(int lane, TrackResult result) {
+  Track &track = tracks[lane];
+  int direction = (result == TRACK_ENTERED) ? 1 : (result == TRACK_EXITED) ? -1 : 0;
+  if (ConfigStore::instance().get().mountedInside) direction = -direction;      // Zone 1 is the outer zone on this door
+
+  finishCrossing(track, direction);
+  if (result == TRACK_ABORTED) {
+    OccupancySeries::instance().countAborted();
+    CloudPublisher::instance().countAborted();
+    CrossingHistory::instance().record(HISTORY_ABORTED, track.crossing.confidence, occupancyCount);
+  }
+  if (direction == 0) return;
+
+  track.completedAt = millis();
+  track.completedDirection = direction;
+
+  #if LATERAL_SPLIT
+  Track &other = tracks[1 - lane];
+  if (other.completedDirection == direction && track.completedAt - other.completedAt < SIDE_BY_SIDE_WINDOW_MS) {
+    bool bothLanesFull = (track.peakDeviation >= LANE_FULL_THRESHOLD) && (other.peakDeviation >= LANE_FULL_THRESHOLD);
+    other.completedDirection = 0;                               // The pair is settled either way
+    track.completedDirection = 0;
+    if (!bothLanesFull) return;                                 // The other lane already counted this person
+  }
+  #endif
+
+  occupancyCount += direction;
+  if (direction > 0) {
+    OccupancySeries::instance().countEntry(occupancyCount);
+    CloudPublisher::instance().countEntry(occupancyCount);
+  }
+  else {
+    OccupancySeries::instance().countExit(occupancyCount);
+    CloudPublisher::instance().countExit(occupancyCount);
+  }
+  CrossingHistory::instance().record((direction > 0) ? HISTORY_ENTERED : HISTORY_EXITED, track.crossing.confidence, occupancyCount);
+}
 
 PeopleCounter *PeopleCounter::_instance;
 
@@ -36,95 +179,72 @@ PeopleCounter::~PeopleCounter() {
 }
 
 void PeopleCounter::setup() {
+  occupancyCount = PersistentStore::instance().state().occupancyCount;      // Pick up where we left off before the restart
+
+  memset(&lastCrossing, 0, sizeof(lastCrossing));
+
+  // The ten foot display is rendered from the event log so its nine lines never run on the counting path
+  EventLog::instance().setRenderer(EVENT_BIG_NUMBER, [](const EventLogEntry &entry) {
+    PeopleCounter::instance().printBigNumbers(entry.args[0]);
+  });
 }
 
 void PeopleCounter::loop(){                                             // This function is only called if there is a change in occupancy state
     int oldOccupancyCount = occupancyCount;
-    int newOccupancyState = TofSensor::instance().getOccupancyState();
-    int magicalStateMap[4] = {3, 2, 1, 0};                             // Define impossible state transitions (Ex. newOccupancyState cannot equal impossibilityMap[lastOccupancyState])
-    
-    switch(stateStack.count()){
-      case 0:
-        if(newOccupancyState == 0){                                     // First value MUST be a 0, ignore others
-          stateStack.push(newOccupancyState);   
-        }                                             
-        break;
-      case 1:
-        if(newOccupancyState != 0){                                     // Second state must NOT be a 0, ignore others
-          stateStack.push(newOccupancyState);                           // Push to the stack without checking for impossibilities
-        }
-        break;                                                           
-      case 2:
-      case 3:                                                           // When the stateStack has 2 or 3 items, we must identify impossible patterns and fix them.
-        if(stateStack.count() == 2 && newOccupancyState == 0){          // If we receive a 0 as the third state, the detected person left the area without walking in or out ...
-          while(stateStack.count() > 1){                                    // ... so reset the stateStack so it only contains 0.
-            stateStack.pop();                           // NOTE: IF IT IS COMMON FOR RANDOM 0s TO COME IN RIGHT HERE, MAY NEED TO LET THIS THROUGH AND FIX IT WITH THE NEXT CHANGE
-          }
-        }
-        tempStack.push(newOccupancyState);                              // Push the new occupancyState to the tempStack
-        while(stateStack.count() > 1){                                  // Go through the stack containing prior states
-          int current = stateStack.pop();                               
-          int after = tempStack.peek();
-          int before = stateStack.peek();
-          if(magicalStateMap[before] == current){                       // If the transition from before --> current is impossible, we must have failed to detect the person at some point ...
-            tempStack.push(current);                                            // ... so push current ...
-            int missedState = magicalStateMap[after];                               // ... consult the magical state map to determine what state was missed ...
-            tempStack.push(missedState);                                                // ... then push that.
-          } else if(magicalStateMap[current] == after) {                // If the transition from current --> after is impossible, we must have failed to detect the person at some point ...
-            int missedState = magicalStateMap[before];                          // ... so consult the magical state map to determine what state was missed ...
-            tempStack.push(missedState);                                            // ... push the missing state ...
-            tempStack.push(current);                                                    // ... then push current.
-          } else {                                                      // If the transition from before --> current is possible ...
-            tempStack.push(current);                                            // ... push current.
-          }
-        }
-        while(!tempStack.isEmpty()){                                            // Then move everything in the tempStack back to the permanent stack
-          stateStack.push(tempStack.pop());
-        }
-        break;
-      case 4:
-        if(newOccupancyState != 0){                                     // If the new occupancy state is NOT 0 ...
-          while(stateStack.peek() != newOccupancyState){                        // ... until the top of the stack is equal to the new occupancy state ...
-            stateStack.pop();                                                       // ... remove the top of the stack.
-          }
-        } else {                                                         // If the new occupancy state is 0 ...
-          stateStack.push(newOccupancyState);                                   // ... push the final state ...
-          char states[5];                                                           // ... turn it into a string by popping all values off the stack...
-          snprintf(states, sizeof(states), "%i%i%i%i%i", stateStack.pop(), stateStack.pop(), stateStack.pop(), stateStack.pop(), stateStack.pop());   
-          if(strcmp(states, "01320")){
-            occupancyCount++;                                                           // ... then increment the count if the sequence matches the increment secuence.
-          } else if(strcmp(states, "02310")) {
-            occupancyCount--;                                                           // ... then decrement the count if the sequence matches the decrement secuence.
-          } else {
-            Log.info("[ERROR WHEN COUNTING] Impossible sequence: %s", states);          // ... then throw an error if the sequence is supposed to be impossible.
-          }
-        }
-        break;
+
+    #if LATERAL_SPLIT
+    for (int lane = 0; lane < 2; lane++) {                              // Each lane is its own track - side by side people pass in parallel
+      Track &track = tracks[lane];
+      int newState = TofSensor::instance().getLaneState(lane);
+      if (newState != track.lastState || track.sequence.depth() == 0) {
+        TrackResult result = advanceTrack(track, newState);
+        if (result != TRACK_PENDING) completeTrack(lane, result);
+      }
+      for (byte zone = 0; zone < 2; zone++) {
+        int deviation = TofSensor::instance().getLaneDeviation(zone, lane);
+        if (deviation > track.peakDeviation) track.peakDeviation = deviation;
+      }
     }
+    #else
+    TrackResult result = advanceTrack(tracks[0], TofSensor::instance().getOccupancyState());
+    if (result != TRACK_PENDING) completeTrack(0, result);
+    #endif
+
+   if (oldOccupancyCount != occupancyCount) {
+     OccupancyLimit::instance().update(occupancyCount);                // Same frame as the crossing
+     PersistentStore::instance().state().occupancyCount = occupancyCount;
+     PersistentStore::instance().markDirty();
+   }
 
    #if TENFOOTDISPLAY
-    if (oldOccupancyCount != occupancyCount) printBigNumbers(occupancyCount);
+    if (oldOccupancyCount != occupancyCount) EventLog::instance().record(EVENT_BIG_NUMBER, occupancyCount);
    #else
-    if (oldOccupancyCount != occupancyCount) Log.info("Occupancy %s %i",(occupancyCount > oldOccupancyCount) ? "increased to" : "decreased to", occupancyCount);
+    if (oldOccupancyCount != occupancyCount) EventLog::instance().record(EVENT_COUNT_CHANGED, (occupancyCount > oldOccupancyCount), occupancyCount);
    #endif
 }
 
+const CrossingEvent &PeopleCounter::getLastCrossing() {
+  return lastCrossing;
+}
+
 int PeopleCounter::getCount(){
-  Log.info("Occupancy count is %d",occupancyCount);
   return occupancyCount;
-
 }
 
 void PeopleCounter::setCount(int value){
   occupancyCount = value;
+  OccupancyLimit::instance().update(occupancyCount);
+  CrossingHistory::instance().record(HISTORY_COUNT_SET, 0, occupancyCount);
+  PersistentStore::instance().state().occupancyCount = occupancyCount;
+  PersistentStore::instance().markDirty();
 }
 
 int PeopleCounter::getLimit(){
-  return occupancyLimit;
+  return ConfigStore::instance().get().peopleLimit;
 }
 
-void PeopleCounter::setLimit(int value){
-  occupancyLimit = value;
+bool PeopleCounter::setLimit(int value){
+  return ConfigStore::instance().set(CONFIG_PEOPLE_LIMIT, value) == 0;    // Takes effect (and is saved) at the next frame boundary
 }
 
 void PeopleCounter::printBigNumbers(int number) {
@@ -11,6 +11,22 @@
 #include "Particle.h"
 #include "PeopleCounterConfig.h"
 
+/**
+ * @brief Timing of one pass under the sensor, built from the zone timestamps as the states arrive
+ * 
+ * Times are millis() - a zone that was never occupied has 0 for its entry and exit times
+ */
+struct CrossingEvent {
+    uint32_t zoneEntry[2];                  // First time each zone became occupied
+    uint32_t zoneExit[2];                   // Last time each zone became clear
+    uint16_t dwell[2];                      // ms each zone was occupied (exit - entry)
+    uint16_t speed;                         // Walking speed in mm/s - 0 if it could not be estimated
+    uint8_t confidence;                     // 0 - 100
+    int8_t direction;                       // 1 entered, -1 exited, 0 no count (turned back or impossible sequence)
+    bool repaired;                          // A state was missed and filled in by the magical state map
+    int result;                             // RESULT_OK, or PERSON_TOO_FAST when faster than MAX_WALKING_SPEED_MM_S or the frame rate can resolve
+};
+
 /**
  * This class is a singleton; you do not create one as a global, on the stack, or with new.
  * 
@@ -43,10 +59,19 @@ public:
      */
     void loop();
 
+    /**
+     * @brief The most recent completed pass (counted or not) - see CrossingEvent
+     */
+    const CrossingEvent &getLastCrossing();
+
     int getCount();
     int getLimit();
     void setCount(int value);
-    void setLimit(int value);
+
+    /**
+     * @brief Stages a new occupancy limit - false (and the limit unchanged) if ConfigStore rejects it as out of range
+     */
+    bool setLimit(int value);
 
 protected:
     /**
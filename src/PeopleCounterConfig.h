@@ -1,10 +1,53 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// DEFAULT_PEOPLE_LIMIT and MOUNTED_INSIDE are the defaults - the live values are in ConfigStore ("peopleLimit", "mountedInside")
 #define DEFAULT_PEOPLE_LIMIT 5             // Values above this will generate an alert
 #define PEOPLECOUNTER_DEBUG 1
 #define TENFOOTDISPLAY 0
 #define SINGLE_ENTRANCE 1                  // If this is the only entrance, negative occupancy values are not allowed
 #define MOUNTED_INSIDE 0                   // Reverses the directions
 
+// Occupancy limit alerts (OccupancyLimit) - the limit itself is DEFAULT_PEOPLE_LIMIT / ConfigStore "peopleLimit"
+#define LIMIT_HYSTERESIS 1                 // An alert level only drops once the count is this far below where it was raised
+#define LIMIT_HOLDOFF_MS 10000             // ... and has stayed there this long
+#define LIMIT_ESCALATE_MS 120000           // Over the limit this long escalates
+#define LIMIT_CRITICAL_MARGIN 3            // This many over the limit escalates at once
+#define LIMIT_ALERT_PIN D4                 // High while over the limit - for a sign, buzzer or relay
+#define LIMIT_LED_PIN D7                   // Steady at capacity, slow blink over, fast blink escalated
+#define LIMIT_BLINK_SLOW_MS 500
+#define LIMIT_BLINK_FAST_MS 125
+
+// Crossing timing - turns zone transition times into a walking speed
+#define SENSOR_MOUNT_HEIGHT_MM 2100        // Sensor above the floor
+#define CROSSING_HEIGHT_MM 1200            // Height at which the zones see a passing person (torso / shoulders)
+#define MAX_WALKING_SPEED_MM_S 3000        // Faster than this is reported as PERSON_TOO_FAST
+#define MIN_WALKING_SPEED_MM_S 150         // Slower than this is flagged as implausible (loitering in the doorway)
+
+// Side by side passes (LATERAL_SPLIT in TofSensorConfig.h)
+#define SIDE_BY_SIDE_WINDOW_MS 1500        // Both lanes completing the same direction within this are one pass - or two people
+#define LANE_FULL_THRESHOLD 24             // ... two people only if both lanes saw at least this signal change (a whole body, not half of one)
+
+// Main loop tasks (TaskScheduler) - periods in ms, budgets in us (a run over budget is counted as an overrun)
+// A frame blocks for about one timing budget, so periods much shorter than a frame cannot be kept and would only count as late
+#define SCHEDULER_MAX_TASKS 12
+#define SCHEDULER_MAX_WAIT_MS 2000         // A task that has not fitted between frames for this long runs anyway (counted late)
+#define TASK_SENSOR_BUDGET_US 100000       // A frame - two ROIs and their reads at the longest timing budget
+#define TASK_SENSOR_POLL_MS 5              // Between calls when no frame is integrating (recovery, recalibration, a scan)
+#define TASK_COUNT_BUDGET_US 2000
+#define TASK_LOG_PERIOD_MS 50
+#define TASK_LOG_BUDGET_US 3000            // EVENT_LOG_DRAIN_BUDGET lines out of the serial port
+#define TASK_LIMIT_PERIOD_MS 50            // Resolves LIMIT_BLINK_FAST_MS well enough to see
+#define TASK_LIMIT_BUDGET_US 200
+#define TASK_PUBLISH_PERIOD_MS 100
+#define TASK_PUBLISH_BUDGET_US 5000
+#define TASK_STORE_PERIOD_MS 1000          // Persistent store and occupancy series - both act on their own timers
+#define TASK_STORE_BUDGET_US 5000
+#define TASK_CONSOLE_PERIOD_MS 50
+#define TASK_CONSOLE_BUDGET_US 2000
+#define TASK_LED_PERIOD_MS 1000            // Heartbeat - stands aside while OccupancyLimit drives the LED
+#define TASK_LED_BUDGET_US 100
+#define TASK_DIAGNOSTICS_PERIOD_MS 60000   // Logs the tasks that overran or ran late since the last check
+#define TASK_DIAGNOSTICS_BUDGET_US 1000
+
 #endif
\ No newline at end of file
@@ -0,0 +1,214 @@
+// Persistent Store Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class keeps the occupancy count, baselines and calibration across restarts
+// - Retained SRAM survives System.reset() so a warm restart is a CRC check and a copy
+// - Flash (EEPROM emulation) is written round-robin across slots with a sequence number and CRC for cold boots
+// The flash side goes through PersistenceBackend so it can be replaced (tools/host/FileStorageBackend.h on a desktop)
+
+#include <stddef.h>
+#include "Particle.h"
+#include "PersistentStore.h"
+
+#define PERSIST_MAGIC 0x50455253                    // "PERS"
+
+// One record - the same layout in retained memory and in each flash slot
+struct PersistentRecord {
+  uint32_t magic;
+  uint32_t sequence;
+  uint16_t length;                                  // sizeof(PersistentState) of the firmware that wrote it
+  uint16_t reserved;
+  uint8_t payload[PERSIST_SLOT_SIZE - 16];
+  uint32_t crc;                                     // Over everything above
+};
+
+static_assert(sizeof(PersistentRecord) == PERSIST_SLOT_SIZE, "PersistentRecord must fill exactly one slot");
+static_assert(sizeof(PersistentState) <= sizeof(((PersistentRecord *)0)->payload), "PersistentState has outgrown a flash slot");
+
+retained static PersistentRecord retainedRecord;
+
+// Device OS EEPROM emulation - the default backend
+class EepromBackend : public PersistenceBackend {
+public:
+  size_t size() override { return EEPROM.length(); }
+  void read(size_t offset, uint8_t *data, size_t length) override {
+    for (size_t i = 0; i < length; i++) data[i] = EEPROM.read(offset + i);
+  }
+  void write(size_t offset, const uint8_t *data, size_t length) override {
+    for (size_t i = 0; i < length; i++) {
+      if (EEPROM.read(offset + i) != data[i]) EEPROM.write(offset + i, data[i]);      // Skip unchanged bytes
+    }
+  }
+};
+
+static EepromBackend eepromBackend;
+
+// CRC-32 (IEEE) - bitwise, the record is small and this only runs on changes
+static uint32_t crc32(const uint8_t *data, size_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  while (length--) {
+    crc ^= *data++;
+    for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+static uint32_t recordCrc(const PersistentRecord &record) {
+  return crc32((const uint8_t *)&record, offsetof(PersistentRecord, crc));
+}
+
+static bool recordIsValid(const PersistentRecord &record) {
+  return record.magic == PERSIST_MAGIC && record.length <= sizeof(record.payload) && record.crc == recordCrc(record);
+}
+
+static void fillRecord(PersistentRecord &record, const PersistentState &state, uint32_t sequence) {
+  memset(&record, 0, sizeof(record));
+  record.magic = PERSIST_MAGIC;
+  record.sequence = sequence;
+  record.length = sizeof(PersistentState);
+  memcpy(record.payload, &state, sizeof(PersistentState));
+  record.crc = recordCrc(record);
+}
+
+// Older records are shorter - the fields they did not know about stay zero
+static void readRecord(const PersistentRecord &record, PersistentState &state) {
+  memset(&state, 0, sizeof(state));
+  memcpy(&state, record.payload, (record.length < sizeof(state)) ? record.length : sizeof(state));
+}
+
+PersistentStore *PersistentStore::_instance;
+
+// [static]
+PersistentStore &PersistentStore::instance() {
+  if (!_instance) {
+      _instance = new PersistentStore();
+  }
+  return *_instance;
+}
+
+PersistentStore::PersistentStore() {
+  memset(&current, 0, sizeof(current));
+  memset(blockSequences, 0, sizeof(blockSequences));
+  backend = &eepromBackend;
+}
+
+PersistentStore::~PersistentStore() {
+}
+
+void PersistentStore::setBackend(PersistenceBackend *newBackend) {
+  backend = newBackend ? newBackend : &eepromBackend;
+}
+
+void PersistentStore::setup() {
+  unsigned long started = micros();
+
+  if (recordIsValid(retainedRecord)) {
+    readRecord(retainedRecord, current);
+    sequence = retainedRecord.sequence;
+    restoreSource = RESTORE_RETAINED;
+  }
+  else if (loadFromFlash()) {
+    fillRecord(retainedRecord, current, sequence);
+    restoreSource = RESTORE_FLASH;
+  }
+  else restoreSource = RESTORE_NONE;
+
+  restoreMicros = micros() - started;
+  lastFlashWrite = millis();
+  Log.info("Persistent state restored from %s in %luuS - count %ld", (restoreSource == RESTORE_RETAINED) ? "retained memory" : (restoreSource == RESTORE_FLASH) ? "flash" : "defaults", (unsigned long)restoreMicros, (long)current.occupancyCount);
+}
+
+void PersistentStore::loop() {
+  if (dirty && millis() - lastFlashWrite >= PERSIST_FLASH_INTERVAL_MS) save();
+}
+
+void PersistentStore::markDirty() {
+  fillRecord(retainedRecord, current, sequence);
+  dirty = true;
+}
+
+void PersistentStore::save() {
+  PersistentRecord record;
+  sequence++;
+  fillRecord(record, current, sequence);
+  size_t slot = sequence % PERSIST_FLASH_SLOTS;
+  if (PERSIST_FLASH_OFFSET + (slot + 1) * PERSIST_SLOT_SIZE <= backend->size()) {
+    backend->write(PERSIST_FLASH_OFFSET + slot * PERSIST_SLOT_SIZE, (const uint8_t *)&record, sizeof(record));
+    flashWrites++;
+  }
+  retainedRecord = record;
+  dirty = false;
+  lastFlashWrite = millis();
+}
+
+// Each block has two slots after the state slots - the same magic / sequence / length / CRC header as a state record
+struct PersistentBlock {
+  uint32_t magic;
+  uint32_t sequence;
+  uint16_t length;
+  uint16_t reserved;
+  uint8_t payload[PERSIST_BLOCK_SIZE - 16];
+  uint32_t crc;
+};
+
+static_assert(sizeof(PersistentBlock) == PERSIST_BLOCK_SIZE, "PersistentBlock must fill exactly one slot");
+
+static size_t blockOffset(uint8_t block, uint8_t slot) {
+  return PERSIST_FLASH_OFFSET + PERSIST_FLASH_SLOTS * PERSIST_SLOT_SIZE + (block * 2 + slot) * PERSIST_BLOCK_SIZE;
+}
+
+bool PersistentStore::loadBlock(uint8_t block, void *data, size_t length) {
+  PersistentBlock record;
+  bool found = false;
+  if (block >= PERSIST_BLOCKS) return false;
+
+  for (uint8_t slot = 0; slot < 2; slot++) {
+    if (blockOffset(block, slot) + PERSIST_BLOCK_SIZE > backend->size()) break;
+    backend->read(blockOffset(block, slot), (uint8_t *)&record, sizeof(record));
+    if (record.magic != PERSIST_MAGIC || record.length > sizeof(record.payload)) continue;
+    if (record.crc != crc32((const uint8_t *)&record, offsetof(PersistentBlock, crc))) continue;
+    if (found && (int32_t)(record.sequence - blockSequences[block]) <= 0) continue;
+    memset(data, 0, length);
+    memcpy(data, record.payload, (record.length < length) ? record.length : length);
+    blockSequences[block] = record.sequence;
+    found = true;
+  }
+  return found;
+}
+
+bool PersistentStore::saveBlock(uint8_t block, const void *data, size_t length) {
+  PersistentBlock record;
+  if (block >= PERSIST_BLOCKS || length > sizeof(record.payload)) return false;
+
+  memset(&record, 0, sizeof(record));
+  record.magic = PERSIST_MAGIC;
+  record.sequence = ++blockSequences[block];
+  record.length = length;
+  memcpy(record.payload, data, length);
+  record.crc = crc32((const uint8_t *)&record, offsetof(PersistentBlock, crc));
+
+  size_t offset = blockOffset(block, record.sequence & 1);        // Never overwrite the copy we would fall back to
+  if (offset + PERSIST_BLOCK_SIZE > backend->size()) return false;
+  backend->write(offset, (const uint8_t *)&record, sizeof(record));
+  flashWrites++;
+  return true;
+}
+
+// Scans every slot and keeps the valid record with the highest sequence number
+bool PersistentStore::loadFromFlash() {
+  PersistentRecord record;
+  bool found = false;
+
+  for (size_t slot = 0; slot < PERSIST_FLASH_SLOTS; slot++) {
+    if (PERSIST_FLASH_OFFSET + (slot + 1) * PERSIST_SLOT_SIZE > backend->size()) break;
+    backend->read(PERSIST_FLASH_OFFSET + slot * PERSIST_SLOT_SIZE, (uint8_t *)&record, sizeof(record));
+    if (!recordIsValid(record)) continue;
+    if (!found || (int32_t)(record.sequence - sequence) > 0) {
+      readRecord(record, current);
+      sequence = record.sequence;
+      found = true;
+    }
+  }
+  return found;
+}
@@ -0,0 +1,168 @@
+// Persistent Store Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class keeps the occupancy count, baselines and calibration across restarts
+// - Retained SRAM survives System.reset() so a warm restart is a CRC check and a copy
+// - Flash (EEPROM emulation) is written round-robin across slots with a sequence number and CRC for cold boots
+// The flash side goes through PersistenceBackend so it can be replaced (tools/host/FileStorageBackend.h on a desktop)
+
+#ifndef __PERSISTENTSTORE_H
+#define __PERSISTENTSTORE_H
+
+#include "Particle.h"
+
+#define PERSIST_FLASH_SLOTS 8                       // Records rotated through in flash - spreads the wear
+#define PERSIST_SLOT_SIZE 64                        // Fixed so slots stay put when PersistentState grows
+#define PERSIST_FLASH_OFFSET 0                      // Where the slots start in the backend
+#define PERSIST_FLASH_INTERVAL_MS (5UL * 60UL * 1000UL)   // Minimum time between flash writes (retained memory is updated immediately)
+#define PERSIST_BLOCK_SIZE 128                      // Flash slot for a block (configuration) - each block has two, after the state slots
+#define PERSIST_BLOCKS 2
+
+/**
+ * @brief Everything that survives a restart - append new fields at the end (older records load with them zeroed)
+ */
+struct PersistentState {
+    int32_t occupancyCount;
+    int32_t zoneBaselines[2];                       // kcps/SPAD
+    int16_t zoneOffsets[2];                         // mm
+    uint16_t zoneXTalk[2];                          // cps
+    uint8_t baselinesValid;
+    uint8_t offsetsValid;
+    uint8_t xtalkValid;
+    uint8_t reserved;
+    uint8_t zoneCenters[2];                         // Superseded by ConfigStore - only read to migrate a layout placed before it
+    uint8_t zoneWidth;
+    uint8_t zoneLayoutValid;
+};
+
+/**
+ * @brief Byte storage behind the flash copy - EEPROM on the device, a file on a desktop
+ */
+class PersistenceBackend {
+public:
+    virtual ~PersistenceBackend() {}
+    virtual size_t size() = 0;
+    virtual void read(size_t offset, uint8_t *data, size_t length) = 0;
+    virtual void write(size_t offset, const uint8_t *data, size_t length) = 0;
+};
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From global application setup you must call (before the classes that restore from it):
+ * PersistentStore::instance().setup();
+ *
+ * From global application loop you must call:
+ * PersistentStore::instance().loop();
+ */
+class PersistentStore {
+public:
+    enum RestoreSource {
+        RESTORE_NONE,                               // Nothing valid found - defaults
+        RESTORE_RETAINED,                           // Warm restart from retained SRAM
+        RESTORE_FLASH                               // Cold boot from the newest valid flash slot
+    };
+
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use PersistentStore::instance() to instantiate the singleton.
+     */
+    static PersistentStore &instance();
+
+    /**
+     * @brief Restores the state - from retained memory if it is intact, otherwise from flash
+     *
+     * You typically use PersistentStore::instance().setup();
+     */
+    void setup();
+
+    /**
+     * @brief Writes the state to flash when it has changed and PERSIST_FLASH_INTERVAL_MS has passed
+     *
+     * You typically use PersistentStore::instance().loop();
+     */
+    void loop();
+
+    /**
+     * @brief The live state - call markDirty() after changing it
+     */
+    PersistentState &state() { return current; }
+
+    /**
+     * @brief Refreshes the retained copy (a few microseconds) and schedules a flash write
+     */
+    void markDirty();
+
+    /**
+     * @brief Writes the state to the next flash slot now
+     */
+    void save();
+
+    /**
+     * @brief Loads a block written by saveBlock() - block is 0 to PERSIST_BLOCKS-1
+     *
+     * Blocks are for data that changes rarely (configuration) - flash only, two slots alternated with a sequence number
+     * and CRC so a torn write leaves the previous copy. Returns false (leaving data alone) if neither slot is valid.
+     * A block written by firmware with a shorter struct loads with the new fields zeroed.
+     */
+    bool loadBlock(uint8_t block, void *data, size_t length);
+
+    /**
+     * @brief Writes a block to flash now (up to PERSIST_BLOCK_SIZE - 16 bytes)
+     */
+    bool saveBlock(uint8_t block, const void *data, size_t length);
+
+    /**
+     * @brief Replaces the flash backend (EEPROM by default) - call before setup()
+     */
+    void setBackend(PersistenceBackend *backend);
+
+    RestoreSource getRestoreSource() const { return restoreSource; }
+    uint32_t getRestoreMicros() const { return restoreMicros; }
+    uint32_t getFlashWrites() const { return flashWrites; }
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use PersistentStore::instance() to instantiate the singleton.
+     */
+    PersistentStore();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~PersistentStore();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    PersistentStore(const PersistentStore&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    PersistentStore& operator=(const PersistentStore&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static PersistentStore *_instance;
+
+    bool loadFromFlash();
+
+    PersistentState current;
+    PersistenceBackend *backend = NULL;
+    uint32_t sequence = 0;                          // Sequence number of the newest flash record
+    uint32_t blockSequences[PERSIST_BLOCKS];
+    bool dirty = false;
+    unsigned long lastFlashWrite = 0;
+    RestoreSource restoreSource = RESTORE_NONE;
+    uint32_t restoreMicros = 0;
+    uint32_t flashWrites = 0;
+};
+#endif  /* __PERSISTENTSTORE_H */
@@ -0,0 +1,91 @@
+// Power Profile Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class picks how hard the sensor works - named profiles bundle the timing budget, the time between frames, the
+// baseline filter depth and how TofSensor waits on a result
+
+#include "Particle.h"
+#include "PowerProfile.h"
+#include "ConfigStore.h"
+#include "EventLog.h"
+
+// One row per ProfileId - the "auto" row is never live, it only names the setting
+static const ProfileValues profiles[PROFILE_COUNT] = {
+  {"auto",         0,                             0,                           BASELINE_REFINE_SHIFT,     false},
+  {"high-traffic", 0,                             0,                           BASELINE_REFINE_SHIFT,     false},
+  {"balanced",     0,                             PROFILE_BALANCED_PERIOD_MS,  BASELINE_REFINE_SHIFT,     true},
+  {"low-power",    0,                             PROFILE_LOW_POWER_PERIOD_MS, BASELINE_REFINE_SHIFT - 1, true},     // Fewer frames per window - adapt a little faster
+  {"calibration",  PROFILE_CALIBRATION_BUDGET_MS, 0,                           BASELINE_REFINE_SHIFT,     false}
+};
+
+PowerProfile *PowerProfile::_instance;
+
+// [static]
+PowerProfile &PowerProfile::instance() {
+  if (!_instance) {
+      _instance = new PowerProfile();
+  }
+  return *_instance;
+}
+
+PowerProfile::PowerProfile() {
+  memset(timeInMs, 0, sizeof(timeInMs));
+  resolved = profiles[active];
+}
+
+PowerProfile::~PowerProfile() {
+}
+
+void PowerProfile::frame(int occupancy, bool calibrating) {
+  this->calibrating = calibrating;
+  if (occupancy) {
+    lastActivityAt = millis();
+    seenActivity = true;
+  }
+}
+
+ProfileId PowerProfile::wanted() const {
+  uint8_t configured = ConfigStore::instance().get().profile;
+  if (configured != PROFILE_AUTO && configured < PROFILE_COUNT) return (ProfileId)configured;
+  if (calibrating) return PROFILE_CALIBRATION;
+
+  unsigned long quiet = millis() - lastActivityAt;
+  if (seenActivity && quiet < PROFILE_ACTIVE_HOLD_MS) return PROFILE_HIGH_TRAFFIC;
+  if (quiet < PROFILE_IDLE_MS) return PROFILE_BALANCED;
+  return PROFILE_LOW_POWER;
+}
+
+bool PowerProfile::apply() {
+  ProfileValues previous = resolved;
+  ProfileId next = wanted();
+
+  if (next != active) {
+    unsigned long now = millis();
+    timeInMs[active] += now - activeSince;
+    EventLog::instance().record(EVENT_PROFILE_CHANGED, next, active, (now - lastActivityAt) / 1000);
+    active = next;
+    activeSince = now;
+    switches++;
+  }
+
+  resolved = profiles[active];
+  if (!resolved.timingBudgetMs) resolved.timingBudgetMs = ConfigStore::instance().get().timingBudgetMs;
+  return resolved.timingBudgetMs != previous.timingBudgetMs || resolved.framePeriodMs != previous.framePeriodMs;
+}
+
+ProfileId PowerProfile::find(const char *name) {
+  for (int profile = 0; profile < PROFILE_COUNT; profile++) {
+    if (strcmp(name, profiles[profile].name) == 0) return (ProfileId)profile;
+  }
+  return PROFILE_COUNT;
+}
+
+const char *PowerProfile::getName(ProfileId profile) {
+  return (profile < PROFILE_COUNT) ? profiles[profile].name : "";
+}
+
+unsigned long PowerProfile::getTimeInMs(ProfileId profile) const {
+  if (profile >= PROFILE_COUNT) return 0;
+  return timeInMs[profile] + ((profile == active) ? millis() - activeSince : 0);
+}
@@ -0,0 +1,127 @@
+// Power Profile Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class picks how hard the sensor works - named profiles bundle the timing budget, the time between frames, the
+// baseline filter depth and how TofSensor waits on a result
+// In automatic mode (ConfigStore "profile=0") the profile follows the doorway: calibration while the baselines warm up,
+// high-traffic from the first occupied frame until PROFILE_ACTIVE_HOLD_MS of quiet, balanced after that, and low-power
+// once nobody has passed for PROFILE_IDLE_MS. The distance mode and zone size are not part of a profile - changing them
+// would throw the baselines away.
+
+#ifndef __POWERPROFILE_H
+#define __POWERPROFILE_H
+
+#include "Particle.h"
+#include "TofSensorConfig.h"
+
+/**
+ * @brief Profile ids - PROFILE_AUTO is the ConfigStore "profile" value that lets the doorway decide
+ */
+enum ProfileId : uint8_t {
+    PROFILE_AUTO,
+    PROFILE_HIGH_TRAFFIC,                   // Frames back to back, pipelined, polled without a pause
+    PROFILE_BALANCED,
+    PROFILE_LOW_POWER,                      // A frame now and then, the sensor idle and the processor yielding in between
+    PROFILE_CALIBRATION,                    // A longer budget for a quieter warm-up window
+    PROFILE_COUNT
+};
+
+/**
+ * @brief What a profile sets
+ */
+struct ProfileValues {
+    const char *name;
+    uint16_t timingBudgetMs;                // 0 - ConfigStore "timingBudget"
+    uint16_t framePeriodMs;                 // 0 - frames back to back; otherwise one frame per period and the sensor stops in between
+    uint8_t refineShift;                    // Baseline filter depth (ZoneDecisionParams::refineShift)
+    bool yieldWhileWaiting;                 // delay(1) between data ready polls rather than spinning
+};
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * It is driven by TofSensor - frame() after every frame, apply() at the frame boundary.
+ */
+class PowerProfile {
+public:
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use PowerProfile::instance() to instantiate the singleton.
+     */
+    static PowerProfile &instance();
+
+    /**
+     * @brief Reports a finished frame - occupancy is the decided state, calibrating is set while there are no baselines
+     */
+    void frame(int occupancy, bool calibrating);
+
+    /**
+     * @brief Switches to the profile the configuration or the traffic calls for - true if the timing changed
+     *
+     * TofSensor then stops ranging and loads the new timing budget.
+     */
+    bool apply();
+
+    /**
+     * @brief The live profile's settings - timingBudgetMs is resolved against ConfigStore
+     */
+    const ProfileValues &get() const { return resolved; }
+    ProfileId getProfile() const { return active; }
+
+    /**
+     * @brief Looks a profile up by name ("auto" included) - PROFILE_COUNT if there is no such profile
+     */
+    static ProfileId find(const char *name);
+    static const char *getName(ProfileId profile);
+
+    uint32_t getSwitches() const { return switches; }
+
+    /**
+     * @brief Time spent in a profile since boot, the current stretch included
+     */
+    unsigned long getTimeInMs(ProfileId profile) const;
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use PowerProfile::instance() to instantiate the singleton.
+     */
+    PowerProfile();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~PowerProfile();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    PowerProfile(const PowerProfile&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    PowerProfile& operator=(const PowerProfile&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static PowerProfile *_instance;
+
+    ProfileId wanted() const;
+
+    ProfileId active = PROFILE_CALIBRATION;
+    ProfileValues resolved;
+    bool calibrating = true;
+    unsigned long lastActivityAt = 0;       // The last occupied frame - or boot
+    bool seenActivity = false;
+    unsigned long activeSince = 0;
+    unsigned long timeInMs[PROFILE_COUNT];
+    uint32_t switches = 0;
+};
+#endif  /* __POWERPROFILE_H */
@@ -0,0 +1,97 @@
+// Sensor Health Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class watches every measurement for timeouts, failed bus transactions, implausible results and a frozen sensor
+// After HEALTH_FAULT_LIMIT faults in a row it asks TofSensor for the next recovery step - clear the interrupt, restart
+// ranging, clock the I2C bus free, power cycle through XSHUT, then a soft reinit - each bounded by HEALTH_STEP_TIMEOUT_MS
+
+#include "Particle.h"
+#include "SensorHealth.h"
+#include "EventLog.h"
+
+SensorHealth *SensorHealth::_instance;
+
+// [static]
+SensorHealth &SensorHealth::instance() {
+  if (!_instance) {
+      _instance = new SensorHealth();
+  }
+  return *_instance;
+}
+
+SensorHealth::SensorHealth() {
+  memset(lastResults, 0, sizeof(lastResults));
+  memset(&stats, 0, sizeof(stats));
+}
+
+SensorHealth::~SensorHealth() {
+}
+
+SensorFault SensorHealth::measured(uint8_t zone, const vl53l1x::Results *results, bool busError) {
+  SensorFault fault = FAULT_NONE;
+  zone &= 1;
+
+  if (busError) fault = FAULT_BUS;                  // Checked first - a failed read can still have left old results behind
+  else if (!results) fault = FAULT_TIMEOUT;
+  else if (results->spads == 0 || results->rangeStatus == 255) fault = FAULT_IMPLAUSIBLE;
+  else {
+    // Real readings always carry some noise in one of the fields - a frozen sensor hands back the same registers
+    const vl53l1x::Results &last = lastResults[zone];
+    bool same = results->signalPerSpad == last.signalPerSpad && results->ambientPerSpad == last.ambientPerSpad &&
+                results->distance == last.distance && results->sigma == last.sigma && results->rangeStatus == last.rangeStatus;
+    sameResults[zone] = same ? sameResults[zone] + 1 : 0;
+    lastResults[zone] = *results;
+    if (sameResults[zone] >= HEALTH_STUCK_MEASUREMENTS) {
+      sameResults[zone] = 0;
+      fault = FAULT_STUCK;
+    }
+  }
+
+  if (fault == FAULT_NONE) {
+    consecutiveFaults = 0;
+    if (level == RECOVERY_NONE) faultSince = 0;     // A fault or two that cleared up on its own
+    if (level != RECOVERY_NONE && ++goodMeasurements >= HEALTH_RECOVERED_MEASUREMENTS) {
+      unsigned long outage = millis() - faultSince;
+      stats.outages++;
+      if (outage > stats.longestOutageMs) stats.longestOutageMs = outage;
+      EventLog::instance().record(EVENT_SENSOR_RECOVERED, level, outage);
+      level = RECOVERY_NONE;
+      faultSince = 0;
+    }
+    return fault;
+  }
+
+  stats.faults[fault]++;
+  goodMeasurements = 0;
+  if (consecutiveFaults < HEALTH_FAULT_LIMIT) consecutiveFaults++;
+  if (!faultSince) faultSince = millis() | 1;       // Never 0 - that means "no fault"
+  return fault;
+}
+
+void SensorHealth::initFailed() {
+  stats.faults[FAULT_BUS]++;
+  consecutiveFaults = HEALTH_FAULT_LIMIT;
+  level = RECOVERY_RESTART_RANGING;                 // Nothing is ranging yet - the bus is the first thing worth trying
+  faultSince = millis() | 1;
+}
+
+RecoveryStep SensorHealth::due() {
+  if (consecutiveFaults < HEALTH_FAULT_LIMIT) return RECOVERY_NONE;
+  if (level == RECOVERY_REINIT) {                   // Out of steps - try again now and then rather than resetting the device
+    return (millis() - lastStepAt >= HEALTH_REINIT_RETRY_MS) ? RECOVERY_REINIT : RECOVERY_NONE;
+  }
+  return (RecoveryStep)(level + 1);
+}
+
+void SensorHealth::stepDone(RecoveryStep step, bool ok, unsigned long tookMs) {
+  level = step;
+  lastStepAt = millis();
+  goodMeasurements = 0;
+  consecutiveFaults = ok ? 0 : HEALTH_FAULT_LIMIT;  // A step that did not even bring the sensor back moves straight on
+  memset(sameResults, 0, sizeof(sameResults));
+
+  stats.steps[step]++;
+  if (!ok) stats.failedSteps++;
+  EventLog::instance().record(EVENT_SENSOR_RECOVERY, step, ok, tookMs);
+}
@@ -0,0 +1,136 @@
+// Sensor Health Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class watches every measurement for timeouts, failed bus transactions, implausible results and a frozen sensor
+// After HEALTH_FAULT_LIMIT faults in a row it asks TofSensor for the next recovery step - clear the interrupt, restart
+// ranging, clock the I2C bus free, power cycle through XSHUT, then a soft reinit - each bounded by HEALTH_STEP_TIMEOUT_MS
+// A fault is over after HEALTH_RECOVERED_MEASUREMENTS good measurements; if every step has been tried the reinit is
+// repeated every HEALTH_REINIT_RETRY_MS with ranging suspended in between - the device is never reset, so the count survives
+
+#ifndef __SENSORHEALTH_H
+#define __SENSORHEALTH_H
+
+#include "Particle.h"
+#include "TofSensorConfig.h"
+#include "Vl53l1xDevice.h"
+
+/**
+ * @brief What went wrong with a measurement
+ */
+enum SensorFault : uint8_t {
+    FAULT_NONE,
+    FAULT_TIMEOUT,                          // No data ready within the sensor timeout
+    FAULT_BUS,                              // An I2C transaction failed (NACK, stuck bus)
+    FAULT_STUCK,                            // Bit-identical results for HEALTH_STUCK_MEASUREMENTS in a row - the sensor is frozen
+    FAULT_IMPLAUSIBLE,                      // A result no working sensor reports (no SPADs, unknown range status)
+    FAULT_KIND_COUNT
+};
+
+/**
+ * @brief Recovery steps in the order they are tried - each is more disruptive than the last
+ */
+enum RecoveryStep : uint8_t {
+    RECOVERY_NONE,
+    RECOVERY_CLEAR_INTERRUPT,               // Stop ranging and clear a missed interrupt
+    RECOVERY_RESTART_RANGING,               // Start a measurement and wait for it
+    RECOVERY_BUS_RESET,                     // Clock SCL until a slave holding SDA lets go, then restart the bus
+    RECOVERY_POWER_CYCLE,                   // XSHUT low and high, load the configuration again - baselines kept
+    RECOVERY_REINIT,                        // Everything setup() does, and the baselines are re-learned
+    RECOVERY_STEP_COUNT
+};
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * It is driven by TofSensor - measured() for every measurement, due() / stepDone() for the recovery steps.
+ */
+class SensorHealth {
+public:
+    struct Stats {
+        uint32_t faults[FAULT_KIND_COUNT];  // By SensorFault
+        uint32_t steps[RECOVERY_STEP_COUNT];    // Recovery steps run, by RecoveryStep
+        uint32_t failedSteps;
+        uint32_t outages;                   // Faults that ended in a recovery
+        uint32_t longestOutageMs;
+    };
+
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use SensorHealth::instance() to instantiate the singleton.
+     */
+    static SensorHealth &instance();
+
+    /**
+     * @brief Judges one measurement - results is NULL if it timed out, busError is set if a transaction failed
+     *
+     * zone is compared with the last result for the same zone, so a frozen sensor can be told from a scene that is simply
+     * still. Returns the fault (if any) so the caller can discard the measurement.
+     */
+    SensorFault measured(uint8_t zone, const vl53l1x::Results *results, bool busError);
+
+    /**
+     * @brief The sensor did not start in setup() - recovery starts at the bus reset
+     */
+    void initFailed();
+
+    /**
+     * @brief The recovery step to run now, or RECOVERY_NONE
+     */
+    RecoveryStep due();
+
+    /**
+     * @brief Reports a step TofSensor has run - a failed step moves straight on to the next one
+     */
+    void stepDone(RecoveryStep step, bool ok, unsigned long tookMs);
+
+    /**
+     * @brief True while every step has been tried and ranging waits for the next reinit
+     */
+    bool isSuspended() const { return level == RECOVERY_REINIT && consecutiveFaults >= HEALTH_FAULT_LIMIT; }
+
+    bool isHealthy() const { return level == RECOVERY_NONE && consecutiveFaults == 0; }
+    RecoveryStep getLevel() const { return level; }
+    const Stats &getStats() const { return stats; }
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use SensorHealth::instance() to instantiate the singleton.
+     */
+    SensorHealth();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~SensorHealth();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    SensorHealth(const SensorHealth&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    SensorHealth& operator=(const SensorHealth&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static SensorHealth *_instance;
+
+    RecoveryStep level = RECOVERY_NONE;     // The last step run for the current fault
+    uint16_t consecutiveFaults = 0;
+    uint16_t goodMeasurements = 0;          // Since the last step
+    unsigned long faultSince = 0;           // When the current fault began (0 - none)
+    unsigned long lastStepAt = 0;
+    vl53l1x::Results lastResults[2];
+    uint16_t sameResults[2] = {0, 0};
+    Stats stats;
+};
+#endif  /* __SENSORHEALTH_H */
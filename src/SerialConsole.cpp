@@ -0,0 +1,311 @@
+// Serial Console Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class is a line oriented command shell on USB serial for tuning and diagnosing a door without a rebuild
+// Input is collected a few bytes per loop() into a fixed line buffer and tokenized in place - nothing is allocated
+// and nothing waits on the port, so the acquisition loop keeps its frame rate while a technician types
+// Settings go through ConfigStore, so a "set" is validated and takes effect at the next frame boundary
+
+#include "Particle.h"
+#include "SerialConsole.h"
+#include "ConfigStore.h"
+#include "TofSensor.h"
+#include "PeopleCounter.h"
+#include "PersistentStore.h"
+#include "OccupancySeries.h"
+#include "EventLog.h"
+#include "CloudPublisher.h"
+#include "CrossingHistory.h"
+#include "SensorHealth.h"
+#include "SignatureMask.h"
+#include "TaskScheduler.h"
+#include "PowerProfile.h"
+
+typedef void (*ConsoleHandler)(int argc, char **argv);
+
+struct ConsoleCommand {
+  const char *name;
+  const char *usage;
+  ConsoleHandler handler;
+};
+
+static void cmdHelp(int argc, char **argv);
+
+// "get" - every setting with its range, or one by name
+static void cmdGet(int argc, char **argv) {
+  ConfigStore &config = ConfigStore::instance();
+  if (argc > 1) {
+    int32_t value;
+    if (config.getValue(argv[1], value)) Serial.printlnf("%s=%ld", argv[1], (long)value);
+    else Serial.printlnf("Unknown setting %s", argv[1]);
+    return;
+  }
+  for (int id = 0; id < CONFIG_ID_COUNT; id++) {
+    int32_t low, high;
+    config.getRange((ConfigId)id, low, high);
+    Serial.printlnf("%s=%ld (%ld-%ld)", config.getName((ConfigId)id), (long)config.getValue((ConfigId)id), (long)low, (long)high);
+  }
+  if (config.isPending()) Serial.println("Changes pending - applied at the next frame");
+}
+
+// "set name=value[,name=value...]" - the arguments are rejoined so "set a=1, b=2" works too
+static void cmdSet(int argc, char **argv) {
+  char assignments[CONSOLE_LINE_LENGTH];
+  size_t used = 0;
+  if (argc < 2) {
+    Serial.println("Usage: set name=value[,name=value...]");
+    return;
+  }
+  assignments[0] = '\0';
+  for (int i = 1; i < argc; i++) {
+    size_t length = strlen(argv[i]);
+    if (used + length + 1 > sizeof(assignments)) break;
+    memcpy(assignments + used, argv[i], length + 1);
+    used += length;
+  }
+  int result = ConfigStore::instance().set(assignments);
+  if (result == 0) Serial.println("OK - applied at the next frame");
+  else if (result == CONFIG_REJECTED_LAYOUT) Serial.println("Rejected - the zones would overlap or run off the SPAD array, nothing changed");
+  else Serial.printlnf("Rejected - assignment %d is unknown or out of range, nothing changed", -result);
+}
+
+static void cmdDefaults(int argc, char **argv) {
+  ConfigStore::instance().restoreDefaults();
+  Serial.println("Defaults staged - applied at the next frame");
+}
+
+// "layout" shows the zones, "layout <front> <back> [width]" moves them (recalibrates)
+static void cmdLayout(int argc, char **argv) {
+  const ConfigValues &config = ConfigStore::instance().get();
+  if (argc == 1) {
+    Serial.printlnf("Front %u back %u - %u SPADs through the door, %u across", config.frontCenter, config.backCenter, config.zoneWidth, config.zoneHeight);
+    return;
+  }
+  if (argc < 3) {
+    Serial.println("Usage: layout <front center> <back center> [width]");
+    return;
+  }
+  char assignments[CONSOLE_LINE_LENGTH];                          // All three or none
+  snprintf(assignments, sizeof(assignments), "frontCenter=%s,backCenter=%s,zoneWidth=%d", argv[1], argv[2], (argc > 3) ? atoi(argv[3]) : config.zoneWidth);
+  int result = ConfigStore::instance().set(assignments);
+  if (result != 0) {
+    Serial.println((result == CONFIG_REJECTED_LAYOUT) ? "Rejected - the zones would overlap or run off the SPAD array" : "Rejected - out of range");
+    return;
+  }
+  Serial.println("OK - zones move and recalibrate at the next frame");
+}
+
+// "count" shows the count, "count <n>" sets it ("count 0" resets)
+static void cmdCount(int argc, char **argv) {
+  if (argc > 1) PeopleCounter::instance().setCount(atoi(argv[1]));
+  Serial.printlnf("Count %d (limit %d)", PeopleCounter::instance().getCount(), PeopleCounter::instance().getLimit());
+}
+
+static void cmdCalibrate(int argc, char **argv) {
+  TofSensor::instance().performCalibration();
+  Serial.println("Re-learning the baselines - keep the doorway clear");
+}
+
+static void cmdStats(int argc, char **argv) {
+  static const char * const calibrationNames[] = {"warming up", "provisional", "complete"};
+  static const char * const restoreNames[] = {"defaults", "retained memory", "flash"};
+  TofSensor &sensor = TofSensor::instance();
+  PersistentStore &store = PersistentStore::instance();
+  const TofSensor::RecalibrationStats &vhv = sensor.getRecalibrationStats();
+  const SensorHealth::Stats &health = SensorHealth::instance().getStats();
+  const TofSensor::ValidationStats &samples = sensor.getValidationStats();
+  const SignatureMask::Stats &signatures = SignatureMask::instance().getStats();
+  OccupancyBin today;
+
+  Serial.printlnf("Uptime %lus, count %d, limit %d", (unsigned long)System.uptime(), PeopleCounter::instance().getCount(), PeopleCounter::instance().getLimit());
+  Serial.printlnf("Zones %d / %d kcps/SPAD, baselines %d / %d, state %d, calibration %s", sensor.getZone1(), sensor.getZone2(), sensor.getZoneBaseline(0), sensor.getZoneBaseline(1), sensor.getOccupancyState(), calibrationNames[sensor.getCalibrationState()]);
+  Serial.printlnf("Frame interval %lums, last frame at %lums", sensor.getFrameInterval(), sensor.getFrameTimestamp());
+  Serial.printlnf("Temperature recalibrations %lu (%lu timed out), longest pause %lums", (unsigned long)vhv.count, (unsigned long)vhv.timeouts, (unsigned long)vhv.maxPauseMs);
+  Serial.printlnf("Samples zone1/zone2 - valid %lu/%lu, degraded %lu/%lu, dropped %lu/%lu, re-measured %lu/%lu",
+                  (unsigned long)samples.valid[0], (unsigned long)samples.valid[1], (unsigned long)samples.degraded[0], (unsigned long)samples.degraded[1],
+                  (unsigned long)samples.dropped[0], (unsigned long)samples.dropped[1], (unsigned long)samples.remeasured[0], (unsigned long)samples.remeasured[1]);
+  Serial.printlnf("Sensor %s (step %d) - faults %lu timeout, %lu bus, %lu stuck, %lu implausible; %lu steps (%lu failed), %lu outages, longest %lums",
+                  SensorHealth::instance().isHealthy() ? "healthy" : "recovering", SensorHealth::instance().getLevel(),
+                  (unsigned long)health.faults[FAULT_TIMEOUT], (unsigned long)health.faults[FAULT_BUS], (unsigned long)health.faults[FAULT_STUCK], (unsigned long)health.faults[FAULT_IMPLAUSIBLE],
+                  (unsigned long)(health.steps[RECOVERY_CLEAR_INTERRUPT] + health.steps[RECOVERY_RESTART_RANGING] + health.steps[RECOVERY_BUS_RESET] + health.steps[RECOVERY_POWER_CYCLE] + health.steps[RECOVERY_REINIT]),
+                  (unsigned long)health.failedSteps, (unsigned long)health.outages, (unsigned long)health.longestOutageMs);
+  Serial.printlnf("Signatures %u learned from %lu of %lu episodes, masked %lu episodes (%lu frames)", signatures.templates,
+                  (unsigned long)signatures.learned, (unsigned long)signatures.episodes, (unsigned long)signatures.maskedEpisodes, (unsigned long)signatures.maskedFrames);
+  if (OccupancySeries::instance().getTotal(OccupancySeries::SERIES_HOUR, 24, today)) {
+    Serial.printlnf("Last 24h - %u in, %u out, %u aborted, peak %d", today.entries, today.exits, today.aborted, today.peakOccupancy);
+  }
+  Serial.printlnf("Published %lu events (%lu history), %u batches queued, %lu failed attempts, %lu batches merged", (unsigned long)CloudPublisher::instance().getPublished(), (unsigned long)CloudPublisher::instance().getHistoryPublished(), CloudPublisher::instance().getQueued(), (unsigned long)CloudPublisher::instance().getFailures(), (unsigned long)CloudPublisher::instance().getMerged());
+  Serial.printlnf("Restored from %s, %lu flash writes, %lu events dropped, %lu raw frames skipped", restoreNames[store.getRestoreSource()], (unsigned long)store.getFlashWrites(), (unsigned long)EventLog::instance().getDropped(), (unsigned long)SerialConsole::instance().getRawSkipped());
+}
+
+// "profile" shows the power profile and where the time went, "profile <name>|auto" picks one (saved like any setting)
+static void cmdProfile(int argc, char **argv) {
+  PowerProfile &profiles = PowerProfile::instance();
+  if (argc > 1) {
+    ProfileId profile = PowerProfile::find(argv[1]);
+    if (profile == PROFILE_COUNT || ConfigStore::instance().set(CONFIG_PROFILE, profile) != 0) {
+      Serial.println("Usage: profile auto|high-traffic|balanced|low-power|calibration");
+      return;
+    }
+    Serial.println("OK - applied at the next frame");
+    return;
+  }
+  const ProfileValues &values = profiles.get();
+  Serial.printlnf("%s (%s) - %ums budget, %s, %lu switches", values.name, ConfigStore::instance().get().profile ? "set by hand" : "auto", values.timingBudgetMs,
+                  values.framePeriodMs ? "periodic frames" : "frames back to back", (unsigned long)profiles.getSwitches());
+  for (int profile = PROFILE_HIGH_TRAFFIC; profile < PROFILE_COUNT; profile++) {
+    Serial.printlnf("  %-13s %lus", PowerProfile::getName((ProfileId)profile), profiles.getTimeInMs((ProfileId)profile) / 1000);
+  }
+}
+
+// "tasks" - where the loop's time goes, per scheduled task; "tasks reset" starts the figures again
+static void cmdTasks(int argc, char **argv) {
+  TaskScheduler &scheduler = TaskScheduler::instance();
+  if (argc > 1 && !strcmp(argv[1], "reset")) {
+    scheduler.resetStats();
+    Serial.println("Task statistics cleared");
+    return;
+  }
+  unsigned long elapsedMs = millis() - scheduler.getStatsSince();
+  Serial.printlnf("Over %lus - task, priority, period ms, budget us, runs, mean / max us, overruns, late, deferred, share of time", elapsedMs / 1000);
+  for (int task = 0; task < scheduler.getTaskCount(); task++) {
+    const TaskScheduler::TaskStats &stats = scheduler.getStats(task);
+    Serial.printlnf("%-12s %u %6lu %6lu %8lu %6lu / %-6lu %5lu %5lu %5lu %5.1f%%", stats.name, stats.priority, stats.periodMs, (unsigned long)stats.budgetUs,
+                    (unsigned long)stats.runs, stats.runs ? (unsigned long)(stats.totalUs / stats.runs) : 0UL, (unsigned long)stats.maxUs,
+                    (unsigned long)stats.overruns, (unsigned long)stats.late, (unsigned long)stats.deferred,
+                    elapsedMs ? (double)stats.totalUs / (elapsedMs * 10.0) : 0.0);
+  }
+}
+
+// "history [n]" - the crossing history and its newest n records; "history batch" - the next upload, for tools/history/HistoryDecode.cpp
+static void cmdHistory(int argc, char **argv) {
+  static const char * const kindNames[] = {"aborted", "entered", "exited", "count set"};
+  static char batch[PUBLISH_DATA_LENGTH];           // Static - too big for the application thread's stack
+  CrossingHistory &history = CrossingHistory::instance();
+  if (argc > 1 && !strcmp(argv[1], "batch")) {
+    uint16_t records = history.format(batch, sizeof(batch));
+    if (records) Serial.printlnf("%u records: %s", records, batch);
+    else Serial.println("Nothing to upload");
+    return;
+  }
+
+  const CrossingHistory::HistoryStats &stats = history.getStats();
+  uint16_t records = history.getRecords();
+  Serial.printlnf("%u records in %u of %u bytes, %u not uploaded, epoch %lu - %lu written since boot (%lu bytes), %lu dropped (%lu before upload)%s",
+                  records, (unsigned)history.getBytes(), HISTORY_BYTES, history.getUnsent(), (unsigned long)history.getEpoch(), (unsigned long)stats.written,
+                  (unsigned long)stats.writtenBytes, (unsigned long)stats.dropped, (unsigned long)stats.lost, stats.restored ? ", restored" : "");
+  int newest = (argc > 1) ? atoi(argv[1]) : 10;
+  HistoryRecord record;
+  for (uint16_t index = (newest >= 0 && records > newest) ? records - newest : 0; index < records; index++) {
+    if (!history.getRecord(index, record)) break;
+    uint64_t ms = (uint64_t)record.ticks * HISTORY_TICK_MS;
+    Serial.printlnf("  +%lu.%lus %-9s %3u%% count %ld", (unsigned long)(ms / 1000), (unsigned long)(ms % 1000) / 100, kindNames[record.kind],
+                    record.confidence, (long)record.count);
+  }
+}
+
+// "raw on|off" - per frame signals for plotting; frames are skipped rather than waited for if the host reads slowly
+static void cmdRaw(int argc, char **argv) {
+  if (argc > 1) SerialConsole::instance().setRawStreaming(strcmp(argv[1], "on") == 0);
+  Serial.printlnf("Raw frames %s", SerialConsole::instance().isRawStreaming() ? "on" : "off");
+}
+
+static const ConsoleCommand commands[] = {
+  {"help",      "",                            cmdHelp},
+  {"get",       "[name]",                      cmdGet},
+  {"set",       "name=value[,name=value...]",  cmdSet},
+  {"defaults",  "",                            cmdDefaults},
+  {"layout",    "[front back [width]]",        cmdLayout},
+  {"count",     "[value]",                     cmdCount},
+  {"calibrate", "",                            cmdCalibrate},
+  {"stats",     "",                            cmdStats},
+  {"tasks",     "[reset]",                     cmdTasks},
+  {"profile",   "[name|auto]",                 cmdProfile},
+  {"history",   "[n|batch]",                   cmdHistory},
+  {"raw",       "on|off",                      cmdRaw}
+};
+
+static void cmdHelp(int argc, char **argv) {
+  for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) Serial.printlnf("  %s %s", commands[i].name, commands[i].usage);
+}
+
+SerialConsole *SerialConsole::_instance;
+
+// [static]
+SerialConsole &SerialConsole::instance() {
+  if (!_instance) {
+      _instance = new SerialConsole();
+  }
+  return *_instance;
+}
+
+SerialConsole::SerialConsole() {
+  line[0] = '\0';
+}
+
+SerialConsole::~SerialConsole() {
+}
+
+void SerialConsole::setup() {
+  lineLength = 0;
+  overflowed = false;
+}
+
+void SerialConsole::loop() {
+  for (int budget = CONSOLE_READ_BUDGET; budget > 0 && Serial.available() > 0; budget--) {
+    char c = (char)Serial.read();
+    if (c == '\r' || c == '\n') {
+      if (overflowed) Serial.println("Line too long - ignored");
+      else if (lineLength) {
+        line[lineLength] = '\0';
+        execute(line);
+      }
+      lineLength = 0;
+      overflowed = false;
+      break;                                        // One command per loop - the next line waits for the next pass
+    }
+    if (c == '\b' || c == 0x7F) {                   // Backspace from a terminal
+      if (lineLength) lineLength--;
+    }
+    else if (lineLength < sizeof(line) - 1) line[lineLength++] = c;
+    else overflowed = true;
+  }
+
+  if (rawStreaming) streamFrame();
+}
+
+void SerialConsole::execute(char *text) {
+  char *argv[CONSOLE_MAX_TOKENS];
+  int argc = 0;
+
+  for (char *cursor = text; *cursor && argc < CONSOLE_MAX_TOKENS; ) {      // Split on blanks by terminating each token where it lies
+    while (*cursor == ' ' || *cursor == '\t') *cursor++ = '\0';
+    if (!*cursor) break;
+    argv[argc++] = cursor;
+    while (*cursor && *cursor != ' ' && *cursor != '\t') cursor++;
+  }
+  if (argc == 0) return;
+
+  for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+    if (strcmp(argv[0], commands[i].name) == 0) {
+      commands[i].handler(argc, argv);
+      return;
+    }
+  }
+  Serial.printlnf("Unknown command %s - try help", argv[0]);
+}
+
+// One line per completed frame, only if it fits in the port's buffer now
+void SerialConsole::streamFrame() {
+  TofSensor &sensor = TofSensor::instance();
+  unsigned long frame = sensor.getFrameTimestamp();
+  if (frame == lastStreamedFrame) return;
+  lastStreamedFrame = frame;
+
+  if (Serial.availableForWrite() < CONSOLE_RAW_LINE_LENGTH) {
+    rawSkipped++;
+    return;
+  }
+  Serial.printlnf("raw,%lu,%d,%d,%d", frame, sensor.getZone1(), sensor.getZone2(), sensor.getOccupancyState());
+}
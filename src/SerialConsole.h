@@ -0,0 +1,108 @@
+// Serial Console Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class is a line oriented command shell on USB serial for tuning and diagnosing a door without a rebuild
+// Input is collected a few bytes per loop() into a fixed line buffer and tokenized in place - nothing is allocated
+// and nothing waits on the port, so the acquisition loop keeps its frame rate while a technician types
+// Settings go through ConfigStore, so a "set" is validated and takes effect at the next frame boundary
+
+#ifndef __SERIALCONSOLE_H
+#define __SERIALCONSOLE_H
+
+#include "Particle.h"
+
+#define CONSOLE_LINE_LENGTH 96              // Longest command line - longer lines are discarded
+#define CONSOLE_MAX_TOKENS 6                // Command plus arguments
+#define CONSOLE_READ_BUDGET 32              // Most bytes taken from the port per call to loop()
+#define CONSOLE_RAW_LINE_LENGTH 48          // A raw frame is only written if the port has this much room (otherwise it is skipped)
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From global application setup you must call:
+ * SerialConsole::instance().setup();
+ *
+ * From global application loop you must call:
+ * SerialConsole::instance().loop();
+ */
+class SerialConsole {
+public:
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use SerialConsole::instance() to instantiate the singleton.
+     */
+    static SerialConsole &instance();
+
+    /**
+     * @brief Perform setup operations; call this from global application setup()
+     *
+     * You typically use SerialConsole::instance().setup();
+     */
+    void setup();
+
+    /**
+     * @brief Takes up to CONSOLE_READ_BUDGET bytes from the port, runs a command if a line completed and streams
+     * the latest frame if raw output is on
+     *
+     * You typically use SerialConsole::instance().loop();
+     */
+    void loop();
+
+    /**
+     * @brief Runs one command line - tokenized in place, so the buffer is modified
+     */
+    void execute(char *line);
+
+    /**
+     * @brief Raw frame streaming - one "raw,<ms>,<zone1>,<zone2>,<state>" line per frame
+     */
+    void setRawStreaming(bool enabled) { rawStreaming = enabled; }
+    bool isRawStreaming() const { return rawStreaming; }
+
+    /**
+     * @brief Raw frames not written because the port was backed up
+     */
+    uint32_t getRawSkipped() const { return rawSkipped; }
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use SerialConsole::instance() to instantiate the singleton.
+     */
+    SerialConsole();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~SerialConsole();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    SerialConsole(const SerialConsole&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    SerialConsole& operator=(const SerialConsole&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static SerialConsole *_instance;
+
+    void streamFrame();
+
+    char line[CONSOLE_LINE_LENGTH];
+    uint8_t lineLength = 0;
+    bool overflowed = false;                // Discarding the rest of a line that did not fit
+    bool rawStreaming = false;
+    unsigned long lastStreamedFrame = 0;
+    uint32_t rawSkipped = 0;
+};
+#endif  /* __SERIALCONSOLE_H */
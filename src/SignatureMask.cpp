@@ -0,0 +1,185 @@
+// Signature Mask Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class learns the recurring things that pass under the sensor without being people - a door swinging through the
+// zones - and masks them before PeopleCounter sees them
+
+#include "Particle.h"
+#include "SignatureMask.h"
+#include "EventLog.h"
+
+SignatureMask *SignatureMask::_instance;
+
+// [static]
+SignatureMask &SignatureMask::instance() {
+  if (!_instance) {
+      _instance = new SignatureMask();
+  }
+  return *_instance;
+}
+
+SignatureMask::SignatureMask() {
+  memset(&stats, 0, sizeof(stats));
+  clear();
+}
+
+SignatureMask::~SignatureMask() {
+}
+
+void SignatureMask::clear() {
+  memset(signatures, 0, sizeof(signatures));
+  stats.templates = 0;
+  inEpisode = false;
+  clearFrames = 0;
+  maskedBy = -1;
+}
+
+static inline int8_t quantize(int deviation) {
+  int steps = deviation / (1 << SIGNATURE_SCALE_SHIFT);
+  return (int8_t)((steps > 127) ? 127 : (steps < -127) ? -127 : steps);
+}
+
+bool SignatureMask::frame(const int deviation[2], int occupancy) {
+  if (occupancy == 0) {
+    if (clearFrames < 255) clearFrames++;
+    if (inEpisode) {
+      inEpisode = false;
+      maskedBy = -1;
+      learnEpisode();
+    }
+    return false;
+  }
+
+  if (!inEpisode) {
+    inEpisode = true;
+    episodeLength = 0;
+    episodeMasked = false;
+    episodeQuiet = clearFrames >= SIGNATURE_QUIET_FRAMES;
+    clearFrames = 0;
+    memset(matchError, 0, sizeof(matchError));
+  }
+
+  if (episodeLength >= SIGNATURE_FRAMES) {        // Longer than any signature - whatever is there now is something else
+    maskedBy = -1;
+    return false;
+  }
+
+  int8_t value[2] = {quantize(deviation[0]), quantize(deviation[1])};
+  episode[episodeLength][0] = value[0];
+  episode[episodeLength][1] = value[1];
+
+  // Extend each template's running difference by this frame - past its length a template expects a clear zone
+  uint16_t maskedFrameError = 0;
+  for (uint8_t slot = 0; slot < SIGNATURE_SLOTS; slot++) {
+    if (!signatures[slot].masking) continue;
+    const int8_t *expected = signatures[slot].profile[episodeLength];
+    uint16_t error = abs(value[0] - expected[0]) + abs(value[1] - expected[1]);
+    matchError[slot] += error;
+    if (slot == maskedBy) maskedFrameError = error;
+  }
+  episodeLength++;
+
+  uint16_t limit = (uint16_t)(SIGNATURE_MATCH_ERROR * 2 * episodeLength);
+  if (maskedBy >= 0) {
+    // It stopped looking like the template - or someone walked in behind the door, which one frame shows
+    if (matchError[maskedBy] > limit || maskedFrameError > SIGNATURE_MATCH_ERROR * 2 * SIGNATURE_MATCH_FRAMES) maskedBy = -1;
+  }
+  else if (!episodeMasked && episodeLength >= SIGNATURE_MATCH_FRAMES) {
+    for (uint8_t slot = 0; slot < SIGNATURE_SLOTS; slot++) {
+      if (!signatures[slot].masking || matchError[slot] > limit) continue;
+      if (maskedBy < 0 || matchError[slot] < matchError[maskedBy]) maskedBy = slot;
+    }
+    if (maskedBy >= 0) {
+      episodeMasked = true;
+      stats.maskedEpisodes++;
+      EventLog::instance().record(EVENT_SIGNATURE_MASKED, maskedBy, episodeLength);
+    }
+  }
+
+  if (maskedBy >= 0) stats.maskedFrames++;
+  return (maskedBy >= 0);
+}
+
+// [static] How much a signature is worth keeping - one its episodes only loosely agree on is never going to mask
+uint16_t SignatureMask::strength(const Signature &signature) {
+  return (signature.occurrences > 1 && signature.spread > SIGNATURE_MAX_SPREAD) ? 0 : signature.occurrences;
+}
+
+// Averages an episode into the signature it resembles, or starts a new one in place of the weakest
+void SignatureMask::learnEpisode() {
+  stats.episodes++;
+  if (episodeMasked || !episodeQuiet || episodeLength < SIGNATURE_MIN_FRAMES) return;
+  learnable++;
+
+  int8_t best = -1, weakest = 0;
+  uint32_t bestError = 0, bestFrames = 1;
+  for (uint8_t slot = 0; slot < SIGNATURE_SLOTS; slot++) {
+    const Signature &signature = signatures[slot];
+    if (strength(signature) < strength(signatures[weakest]) ||
+        (strength(signature) == strength(signatures[weakest]) && signature.lastSeen < signatures[weakest].lastSeen)) weakest = slot;
+    if (!signature.length) continue;
+
+    uint8_t frames = (signature.length > episodeLength) ? signature.length : episodeLength;
+    uint32_t error = 0;
+    for (uint8_t i = 0; i < frames; i++) {
+      int8_t observed[2] = {0, 0};
+      if (i < episodeLength) {
+        observed[0] = episode[i][0];
+        observed[1] = episode[i][1];
+      }
+      error += abs(observed[0] - signature.profile[i][0]) + abs(observed[1] - signature.profile[i][1]);
+    }
+    if (error > (uint32_t)SIGNATURE_CLUSTER_ERROR * 2 * frames) continue;
+    if (best < 0 || error * bestFrames < bestError * frames) {   // Lowest mean difference
+      best = slot;
+      bestError = error;
+      bestFrames = frames;
+    }
+  }
+
+  if (best < 0) {                                 // Nothing like it yet
+    Signature &signature = signatures[weakest];
+    if (signature.masking) stats.templates--;
+    memset(&signature, 0, sizeof(signature));
+    memcpy(signature.profile, episode, episodeLength * sizeof(episode[0]));
+    signature.length = episodeLength;
+    signature.occurrences = 1;
+    signature.firstSeen = learnable;
+    signature.lastSeen = stats.episodes;
+    return;
+  }
+
+  // How far this episode was from the signature, relative to how far the signature is from the baseline
+  Signature &signature = signatures[best];
+  uint32_t deviation = 0;
+  for (uint8_t i = 0; i < bestFrames; i++) deviation += abs(signature.profile[i][0]) + abs(signature.profile[i][1]);
+  uint32_t spread = bestError * 100 / (deviation ? deviation : 1);
+  if (spread > 255) spread = 255;
+  int spreadDivisor = (signature.occurrences < 4) ? signature.occurrences : 4;
+  signature.spread += ((int)spread - signature.spread) / spreadDivisor;
+
+  // Running mean for the first few, then an average that keeps following a slowly changing door closer
+  int divisor = (signature.occurrences < 4) ? signature.occurrences + 1 : 4;
+  for (uint8_t i = 0; i < SIGNATURE_FRAMES; i++) {
+    for (uint8_t zone = 0; zone < 2; zone++) {
+      int observed = (i < episodeLength) ? episode[i][zone] : 0;
+      signature.profile[i][zone] += (observed - signature.profile[i][zone]) / divisor;
+    }
+  }
+  if (episodeLength > signature.length) signature.length = episodeLength;
+  signature.lastSeen = stats.episodes;
+  stats.learned++;
+  if (signature.occurrences < 0xFFFF) signature.occurrences++;
+
+  // A template once its episodes agree closely and came often enough - it stays one while they keep agreeing
+  bool masking = signature.masking;
+  bool recurring = signature.occurrences >= SIGNATURE_MIN_OCCURRENCES &&
+                   (uint32_t)signature.occurrences * SIGNATURE_MIN_SHARE >= learnable - signature.firstSeen + 1;
+  signature.masking = (signature.spread <= SIGNATURE_MAX_SPREAD) && (masking || recurring);
+  if (signature.masking && !masking) {
+    stats.templates++;
+    EventLog::instance().record(EVENT_SIGNATURE_LEARNED, best, signature.occurrences, signature.length);
+  }
+  else if (masking && !signature.masking) stats.templates--;
+}
@@ -0,0 +1,115 @@
+// Signature Mask Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class learns the recurring things that pass under the sensor without being people - a door swinging through the
+// zones - and masks them before PeopleCounter sees them
+// An episode runs from the first occupied frame to the next clear one and is recorded as each zone's deviation from its
+// baseline. Episodes that look alike (SIGNATURE_CLUSTER_ERROR) are averaged into one of SIGNATURE_SLOTS signatures. People
+// differ in height, clothing and pace, so their episodes rarely agree; a door on a closer traces the same profile every time,
+// and after SIGNATURE_MIN_OCCURRENCES its signature is a template. Look-alike people do still meet: faint ones sit within
+// SIGNATURE_CLUSTER_ERROR of each other, and bright ones saturate into the same plateau. So only an episode that starts from a
+// quiet doorway teaches a signature (a pass in a stream of people does not), and a signature only becomes a template if its
+// episodes agreed closely (SIGNATURE_MAX_SPREAD) and kept coming (SIGNATURE_MIN_SHARE) - one kind of person is a small share
+// of the traffic, while a door repeats itself whatever the traffic. Each frame of a new episode adds its difference from every
+// template to a running total, so matching is a handful of subtractions per frame - a match masks the episode until it stops
+// looking like the template. A chair or cart left in a zone is not an episode for long: ZoneDecision relearns the baseline.
+
+#ifndef __SIGNATUREMASK_H
+#define __SIGNATUREMASK_H
+
+#include "Particle.h"
+#include "TofSensorConfig.h"
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * TofSensor calls frame() for every decided frame.
+ */
+class SignatureMask {
+public:
+    struct Stats {
+        uint32_t episodes;
+        uint32_t learned;                   // Episodes averaged into an existing signature
+        uint32_t maskedEpisodes;
+        uint32_t maskedFrames;
+        uint8_t templates;                  // Signatures masking now
+    };
+
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use SignatureMask::instance() to instantiate the singleton.
+     */
+    static SignatureMask &instance();
+
+    /**
+     * @brief Feeds one frame - deviation is each zone's signal less its baseline, occupancy the decision before masking
+     *
+     * Returns true if the frame belongs to a masked episode and should be reported as clear.
+     */
+    bool frame(const int deviation[2], int occupancy);
+
+    /**
+     * @brief Forgets every signature - the zones have moved
+     */
+    void clear();
+
+    const Stats &getStats() const { return stats; }
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use SignatureMask::instance() to instantiate the singleton.
+     */
+    SignatureMask();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~SignatureMask();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    SignatureMask(const SignatureMask&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    SignatureMask& operator=(const SignatureMask&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static SignatureMask *_instance;
+
+    struct Signature {
+        int8_t profile[SIGNATURE_FRAMES][2];    // Mean deviation per frame and zone - zero (clear) past length
+        uint8_t length;                         // 0 - empty slot
+        uint16_t occurrences;
+        uint8_t spread;                         // Mean difference of the episodes that joined it, % of its mean deviation
+        bool masking;                           // A template
+        uint32_t firstSeen;                     // Learnable episode it was started by
+        uint32_t lastSeen;                      // Episode number - the least recently seen weak signature is replaced first
+    };
+
+    void learnEpisode();
+    static uint16_t strength(const Signature &signature);
+
+    Signature signatures[SIGNATURE_SLOTS];
+    int8_t episode[SIGNATURE_FRAMES][2];
+    uint16_t matchError[SIGNATURE_SLOTS];       // Running sum of absolute differences for the current episode
+    uint8_t episodeLength = 0;
+    bool inEpisode = false;
+    uint8_t clearFrames = 0;                    // Since the last episode ended
+    bool episodeQuiet = false;                  // The doorway was clear for SIGNATURE_QUIET_FRAMES before it
+    uint32_t learnable = 0;                     // Episodes that could teach a signature - quiet, unmasked and long enough
+    bool episodeMasked = false;                 // At any point - masked episodes never teach a signature
+    int8_t maskedBy = -1;                       // Slot masking the current episode
+    Stats stats;
+};
+#endif  /* __SIGNATUREMASK_H */
@@ -24,11 +24,21 @@
 // v2.03 - Added a buffer to find the minimum deistance in buffer set in the config file
 // v3.00 - Removed most logic in favor of a simple getSignalBySpad() approach.
 // v4.00 - Implemented the "magicalStateMap" algorithm, which replaced the FSM. Counts now change when sufficiently BELOW baseline. Helps detect black.
+// v4.01 - The main loop is a set of scheduled tasks (TaskScheduler) fitted around the sensor's frames
 
 #include <Wire.h>
 #include "ErrorCodes.h"
 #include "TofSensor.h"
 #include "PeopleCounter.h"
+#include "EventLog.h"
+#include "PersistentStore.h"
+#include "OccupancySeries.h"
+#include "ConfigStore.h"
+#include "SerialConsole.h"
+#include "CloudPublisher.h"
+#include "CrossingHistory.h"
+#include "OccupancyLimit.h"
+#include "TaskScheduler.h"
 
 // Enable logging as we ware looking at messages that will be off-line - need to connect to serial terminal
 SerialLogHandler logHandler(LOG_LEVEL_INFO);
@@ -37,10 +47,52 @@ SYSTEM_MODE(MANUAL);
 SYSTEM_THREAD(ENABLED);
 
 //Optional interrupt and shutdown pins.
-const int shutdownPin = D2;                       // Pin to shut down the device - active low
+const int shutdownPin = TOF_SENSOR_SHUTDOWN_PIN;  // Pin to shut down the device - level set in TofSensorConfig.h
 const int intPin =      D3;                       // Hardware interrupt - poliarity set in the library
 const int blueLED =     D7;
-char statusMsg[64] = "Startup Complete.  Running version 4.0";
+char statusMsg[64] = "Startup Complete.  Running version 4.01";
+
+// Tasks (TaskScheduler) - acquisition and counting are started by each other, the rest run on their periods
+int sensorTask = -1;
+int countTask = -1;
+
+// Runs a frame, hands a change of state to counting, and tells the scheduler when the next frame's first result is ready
+static void acquisitionTask() {
+  if (TofSensor::instance().loop() > 0) {     // If there is new data from the sensor (errors and warm-up are negative)
+    TaskScheduler::instance().trigger(countTask);
+  }
+  unsigned long nextResultAt = TofSensor::instance().getNextResultAt();
+  if (!nextResultAt) nextResultAt = millis() + TASK_SENSOR_POLL_MS;
+  TaskScheduler::instance().runAt(sensorTask, nextResultAt);
+}
+
+static void countingTask() {
+  PeopleCounter::instance().loop();
+}
+
+static void storeTask() {
+  PersistentStore::instance().loop();
+  OccupancySeries::instance().loop();
+}
+
+static void ledTask() {
+  if (!OccupancyLimit::instance().isDrivingLed()) digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN));    // The limit alert takes the LED over
+}
+
+// Logs each task that overran its budget or ran late since the last check
+static void diagnosticsTask() {
+  static uint32_t reportedOverruns[SCHEDULER_MAX_TASKS], reportedLate[SCHEDULER_MAX_TASKS];
+  TaskScheduler &scheduler = TaskScheduler::instance();
+  for (int task = 0; task < scheduler.getTaskCount(); task++) {
+    const TaskScheduler::TaskStats &stats = scheduler.getStats(task);
+    if (stats.overruns < reportedOverruns[task] || stats.late < reportedLate[task]) reportedOverruns[task] = reportedLate[task] = 0;   // Stats were reset
+    if (stats.overruns != reportedOverruns[task] || stats.late != reportedLate[task]) {
+      EventLog::instance().record(EVENT_TASK_OVERRUN, task, stats.overruns - reportedOverruns[task], stats.late - reportedLate[task], stats.maxUs);
+      reportedOverruns[task] = stats.overruns;
+      reportedLate[task] = stats.late;
+    }
+  }
+}
 
 void setup(void)
 {
@@ -51,30 +103,40 @@ void setup(void)
   pinMode(blueLED,OUTPUT);                  // Set up pin names and modes
   pinMode(intPin,INPUT);
   pinMode(shutdownPin,OUTPUT);              // Not sure if we can use this - messes with Boron i2c bus
-  digitalWrite(shutdownPin, LOW);           // Turns on the module
+  digitalWrite(shutdownPin, !TOF_SENSOR_SHUTDOWN_LEVEL);   // Turns on the module
   digitalWrite(blueLED,HIGH);               // Blue led on for Setup
 
   delay(100);
 
+  PersistentStore::instance().setup();      // First - the sensor and counter restore from it
+  ConfigStore::instance().setup();          // Settings block is in the persistent store - read before anything that uses them
+  EventLog::instance().setup();
   TofSensor::instance().setup();
   PeopleCounter::instance().setup();
-  PeopleCounter::instance().setCount(1);
+  OccupancySeries::instance().setup(PeopleCounter::instance().getCount());
+  CrossingHistory::instance().setup(PeopleCounter::instance().getCount());
+  CloudPublisher::instance().setup(PeopleCounter::instance().getCount());
+  OccupancyLimit::instance().setup(PeopleCounter::instance().getCount());
+  SerialConsole::instance().setup();
+
+  TaskScheduler &scheduler = TaskScheduler::instance();
+  sensorTask = scheduler.add("sensor", acquisitionTask, TASK_PRIORITY_SENSOR, 0, TASK_SENSOR_BUDGET_US);
+  countTask = scheduler.add("count", countingTask, TASK_PRIORITY_HIGH, 0, TASK_COUNT_BUDGET_US);
+  scheduler.add("log", []() { EventLog::instance().loop(); }, TASK_PRIORITY_NORMAL, TASK_LOG_PERIOD_MS, TASK_LOG_BUDGET_US);
+  scheduler.add("limit", []() { OccupancyLimit::instance().loop(); }, TASK_PRIORITY_NORMAL, TASK_LIMIT_PERIOD_MS, TASK_LIMIT_BUDGET_US);
+  scheduler.add("publish", []() { CloudPublisher::instance().loop(); }, TASK_PRIORITY_NORMAL, TASK_PUBLISH_PERIOD_MS, TASK_PUBLISH_BUDGET_US);
+  scheduler.add("store", storeTask, TASK_PRIORITY_LOW, TASK_STORE_PERIOD_MS, TASK_STORE_BUDGET_US);
+  scheduler.add("console", []() { SerialConsole::instance().loop(); }, TASK_PRIORITY_LOW, TASK_CONSOLE_PERIOD_MS, TASK_CONSOLE_BUDGET_US);
+  scheduler.add("led", ledTask, TASK_PRIORITY_LOW, TASK_LED_PERIOD_MS, TASK_LED_BUDGET_US);
+  scheduler.add("diagnostics", diagnosticsTask, TASK_PRIORITY_LOW, TASK_DIAGNOSTICS_PERIOD_MS, TASK_DIAGNOSTICS_BUDGET_US);
+  scheduler.trigger(sensorTask);                // The first frame starts right away
 
   Log.info(statusMsg);
 
   digitalWrite(blueLED, LOW);                   // Signal setup complete
 }
 
-unsigned long lastLedUpdate = 0;
-
 void loop(void)
 {
-  if( (millis() - lastLedUpdate) > 1000 ){
-    digitalWrite(LED_BUILTIN,!digitalRead(LED_BUILTIN));
-    lastLedUpdate = millis();
-  }
-
-  if (TofSensor::instance().loop()) {         // If there is new data from the sensor
-    PeopleCounter::instance().loop();         // Then check to see if we need to update the counts
-  }
+  TaskScheduler::instance().loop();             // One task per pass - the system thread gets its turn in between
 }
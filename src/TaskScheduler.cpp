@@ -0,0 +1,127 @@
+// Task Scheduler Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class runs the main loop as a set of cooperative tasks - each with a priority, a period and a time budget
+// A task only starts if its budget ends before any higher priority task is due, so acquisition keeps its cadence
+
+#include <limits.h>
+#include "Particle.h"
+#include "TaskScheduler.h"
+
+TaskScheduler *TaskScheduler::_instance;
+
+// [static]
+TaskScheduler &TaskScheduler::instance() {
+  if (!_instance) {
+      _instance = new TaskScheduler();
+  }
+  return *_instance;
+}
+
+TaskScheduler::TaskScheduler() {
+  memset(tasks, 0, sizeof(tasks));
+}
+
+TaskScheduler::~TaskScheduler() {
+}
+
+int TaskScheduler::add(const char *name, TaskFunction function, TaskPriority priority, unsigned long periodMs, uint32_t budgetUs) {
+  if (taskCount >= SCHEDULER_MAX_TASKS || !function) return -1;
+  Task &task = tasks[taskCount];
+  memset(&task, 0, sizeof(task));
+  task.function = function;
+  task.nextRun = millis();
+  task.pending = (periodMs != 0);
+  task.stats.name = name;
+  task.stats.priority = priority;
+  task.stats.periodMs = periodMs;
+  task.stats.budgetUs = budgetUs;
+  if (!statsSince) statsSince = millis();
+  return taskCount++;
+}
+
+void TaskScheduler::trigger(int task) {
+  if (task < 0 || task >= taskCount) return;
+  tasks[task].pending = true;
+  tasks[task].nextRun = millis();
+}
+
+void TaskScheduler::runAt(int task, unsigned long at) {
+  if (task < 0 || task >= taskCount) return;
+  tasks[task].pending = true;
+  tasks[task].nextRun = at;
+}
+
+void TaskScheduler::resetStats() {
+  for (uint8_t i = 0; i < taskCount; i++) {
+    TaskStats &stats = tasks[i].stats;
+    stats.runs = stats.overruns = stats.late = stats.deferred = stats.maxUs = 0;
+    stats.totalUs = 0;
+  }
+  statsSince = millis();
+}
+
+// Priority levels from the top - each level's next due time is the deadline everything below it has to fit in
+void TaskScheduler::loop() {
+  unsigned long now = millis();
+  long slack = LONG_MAX;                                // ms until a higher priority task is due
+
+  for (uint8_t level = TASK_PRIORITY_SENSOR; level <= TASK_PRIORITY_LOW; level++) {
+    int due = -1;
+    for (uint8_t i = 0; i < taskCount; i++) {           // The task at this level that has been due longest
+      const Task &task = tasks[i];
+      if (task.stats.priority != level || !task.pending || (long)(now - task.nextRun) < 0) continue;
+      if (due < 0 || (long)(tasks[due].nextRun - task.nextRun) > 0) due = i;
+    }
+
+    if (due >= 0) {
+      Task &task = tasks[due];
+      bool fits = (slack == LONG_MAX) || ((slack > 0) && task.stats.budgetUs <= (uint32_t)(slack - 1) * 1000UL);   // millis() is coarse - keep a millisecond back
+      bool starved = task.waitingSince && (now - task.waitingSince >= SCHEDULER_MAX_WAIT_MS);
+      if (fits || starved) {
+        run(task, now, !fits);
+        return;
+      }
+      if (!task.waitingSince) {
+        task.waitingSince = now | 1;                    // Never 0 - that means "not waiting"
+        task.stats.deferred++;
+      }
+    }
+
+    for (uint8_t i = 0; i < taskCount; i++) {
+      const Task &task = tasks[i];
+      if (task.stats.priority != level || !task.pending) continue;
+      long until = (long)(task.nextRun - now);
+      if (until < slack) slack = (until < 0) ? 0 : until;
+    }
+  }
+}
+
+void TaskScheduler::run(Task &task, unsigned long now, bool forced) {
+  TaskStats &stats = task.stats;
+
+  // Set before the run so the task can move its own next run
+  if (stats.periodMs) {
+    task.nextRun += stats.periodMs;
+    if ((long)(now - task.nextRun) >= 0) {              // Slipped a whole period - carry on from now rather than catch up
+      task.nextRun = now + stats.periodMs;
+      stats.late++;
+    }
+    else if (forced) stats.late++;
+  }
+  else {
+    task.pending = false;
+    if (forced) stats.late++;
+  }
+  task.waitingSince = 0;
+
+  unsigned long started = micros();
+  task.function();
+  uint32_t took = (uint32_t)(micros() - started);
+
+  stats.runs++;
+  stats.totalUs += took;
+  if (took > stats.maxUs) stats.maxUs = took;
+  if (took > stats.budgetUs) stats.overruns++;
+}
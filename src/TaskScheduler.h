@@ -0,0 +1,138 @@
+// Task Scheduler Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class runs the main loop as a set of cooperative tasks - acquisition, counting, logging, publishing, the LED and
+// the console - each with a priority, a period and a time budget, in SCHEDULER_MAX_TASKS fixed slots
+// One task runs per loop() call: the highest priority task that is due, as long as its budget ends before any higher
+// priority task is due again. Acquisition tells the scheduler when the sensor's next result will be ready, so the rest of
+// the application fills the time the sensor spends integrating and never holds up a frame. Every run is timed; a run
+// longer than its budget is an overrun, a periodic task that slipped a whole period is late.
+
+#ifndef __TASKSCHEDULER_H
+#define __TASKSCHEDULER_H
+
+#include "Particle.h"
+#include "PeopleCounterConfig.h"
+
+/**
+ * @brief Task priorities, highest first - ties go to the task that has been due longest
+ */
+enum TaskPriority : uint8_t {
+    TASK_PRIORITY_SENSOR,                   // Acquisition - everything else is fitted around it
+    TASK_PRIORITY_HIGH,                     // Counting - on the frame that changed the occupancy
+    TASK_PRIORITY_NORMAL,
+    TASK_PRIORITY_LOW                       // Diagnostics and anything that can wait for a quiet moment
+};
+
+typedef void (*TaskFunction)();
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From global application setup, add the tasks:
+ * TaskScheduler::instance().add("name", function, priority, periodMs, budgetUs);
+ *
+ * From global application loop you must call:
+ * TaskScheduler::instance().loop();
+ */
+class TaskScheduler {
+public:
+    struct TaskStats {
+        const char *name;
+        TaskPriority priority;
+        unsigned long periodMs;             // 0 - runs when triggered
+        uint32_t budgetUs;
+        uint32_t runs;
+        uint32_t overruns;                  // Runs longer than budgetUs
+        uint32_t late;                      // Periods slipped, or started only because it had waited SCHEDULER_MAX_WAIT_MS
+        uint32_t deferred;                  // Times it was due but did not fit before a higher priority task
+        uint32_t maxUs;
+        uint64_t totalUs;
+    };
+
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use TaskScheduler::instance() to instantiate the singleton.
+     */
+    static TaskScheduler &instance();
+
+    /**
+     * @brief Adds a task - returns its id, or -1 if every slot is taken
+     *
+     * A periodic task first runs right away. With periodMs 0 the task only runs after trigger().
+     */
+    int add(const char *name, TaskFunction function, TaskPriority priority, unsigned long periodMs, uint32_t budgetUs);
+
+    /**
+     * @brief Runs one task that is due, if any fits; call this from global application loop()
+     *
+     * You typically use TaskScheduler::instance().loop();
+     */
+    void loop();
+
+    /**
+     * @brief Makes a task due now - for work that follows an event, like counting after a state change
+     */
+    void trigger(int task);
+
+    /**
+     * @brief Moves a task's next run to at (millis()) - acquisition sets this to when the next result is ready
+     */
+    void runAt(int task, unsigned long at);
+
+    /**
+     * @brief Clears the run statistics (the tasks stay)
+     */
+    void resetStats();
+
+    int getTaskCount() const { return taskCount; }
+    const TaskStats &getStats(int task) const { return tasks[task].stats; }
+    unsigned long getStatsSince() const { return statsSince; }
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use TaskScheduler::instance() to instantiate the singleton.
+     */
+    TaskScheduler();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~TaskScheduler();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    TaskScheduler(const TaskScheduler&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static TaskScheduler *_instance;
+
+    struct Task {
+        TaskFunction function;
+        unsigned long nextRun;              // millis()
+        unsigned long waitingSince;         // When it first did not fit (0 - it is not waiting)
+        bool pending;                       // Due at nextRun - cleared after a triggered task runs
+        TaskStats stats;
+    };
+
+    void run(Task &task, unsigned long now, bool forced);
+
+    Task tasks[SCHEDULER_MAX_TASKS];
+    uint8_t taskCount = 0;
+    unsigned long statsSince = 0;
+};
+#endif  /* __TASKSCHEDULER_H */
@@ -3,21 +3,127 @@
 // Date: May 2023
 // License: GPL3
 // This is the class for the ST Micro VL53L1X Time of Flight Sensor
-// We are using the Sparkfun library which has some shortcomgings
+// We started with the Sparkfun library which has some shortcomgings
 // - It does not implement distance mode medium
 // - It does not give access to the factory calibration of the optical center
+// The sensor is now reached through Vl53l1xDevice, which binds the bus, address and pins at compile time
 
 #include "Particle.h"
 #include "ErrorCodes.h"
 #include "TofSensorConfig.h"
 #include "PeopleCounterConfig.h"
 #include "TofSensor.h"
+#include "EventLog.h"
+#include "PersistentStore.h"
+#include "ZonePlacement.h"
+#include "ConfigStore.h"
+#include "ZoneDecision.h"
+#include "SensorHealth.h"
+#include "SignatureMask.h"
+#include "PowerProfile.h"
 
-uint8_t opticalCenters[2] = {FRONT_ZONE_CENTER,BACK_ZONE_CENTER}; 
+uint8_t opticalCenters[2] = {FRONT_ZONE_CENTER,BACK_ZONE_CENTER};      // Copied from ConfigStore when it applies a layout
 int zoneSignalPerSpad[2] = {0,0};
-int zoneBaselines[2] = {0,0};
 int occupancyState = 0;      // This is the current occupancy state (occupied or not, zone 1 (ones) and zone 2 (twos))
 
+// Frame timing - each zone is stamped when its result is ready so transitions can be timed to the zone, not the frame
+static unsigned long zoneTimestamps[2] = {0, 0};
+static unsigned long frameTimestamp = 0;
+static unsigned long frameInterval = 0;                      // Time between the last two completed frames
+
+// ROI programming - the size is only rewritten when it changes, otherwise moving the ROI is a single byte write
+static uint8_t programmedRoiWidth = 0;
+static uint8_t programmedRoiHeight = 0;
+
+// Zone pipeline - the ROI of a counting frame that is integrating now, started as soon as the one before it was ready
+#define FRAME_ROIS (LATERAL_SPLIT ? 4 : 2)                  // Zone 1 then zone 2 - each as a left and right lane with LATERAL_SPLIT
+static int8_t armedRoi = -1;                                // -1 - nothing of ours is ranging (idle, or another mode used the sensor)
+static int8_t preparedRoi = -1;                             // The frame ROI the sensor is programmed for but not yet ranging
+static unsigned long armedAt = 0;
+static unsigned long frameStartedAt = 0;                    // When the current (or last) frame's first ROI started integrating
+
+// Lateral lanes (LATERAL_SPLIT) - each zone split into a left and a right half across the door
+static uint8_t laneCenters[2][2];                            // [zone][lane] optical centers
+static int laneSignalPerSpad[2][2] = {{0, 0}, {0, 0}};
+static int laneBaselines[2][2] = {{0, 0}, {0, 0}};
+static bool laneBaselinesValid = false;
+static int laneStates[2] = {0, 0};                           // Per lane, zone1 ones / zone2 twos
+
+// Depth image scan - takes over loop() from counting until stopped
+static TofSensor::DepthImage depthImage;
+static bool scanning = false;
+static uint8_t scanCursor = 0;                               // Next tile in round-robin order
+static uint64_t scanChanged = 0;                             // Tiles to refresh ahead of the round-robin
+static bool scanPickChanged = false;                         // Alternates so the round-robin always keeps moving
+
+static bool placing = false;                                 // Zone placement window - also takes over loop()
+
+// Baselines and the occupancy decision - calibration is a background phase of loop() rather than a blocking step in setup()
+static ZoneDecision zoneDecision;
+
+// Temperature (VHV) recalibration scheduler - updates are slotted into idle gaps between frames
+static bool vhvRunning = false;
+static int vhvReason = 0;                                    // 1 - elapsed time, 2 - signal drift
+static unsigned long vhvStartedAt = 0;
+static unsigned long lastVhvAt = 0;
+static int baselinesAtLastVhv[2] = {0, 0};
+static uint16_t idleFrames = 0;                              // Consecutive frames with both zones clear
+static TofSensor::RecalibrationStats recalibrationStats = {0, 0, 0, 0, 0};
+
+// Sample validation - the decision uses the signal rate, so a result with an unreliable distance still says how much light
+// came back; only one that says nothing at all is dropped
+enum SampleVerdict : uint8_t { SAMPLE_VALID, SAMPLE_DEGRADED, SAMPLE_INVALID };
+#define RANGE_STATUS_HARDWARE_FAIL 5                         // ULD status (see vl53l1x::rangeStatusMap)
+static TofSensor::ValidationStats validationStats;
+
+// Incremental offset / crosstalk calibration - accumulates the normal frames rather than blocking for 50 of its own
+enum CalibrationJobType : uint8_t { JOB_NONE, JOB_OFFSET, JOB_XTALK };
+static struct {
+  CalibrationJobType type;
+  uint16_t targetMm;
+  unsigned long startedAt;
+  uint16_t frames[2];
+  uint32_t distanceSum[2];                                   // 32 bit sums - 50 frames of 16 bit values would overflow 16 bits
+  uint32_t signalRateSum[2];
+  uint32_t spadSum[2];
+} calibrationJob;
+
+// Per-zone compensation, programmed by the zone scheduler when it switches ROIs
+static int16_t zoneOffsets[2] = {0, 0};
+static uint16_t zoneXTalk[2] = {0, 0};
+static bool offsetsValid = false;                            // Until a job has run we leave the factory values alone
+static bool xtalkValid = false;
+static int16_t programmedOffset = INT16_MIN;                 // What the sensor currently holds - avoids rewriting unchanged values
+static int32_t programmedXTalk = -1;
+
+// Inverts the optical center table in TofSensorConfig.h - rows 0-7 count up from 128, rows 8-15 count down from 127
+static void spadPosition(uint8_t center, int &row, int &column) {
+  if (center >= 128) {
+    column = (center - 128) / 8;
+    row = (center - 128) % 8;
+  }
+  else {
+    column = (127 - center) / 8;
+    row = 8 + (127 - center) % 8;
+  }
+}
+
+static uint8_t spadCenter(int row, int column) {
+  row = constrain(row, 0, 15);
+  column = constrain(column, 0, 15);
+  return (row < 8) ? (uint8_t)(128 + column * 8 + row) : (uint8_t)(127 - column * 8 - (row - 8));
+}
+
+// Lane centers sit a quarter of the zone height either side of the zone center (rows run across the door)
+static void placeLanes() {
+  for (byte zone = 0; zone < 2; zone++) {
+    int row, column;
+    spadPosition(opticalCenters[zone], row, column);
+    laneCenters[zone][0] = spadCenter(row - ConfigStore::instance().get().zoneHeight / 4, column);
+    laneCenters[zone][1] = spadCenter(row + ConfigStore::instance().get().zoneHeight / 4, column);
+  }
+}
+
 TofSensor *TofSensor::_instance;
 
 // [static]
@@ -34,91 +140,698 @@ TofSensor::TofSensor() {
 TofSensor::~TofSensor() {
 }
 
-SFEVL53L1X myTofSensor;
+// The device properties - after begin() and again whenever recovery has power cycled the sensor
+static void configureSensor(TofSensor::Device &sensor) {
+  sensor.setDistanceModeLong();
+  sensor.setSigmaThreshold(45);             // Default is 45 - this will make it harder to get a valid result - Range 1 - 16383
+  sensor.setSignalThreshold(1500);          // Default is 1500 raising value makes it harder to get a valid results- Range 1-16383
+  sensor.setTimingBudgetInMs(PowerProfile::instance().get().timingBudgetMs);     // Was 20mSec - now the profile's, see PowerProfile.h
+}
+
+// After a power cycle the sensor holds its defaults - make the zone scheduler program everything again
+static void forgetProgrammedState() {
+  armedRoi = -1;
+  preparedRoi = -1;
+  programmedRoiWidth = 0;
+  programmedRoiHeight = 0;
+  programmedOffset = INT16_MIN;
+  programmedXTalk = -1;
+}
 
 void TofSensor::setup(){
+  PowerProfile::instance().apply();         // Starts in the calibration profile - configureSensor() loads its timing budget
   if(myTofSensor.begin() != 0){
-    Log.info("Sensor error reset in 10 seconds");
-    delay(10000);
-    System.reset();
+    Log.info("Sensor init failed - recovering from loop()");   // SensorHealth works through the bus reset, power cycle and reinit
+    SensorHealth::instance().initFailed();
   }
   else Log.info("Sensor init successfully");
   
-  // Here is where we set the device properties
-  myTofSensor.setDistanceModeLong();
-  myTofSensor.setSigmaThreshold(45);        // Default is 45 - this will make it harder to get a valid result - Range 1 - 16383
-  myTofSensor.setSignalThreshold(1500);     // Default is 1500 raising value makes it harder to get a valid results- Range 1-16383
-  myTofSensor.setTimingBudgetInMs(20);      // Was 20mSec
+  configureSensor(myTofSensor);
+  const ConfigValues &config = ConfigStore::instance().get();
 
-  while (TofSensor::loop() == SENSOR_BUFFRER_NOT_FULL) {delay(10);}; // Wait for the buffer to fill up
-  Log.info("Buffer is full - will now calibrate");
+  opticalCenters[0] = config.frontCenter;   // Placed at installation or set at runtime - FRONT_ZONE_CENTER / BACK_ZONE_CENTER otherwise
+  opticalCenters[1] = config.backCenter;
+  placeLanes();
 
-  if (TofSensor::performCalibration()) Log.info("Calibration Complete");
-  else {
-    Log.info("Initial calibration failed - wait 10 secs and reset");
-    delay(10000);
-    System.reset();
-  }
+  TofSensor::performCalibration();          // Calibration completes in the background as loop() collects a clear window
+  lastVhvAt = millis();                     // begin() ran a VHV search from the current temperature
 
   // myTofSensor.setDistanceModeShort();                     // Once initialized, we are focused on the top half of the door
 
 }
 
 bool TofSensor::performCalibration() {
-  for (int i=1; i<NUM_CALIBRATION_LOOPS; i++) {
-    TofSensor::loop();                  // Get the latest values
-    zoneBaselines[0] += TofSensor::getZone1();
-    zoneBaselines[1] += TofSensor::getZone2();
+  laneBaselinesValid = false;
+
+  // Baselines and calibration survive restarts (PersistentStore) so counting can start provisionally
+  const PersistentState &saved = PersistentStore::instance().state();
+  for (byte zone = 0; zone < 2; zone++) {
+    zoneOffsets[zone] = saved.zoneOffsets[zone];
+    zoneXTalk[zone] = saved.zoneXTalk[zone];
   }
-  zoneBaselines[0] = zoneBaselines[0]/NUM_CALIBRATION_LOOPS;
-  zoneBaselines[1] = zoneBaselines[1]/NUM_CALIBRATION_LOOPS;
+  offsetsValid = saved.offsetsValid;
+  xtalkValid = saved.xtalkValid;
 
-  if (occupancyState != 0){
-    Log.info("Target zone not clear - will wait ten seconds and try again");
-    delay(10000);
-    TofSensor::loop();
-    if (occupancyState != 0) return FALSE;
+  if (saved.baselinesValid) {
+    int baselines[2] = {saved.zoneBaselines[0], saved.zoneBaselines[1]};
+    zoneDecision.reset(baselines);
+    Log.info("Counting provisionally with saved baselines zone1 %ikcps/SPAD and zone2 %ikcps/SPAD", baselines[0], baselines[1]);
   }
-  Log.info("Target zone is clear with zone1 at %ikcps/SPAD and zone2 at %ikcps/SPAD",zoneBaselines[0],zoneBaselines[1]);
-  return TRUE;
+  else zoneDecision.reset(NULL);
+
+  return (zoneDecision.getState() != ZoneDecision::WARMING_UP);
+}
+
+TofSensor::CalibrationState TofSensor::getCalibrationState() {
+  return (CalibrationState)zoneDecision.getState();           // Same order
+}
+
+// Copies baselines and compensation to the persistent store when they change - baselines only once they are real
+static void saveCalibration() {
+  PersistentState &saved = PersistentStore::instance().state();
+  bool changed = (saved.offsetsValid != offsetsValid) || (saved.xtalkValid != xtalkValid);
+
+  for (byte zone = 0; zone < 2; zone++) {
+    changed |= (saved.zoneOffsets[zone] != zoneOffsets[zone]) || (saved.zoneXTalk[zone] != zoneXTalk[zone]);
+    saved.zoneOffsets[zone] = zoneOffsets[zone];
+    saved.zoneXTalk[zone] = zoneXTalk[zone];
+    if (zoneDecision.getState() == ZoneDecision::COMPLETE) {
+      changed |= !saved.baselinesValid || (saved.zoneBaselines[zone] != zoneDecision.getBaseline(zone));
+      saved.zoneBaselines[zone] = zoneDecision.getBaseline(zone);
+    }
+  }
+  saved.offsetsValid = offsetsValid;
+  saved.xtalkValid = xtalkValid;
+  if (zoneDecision.getState() == ZoneDecision::COMPLETE) saved.baselinesValid = true;
+
+  if (changed) PersistentStore::instance().markDirty();
+}
+
+// Decides the frame against the baselines - logs and persists whatever closing a warm-up window did to them
+// degraded - a bit per zone whose sample should not teach the baselines (see ZoneDecision::update())
+static int decideOccupancy(uint8_t degraded) {
+  const ConfigValues &config = ConfigStore::instance().get();
+  const ZoneDecisionParams params = {config.personThreshold, config.calibrationLoops, CALIBRATION_MAX_STDDEV, PowerProfile::instance().get().refineShift, BASELINE_RELEARN_WINDOWS};
+  uint8_t events;
+  int occupancy = zoneDecision.update(zoneSignalPerSpad, params, events, degraded);
+
+  if (events & DECISION_CALIBRATED) EventLog::instance().record(EVENT_CALIBRATION_COMPLETE, zoneDecision.getBaseline(0), zoneDecision.getBaseline(1));
+  if (events & DECISION_RELEARNED) EventLog::instance().record(EVENT_CALIBRATION_RELEARNED, zoneDecision.getBaseline(0), zoneDecision.getBaseline(1));
+  for (byte zone = 0; zone < 2; zone++) {
+    if (events & ((zone == 0) ? DECISION_ZONE1_RELEARNED : DECISION_ZONE2_RELEARNED)) EventLog::instance().record(EVENT_BASELINE_RELEARNED, zone+1, zoneDecision.getBaseline(zone));
+  }
+  if (events & DECISION_WINDOW_CLOSED) saveCalibration();
+  return occupancy;
+}
+
+bool TofSensor::startOffsetCalibration(uint16_t targetMm) {
+  if (calibrationJob.type != JOB_NONE || scanning || placing || targetMm == 0) return false;
+  memset(&calibrationJob, 0, sizeof(calibrationJob));
+  armedRoi = -1;                                          // It was started with the offset the job zeroes
+  preparedRoi = -1;
+  calibrationJob.type = JOB_OFFSET;
+  calibrationJob.targetMm = targetMm;
+  calibrationJob.startedAt = millis();
+  return true;
+}
+
+bool TofSensor::startXTalkCalibration(uint16_t targetMm) {
+  if (calibrationJob.type != JOB_NONE || scanning || placing || targetMm == 0) return false;
+  memset(&calibrationJob, 0, sizeof(calibrationJob));
+  armedRoi = -1;
+  preparedRoi = -1;
+  calibrationJob.type = JOB_XTALK;
+  calibrationJob.targetMm = targetMm;
+  calibrationJob.startedAt = millis();
+  return true;
+}
+
+bool TofSensor::isCalibrationJobRunning() {
+  return (calibrationJob.type != JOB_NONE);
+}
+
+int16_t TofSensor::getZoneOffset(int zone) {
+  return zoneOffsets[zone & 1];
+}
+
+uint16_t TofSensor::getZoneXTalk(int zone) {
+  return zoneXTalk[zone & 1];
+}
+
+// Programs the zone's offset and crosstalk - a job zeroes the quantity it is measuring, as the ST calibration does
+static void applyZoneCompensation(TofSensor::Device &sensor, byte zone) {
+  if (offsetsValid || calibrationJob.type == JOB_OFFSET) {
+    int16_t offset = (calibrationJob.type == JOB_OFFSET) ? 0 : zoneOffsets[zone];
+    if (offset != programmedOffset) {
+      sensor.setOffset(offset);
+      programmedOffset = offset;
+    }
+  }
+  if (xtalkValid || calibrationJob.type == JOB_XTALK) {
+    uint16_t xtalk = (calibrationJob.type == JOB_XTALK) ? 0 : zoneXTalk[zone];
+    if (xtalk != programmedXTalk) {
+      sensor.setXTalk(xtalk);
+      programmedXTalk = xtalk;
+    }
+  }
+}
+
+// Called once per zone measurement while a job runs
+static void accumulateCalibrationJob(TofSensor::Device &sensor, byte zone) {
+  if (calibrationJob.frames[zone] >= CALIBRATION_JOB_FRAMES) return;
+  calibrationJob.distanceSum[zone] += sensor.getDistance();
+  if (calibrationJob.type == JOB_XTALK) {
+    calibrationJob.signalRateSum[zone] += sensor.getSignalRate();
+    calibrationJob.spadSum[zone] += sensor.getSpadNb();
+  }
+  calibrationJob.frames[zone]++;
+}
+
+// Called once per frame - finishes or abandons the job
+static void updateCalibrationJob() {
+  if (calibrationJob.frames[0] < CALIBRATION_JOB_FRAMES || calibrationJob.frames[1] < CALIBRATION_JOB_FRAMES) {
+    if (millis() - calibrationJob.startedAt > CALIBRATION_JOB_TIMEOUT_MS) {
+      EventLog::instance().record(EVENT_CALIBRATION_JOB_TIMEOUT, calibrationJob.type, calibrationJob.frames[0], calibrationJob.frames[1]);
+      calibrationJob.type = JOB_NONE;
+    }
+    return;
+  }
+
+  for (byte zone = 0; zone < 2; zone++) {
+    int32_t averageDistance = calibrationJob.distanceSum[zone] / CALIBRATION_JOB_FRAMES;
+    if (calibrationJob.type == JOB_OFFSET) {
+      zoneOffsets[zone] = (int16_t)constrain((int32_t)calibrationJob.targetMm - averageDistance, (int32_t)-1024, (int32_t)1023);
+    }
+    else {
+      // Same model as VL53L1X_CalibrateXtalk() - the signal that makes the target look closer than it is comes from the cover glass
+      float averageSignalRate = (float)calibrationJob.signalRateSum[zone] / CALIBRATION_JOB_FRAMES;          // kcps
+      float averageSpads = (float)calibrationJob.spadSum[zone] / CALIBRATION_JOB_FRAMES;
+      float xtalk = (averageSpads > 0) ? 1000.0f * averageSignalRate * (1.0f - (float)averageDistance / calibrationJob.targetMm) / averageSpads : 0;
+      zoneXTalk[zone] = (uint16_t)constrain(xtalk, 0.0f, 65535.0f);
+    }
+  }
+
+  if (calibrationJob.type == JOB_OFFSET) {
+    offsetsValid = true;
+    EventLog::instance().record(EVENT_OFFSET_CALIBRATED, zoneOffsets[0], zoneOffsets[1]);
+  }
+  else {
+    xtalkValid = true;
+    EventLog::instance().record(EVENT_XTALK_CALIBRATED, zoneXTalk[0], zoneXTalk[1]);
+  }
+  calibrationJob.type = JOB_NONE;
+  saveCalibration();
+}
+
+const TofSensor::RecalibrationStats &TofSensor::getRecalibrationStats() {
+  return recalibrationStats;
+}
+
+const TofSensor::ValidationStats &TofSensor::getValidationStats() {
+  return validationStats;
+}
+
+// Judges a result by range status, sigma and SPAD count - more effective SPADs than the ROI has is not a real result
+static SampleVerdict classifySample(const vl53l1x::Results &results, uint16_t roiSpads) {
+  if (results.rangeStatus == RANGE_STATUS_HARDWARE_FAIL || results.spads > roiSpads || results.sigma > SAMPLE_MAX_SIGMA_MM) return SAMPLE_INVALID;
+  return (results.rangeStatus == 0) ? SAMPLE_VALID : SAMPLE_DEGRADED;
+}
+
+// Worth measuring again - invalid, or degraded and about to change the zone's state (a lone bad sample is a spurious transition)
+static bool needsRemeasure(SampleVerdict verdict, const vl53l1x::Results &results, byte zone, int oldOccupancy) {
+  if (verdict == SAMPLE_INVALID) return true;
+  if (verdict == SAMPLE_VALID || zoneDecision.getState() == ZoneDecision::WARMING_UP) return false;
+  bool occupied = abs((int)results.signalPerSpad - zoneDecision.getBaseline(zone)) >= ConfigStore::instance().get().personThreshold;
+  return occupied != (bool)(oldOccupancy & (1 << zone));
+}
+
+// Returns the reason a temperature update is due (0 if it is not)
+static int vhvDue() {
+  if (millis() - lastVhvAt > VHV_RECAL_INTERVAL_MS) return 1;
+  if (zoneDecision.getState() != ZoneDecision::COMPLETE) return 0;    // Drift is only meaningful against a real baseline
+  if (!baselinesAtLastVhv[0] && !baselinesAtLastVhv[1]) {            // First real baselines since boot - measure drift from here
+    baselinesAtLastVhv[0] = zoneDecision.getBaseline(0);
+    baselinesAtLastVhv[1] = zoneDecision.getBaseline(1);
+    return 0;
+  }
+  for (byte zone = 0; zone < 2; zone++) {
+    if (abs(zoneDecision.getBaseline(zone) - baselinesAtLastVhv[zone]) > VHV_DRIFT_THRESHOLD) return 2;
+  }
+  return 0;
+}
+
+static void finishVhv(TofSensor::Device &sensor, bool timedOut) {
+  sensor.endTemperatureUpdate();
+  vhvRunning = false;
+  lastVhvAt = millis();
+  baselinesAtLastVhv[0] = zoneDecision.getBaseline(0);
+  baselinesAtLastVhv[1] = zoneDecision.getBaseline(1);
+  idleFrames = 0;
+
+  uint32_t pause = lastVhvAt - vhvStartedAt;
+  recalibrationStats.count++;
+  if (timedOut) recalibrationStats.timeouts++;
+  recalibrationStats.lastPauseMs = pause;
+  if (pause > recalibrationStats.maxPauseMs) recalibrationStats.maxPauseMs = pause;
+  recalibrationStats.totalPauseMs += pause;
+  EventLog::instance().record(EVENT_VHV_RECALIBRATED, vhvReason, pause, timedOut);
+}
+
+// Programs an ROI and its zone's compensation - the size is only rewritten when it changes
+// The sensor takes its settings when ranging starts, so this may be written while another ROI integrates
+static void programRoi(TofSensor::Device &sensor, byte zone, uint8_t width, uint8_t height, uint8_t center) {
+  if (width != programmedRoiWidth || height != programmedRoiHeight) {
+    sensor.setROI(width, height, center);
+    programmedRoiWidth = width;
+    programmedRoiHeight = height;
+  }
+  else sensor.setROICenter(center);
+  applyZoneCompensation(sensor, zone);
+}
+
+// Waits for the measurement started at startedRanging - on a timeout the sensor is stopped rather than left on this ROI
+static int waitForRoi(TofSensor::Device &sensor, byte zone, unsigned long startedRanging, uint32_t busErrors) {
+  unsigned long timeout = ConfigStore::instance().get().sensorTimeoutMs;
+  bool yield = PowerProfile::instance().get().yieldWhileWaiting;
+  while(!sensor.checkForDataReady()) {
+    if (yield) delay(1);                        // Lets the system thread (and the processor's idle) have the wait
+    if (millis() - startedRanging > timeout) {
+      EventLog::instance().record(EVENT_SENSOR_TIMEOUT);
+      sensor.stopRanging();
+      sensor.clearInterrupt();
+      armedRoi = -1;
+      SensorHealth::instance().measured(zone, NULL, sensor.getBusErrors() != busErrors);
+      return SENSOR_TIMEOUT_ERROR;
+    }
+  }
+  return RESULT_OK;
+}
+
+// Reads the result in one burst - still valid while the next ROI integrates, the sensor only replaces it when that is ready
+// Every measurement is reported to SensorHealth; a fault returns an error and the result must not be used
+static int readRoi(TofSensor::Device &sensor, byte zone, vl53l1x::Results &results, uint32_t busErrors) {
+  bool read = sensor.readResults(results);
+  if (SensorHealth::instance().measured(zone, read ? &results : NULL, !read || sensor.getBusErrors() != busErrors) != FAULT_NONE) return SENSOR_FAULT_ERROR;
+
+  #if DEBUG_COUNTER
+  Log.info("Zone%d (%d SPADs) = %ikcps/SPAD. Ambient/SPAD: %d", zone + 1, results.spads, results.signalPerSpad, results.ambientPerSpad);
+  #endif
+  if (calibrationJob.type != JOB_NONE) accumulateCalibrationJob(sensor, zone);
+  return RESULT_OK;
+}
+
+// Ranges once on an ROI and waits for it - for the depth scan and zone placement, which move about the array
+static int measureRoi(TofSensor::Device &sensor, byte zone, uint8_t width, uint8_t height, uint8_t center, vl53l1x::Results &results) {
+  uint32_t busErrors = sensor.getBusErrors();
+  armedRoi = -1;
+  preparedRoi = -1;
+  sensor.stopRanging();
+  programRoi(sensor, zone, width, height, center);
+  sensor.clearInterruptAndStartRanging();
+  int status = waitForRoi(sensor, zone, millis(), busErrors);
+  if (status != RESULT_OK) return status;
+  return readRoi(sensor, zone, results, busErrors);
+}
+
+// Programs the frame ROI at index (zone major, lane minor with LATERAL_SPLIT)
+static void programFrameRoi(TofSensor::Device &sensor, int8_t index) {
+  const ConfigValues &config = ConfigStore::instance().get();
+  #if LATERAL_SPLIT
+  programRoi(sensor, index / 2, config.zoneWidth, config.zoneHeight / 2, laneCenters[index / 2][index % 2]);
+  #else
+  programRoi(sensor, index, config.zoneWidth, config.zoneHeight, opticalCenters[index]);
+  #endif
+}
+
+// Starts the frame ROI at index, then programs the one after it while this one integrates - between two measurements the
+// sensor only waits for a stop and a combined clear and start
+static void armFrameRoi(TofSensor::Device &sensor, int8_t index) {
+  sensor.stopRanging();
+  if (preparedRoi != index) programFrameRoi(sensor, index);
+  sensor.clearInterruptAndStartRanging();
+  armedRoi = index;
+  armedAt = millis();
+
+  preparedRoi = (index + 1) % FRAME_ROIS;
+  programFrameRoi(sensor, preparedRoi);
+}
+
+#if LATERAL_SPLIT
+static uint16_t laneStuckFrames[2][2] = {{0, 0}, {0, 0}};    // Frames a lane has disagreed with its baseline while its zone was clear
+
+// Lane occupancy against per-lane baselines - learned (and refined) only while the whole zone is clear
+// A lane that disagrees with its baseline for a long stretch while its zone is clear has a stale baseline and is re-learned
+static void updateLanes() {
+  const ConfigValues &config = ConfigStore::instance().get();
+  for (byte zone = 0; zone < 2; zone++) {
+    bool zoneClear = !(occupancyState & (1 << zone));
+    for (byte lane = 0; lane < 2; lane++) {
+      int signal = laneSignalPerSpad[zone][lane];
+      if (!laneBaselinesValid) {
+        if (!zoneClear) continue;
+        laneBaselines[zone][lane] = signal;
+        continue;
+      }
+      bool laneClear = abs(signal - laneBaselines[zone][lane]) < config.personThreshold;
+      if (zoneClear && laneClear) {
+        laneBaselines[zone][lane] += (signal - laneBaselines[zone][lane]) / (1 << PowerProfile::instance().get().refineShift);
+        laneStuckFrames[zone][lane] = 0;
+      }
+      else if (zoneClear && ++laneStuckFrames[zone][lane] >= BASELINE_RELEARN_WINDOWS * config.calibrationLoops) {
+        laneBaselines[zone][lane] = signal;
+        laneStuckFrames[zone][lane] = 0;
+      }
+    }
+  }
+  if (!laneBaselinesValid) {
+    laneBaselinesValid = (occupancyState == 0);            // Both zones were clear, so all four lanes have a baseline
+    return;
+  }
+
+  for (byte lane = 0; lane < 2; lane++) {
+    laneStates[lane] = 0;
+    for (byte zone = 0; zone < 2; zone++) {
+      if (abs(laneSignalPerSpad[zone][lane] - laneBaselines[zone][lane]) >= config.personThreshold) laneStates[lane] |= (1 << zone);
+    }
+  }
+}
+#endif
+
+// A 4x4 ROI centered on a tile - stride 4 for a 4x4 image, 2 (overlapping) for 8x8, kept inside the array
+static uint8_t tileCenter(uint8_t size, int row, int column) {
+  int stride = 16 / size;
+  return spadCenter(constrain(row * stride + stride / 2 - 1, 1, 13), constrain(column * stride + stride / 2, 2, 14));
+}
+
+// Ranges the next tile - a changed tile every other step if there are any, otherwise the round-robin
+static int scanTile(TofSensor::Device &sensor) {
+  uint8_t tiles = depthImage.size * depthImage.size;
+  uint8_t tile;
+  bool sweepDone = false;
+
+  scanPickChanged = !scanPickChanged;
+  if (scanPickChanged && scanChanged) {
+    tile = 0;
+    while (!(scanChanged & (1ULL << tile))) tile++;
+  }
+  else {
+    tile = scanCursor;
+    if (++scanCursor >= tiles) {
+      scanCursor = 0;
+      sweepDone = true;
+    }
+  }
+  scanChanged &= ~(1ULL << tile);
+
+  int row = tile / depthImage.size;
+  int column = tile % depthImage.size;
+  vl53l1x::Results results;
+  int status = measureRoi(sensor, 0, 4, 4, tileCenter(depthImage.size, row, column), results);
+  if (status != RESULT_OK) return status;
+
+  bool changed = (results.rangeStatus != depthImage.status[row][column]) || (abs((int)results.distance - (int)depthImage.distance[row][column]) > SCAN_CHANGE_MM);
+  depthImage.distance[row][column] = results.distance;
+  depthImage.signal[row][column] = results.signalPerSpad;
+  depthImage.status[row][column] = results.rangeStatus;
+
+  if (changed && depthImage.sweeps > 0) {                 // Whatever moved is probably still moving - look at it and around it next
+    scanChanged |= 1ULL << tile;
+    if (row > 0) scanChanged |= 1ULL << (tile - depthImage.size);
+    if (row < depthImage.size - 1) scanChanged |= 1ULL << (tile + depthImage.size);
+    if (column > 0) scanChanged |= 1ULL << (tile - 1);
+    if (column < depthImage.size - 1) scanChanged |= 1ULL << (tile + 1);
+  }
+
+  if (sweepDone) {
+    depthImage.sweeps++;
+    EventLog::instance().record(EVENT_DEPTH_SCAN_SWEEP, depthImage.sweeps, __builtin_popcountll(TofSensor::instance().getObstructionMask()));
+  }
+  return 0;
+}
+
+// Ranges SCAN_TILES_PER_LOOP tiles - stops at the first one that fails
+static int scanStep(TofSensor::Device &sensor) {
+  for (uint8_t i = 0; i < SCAN_TILES_PER_LOOP; i++) {
+    int status = scanTile(sensor);
+    if (status != 0) return status;
+  }
+  return 0;
+}
+
+// Ranges every candidate ROI once - near zones first so each pair is measured close together
+static int placementStep(TofSensor::Device &sensor) {
+  uint16_t signals[ZONE_PLACEMENT_ROIS];
+  unsigned long timestamps[ZONE_PLACEMENT_ROIS];
+
+  for (uint8_t i = 0; i < ZONE_PLACEMENT_ROIS; i++) {
+    uint8_t width, center;
+    vl53l1x::Results results;
+    ZonePlacement::instance().getRoi(i, width, center);
+    int status = measureRoi(sensor, (i < ZONE_PLACEMENT_PAIRS) ? 0 : 1, width, ConfigStore::instance().get().zoneHeight, center, results);
+    if (status != RESULT_OK) return status;
+    signals[i] = results.signalPerSpad;
+    timestamps[i] = millis();
+  }
+
+  if (ZonePlacement::instance().addFrame(signals, timestamps)) {
+    placing = false;
+    const ZonePlacement::Result &result = ZonePlacement::instance().getResult();
+    if (result.valid) TofSensor::instance().setZoneLayout(result.front, result.back, result.width);
+  }
+  return 0;
+}
+
+// Reacts to settings ConfigStore has just made live - we are between frames so nothing is half measured
+static void applyConfig(TofSensor::Device &sensor, uint32_t changes) {
+  const ConfigValues &config = ConfigStore::instance().get();
+
+  armedRoi = -1;                                // Whatever is integrating or prepared may use the old settings
+  preparedRoi = -1;
+  if (PowerProfile::instance().apply()) changes |= CONFIG_CHANGED_TIMING;       // A profile set by hand or a new budget under it
+  if (changes & CONFIG_CHANGED_TIMING) {
+    sensor.stopRanging();
+    sensor.setTimingBudgetInMs(PowerProfile::instance().get().timingBudgetMs);
+  }
+  if (changes & CONFIG_CHANGED_LAYOUT) {
+    opticalCenters[0] = config.frontCenter;
+    opticalCenters[1] = config.backCenter;
+    placeLanes();
+    SignatureMask::instance().clear();                             // Learned for the old position too
+    PersistentStore::instance().state().baselinesValid = false;    // Saved baselines were for the old position
+    PersistentStore::instance().markDirty();
+  }
+  if (changes & (CONFIG_CHANGED_LAYOUT | CONFIG_CHANGED_CALIBRATION)) TofSensor::instance().performCalibration();
+}
+
+// Tells PowerProfile how the frame went and loads the timing of a new profile before the next one
+static void endFrame(TofSensor::Device &sensor, int decidedState) {
+  PowerProfile::instance().frame(decidedState, zoneDecision.getState() == ZoneDecision::WARMING_UP);
+  if (!PowerProfile::instance().apply()) return;
+  sensor.stopRanging();                         // Whatever is integrating was started with the old budget
+  armedRoi = -1;
+  sensor.setTimingBudgetInMs(PowerProfile::instance().get().timingBudgetMs);
+}
+
+// What is left of a recovery step that started at startedAt - every wait in the step shares HEALTH_STEP_TIMEOUT_MS
+static uint16_t stepTimeLeft(unsigned long startedAt) {
+  unsigned long elapsed = millis() - startedAt;
+  return (elapsed < HEALTH_STEP_TIMEOUT_MS) ? (uint16_t)(HEALTH_STEP_TIMEOUT_MS - elapsed) : 0;
+}
+
+// Waits for the sensor to finish booting after XSHUT - within the step's deadline
+static bool waitForBoot(TofSensor::Device &sensor, unsigned long startedAt) {
+  while (!sensor.checkBootState()) {
+    if (!stepTimeLeft(startedAt)) return false;
+    delay(1);
+  }
+  return true;
+}
+
+// Runs one recovery step - true if the sensor answers on the bus afterwards
+static bool recoverSensor(TofSensor::Device &sensor, RecoveryStep step) {
+  uint32_t busErrors = sensor.getBusErrors();
+  unsigned long startedAt = millis();
+  bool ok = true;
+
+  switch (step) {
+    case RECOVERY_CLEAR_INTERRUPT:
+      sensor.stopRanging();
+      sensor.clearInterrupt();
+      break;
+    case RECOVERY_RESTART_RANGING: {
+      sensor.stopRanging();
+      sensor.clearInterrupt();
+      sensor.startRanging();
+      while (!sensor.checkForDataReady()) {
+        if (!stepTimeLeft(startedAt)) {
+          ok = false;
+          break;
+        }
+        delay(1);                                 // The bus may be what is in trouble - do not flood it
+      }
+      sensor.clearInterrupt();
+      sensor.stopRanging();
+      break;
+    }
+    case RECOVERY_BUS_RESET:
+      sensor.resetBus();
+      break;
+    case RECOVERY_POWER_CYCLE:                    // Baselines and compensation are kept - only the sensor's registers are lost
+      sensor.resetBus();
+      ok = sensor.powerCycle(TOF_SENSOR_SHUTDOWN_HOLD_MS) && waitForBoot(sensor, startedAt);
+      busErrors = sensor.getBusErrors();          // The sensor does not answer while it boots
+      ok = ok && stepTimeLeft(startedAt) && sensor.sensorInit(stepTimeLeft(startedAt)) == 0;
+      if (ok) configureSensor(sensor);
+      break;
+    case RECOVERY_REINIT:                         // What setup() does - the scene may have changed while we were blind
+      sensor.resetBus();
+      ok = sensor.powerCycle(TOF_SENSOR_SHUTDOWN_HOLD_MS) && waitForBoot(sensor, startedAt);
+      busErrors = sensor.getBusErrors();
+      ok = ok && stepTimeLeft(startedAt) && sensor.begin(stepTimeLeft(startedAt)) == 0;
+      if (ok) {
+        configureSensor(sensor);
+        TofSensor::instance().performCalibration();
+        lastVhvAt = millis();
+      }
+      break;
+    default:
+      break;
+  }
+
+  forgetProgrammedState();
+  return ok && sensor.getSensorID() == 0xEACC && sensor.getBusErrors() == busErrors;
 }
 
 int TofSensor::loop(){                         // This function will update the current distance / occupancy for each zone.  It will return true if occupancy changes                    
+  if (vhvRunning) {                             // A temperature update is in progress - counting is paused until it completes
+    if (myTofSensor.checkForDataReady()) finishVhv(myTofSensor, false);
+    else if (millis() - vhvStartedAt > VHV_TIMEOUT_MS) finishVhv(myTofSensor, true);
+    return 0;
+  }
+  RecoveryStep step = SensorHealth::instance().due();
+  if (step != RECOVERY_NONE) {                  // One step per call - the rest of the application keeps running in between
+    unsigned long startedAt = millis();
+    bool ok = recoverSensor(myTofSensor, step);
+    SensorHealth::instance().stepDone(step, ok, millis() - startedAt);
+    return SENSOR_RECOVERING;
+  }
+  if (SensorHealth::instance().isSuspended()) return SENSOR_RECOVERING;
+  if (ConfigStore::instance().isPending()) {    // Settings only change here, between frames
+    uint32_t changes = ConfigStore::instance().apply();
+    if (changes) applyConfig(myTofSensor, changes);
+  }
+  if (scanning) return scanStep(myTofSensor);
+  if (placing) return placementStep(myTofSensor);
+  if (idleFrames >= VHV_IDLE_FRAMES && calibrationJob.type == JOB_NONE && (vhvReason = vhvDue())) {
+    myTofSensor.stopRanging();
+    myTofSensor.clearInterrupt();
+    armedRoi = -1;                              // Ranging stopped - the prepared ROI is still programmed
+    myTofSensor.beginTemperatureUpdate();
+    vhvStartedAt = millis();
+    vhvRunning = true;
+    return 0;
+  }
+
+  const ConfigValues &config = ConfigStore::instance().get();
+  const ProfileValues &profile = PowerProfile::instance().get();
+  if (profile.framePeriodMs && armedRoi != 0 && millis() - frameStartedAt < profile.framePeriodMs) return 0;     // Resting between frames - the sensor is stopped
+
   int oldOccupancyState = occupancyState;
   occupancyState = 0;
 
-  unsigned long startedRanging;
+  // Zone 1 normally started integrating when the last frame's final result was ready - start it now if not, or if that
+  // result has been waiting so long it no longer describes the same moment as the rest of this frame
+  if (armedRoi != 0 || millis() - armedAt > (unsigned long)profile.timingBudgetMs + ZONE_RESULT_MAX_AGE_MS) armFrameRoi(myTofSensor, 0);
+  frameStartedAt = armedAt;
 
-  for (byte zone = 0; zone < 2; zone++){
-    myTofSensor.stopRanging();
-    myTofSensor.clearInterrupt();
-    myTofSensor.setROI(ROWS_OF_SPADS,COLUMNS_OF_SPADS,opticalCenters[zone]);
-    delay(1);
-    myTofSensor.startRanging();
+  uint16_t roiSpads = config.zoneWidth * (LATERAL_SPLIT ? config.zoneHeight / 2 : config.zoneHeight);
+  uint8_t degraded = 0;
+  for (int8_t roi = 0; roi < FRAME_ROIS; roi++) {
+    byte zone = roi / (FRAME_ROIS / 2);
+    vl53l1x::Results results;
+    SampleVerdict verdict;
 
-    startedRanging = millis();
-    while(!myTofSensor.checkForDataReady()) {
-      if (millis() - startedRanging > SENSOR_TIMEOUT) {
-        Log.info("Sensor Timed out");
-        return SENSOR_TIMEOUT_ERROR;
+    for (uint8_t attempt = 0; ; attempt++) {
+      uint32_t busErrors = myTofSensor.getBusErrors();
+      int status = waitForRoi(myTofSensor, zone, armedAt, busErrors);
+      if (status == RESULT_OK) {
+        zoneTimestamps[zone] = millis();
+        bool rest = (roi == FRAME_ROIS - 1) && profile.framePeriodMs;   // Periodic frames leave the sensor stopped until the next one
+        if (!rest) armFrameRoi(myTofSensor, (roi + 1) % FRAME_ROIS);    // The next ROI integrates while this result is read and decided
+        status = readRoi(myTofSensor, zone, results, busErrors);
+        if (rest) {
+          myTofSensor.stopRanging();
+          armedRoi = -1;
+        }
+      }
+      if (status != RESULT_OK) {
+        occupancyState = oldOccupancyState;
+        return status;
       }
+      verdict = classifySample(results, roiSpads);
+      if (attempt >= SAMPLE_REMEASURE_LIMIT || !needsRemeasure(verdict, results, zone, oldOccupancyState)) break;
+      validationStats.remeasured[zone]++;
+      armFrameRoi(myTofSensor, roi);                       // Measure this ROI again instead
     }
 
-    #if DEBUG_COUNTER
-    Log.info("Zone%d (%dx%d %d SPADs with optical center %d) = %ikcps/SPAD. Signal/SPAD: %d Ambient/SPAD: %d",zo/
+    if (verdict == SAMPLE_VALID) validationStats.valid[zone]++;
+    else {
+      degraded |= 1 << zone;                               // A held signal must not look like a steady scene either
+      if (verdict == SAMPLE_DEGRADED) validationStats.degraded[zone]++;
+      else validationStats.dropped[zone]++;
+    }
+
+    #if LATERAL_SPLIT
+    if (verdict != SAMPLE_INVALID) laneSignalPerSpad[zone][roi % 2] = results.signalPerSpad;
+    if (roi % 2) zoneSignalPerSpad[zone] = (laneSignalPerSpad[zone][0] + laneSignalPerSpad[zone][1]) / 2;
+    #else
+    if (verdict != SAMPLE_INVALID) zoneSignalPerSpad[zone] = results.signalPerSpad; // - getAmbientPerSpad()??
     #endif
+  }
+
+  if (frameTimestamp) frameInterval = zoneTimestamps[1] - frameTimestamp;
+  frameTimestamp = zoneTimestamps[1];
+
+  if (calibrationJob.type != JOB_NONE) updateCalibrationJob();
+
+  if (zoneDecision.getState() == ZoneDecision::WARMING_UP) {  // No baselines to compare against yet - just fill the warm-up buffer
+    decideOccupancy(degraded);
+    endFrame(myTofSensor, 0);
+    return (zoneDecision.getState() == ZoneDecision::WARMING_UP) ? SENSOR_BUFFRER_NOT_FULL : 0;
+  }
 
-    zoneSignalPerSpad[zone] = myTofSensor.getSignalPerSpad(); // - getAmbientPerSpad()??
+  occupancyState = decideOccupancy(degraded);
+  int decidedState = occupancyState;
+
+  #if LATERAL_SPLIT
+  int oldLaneStates = laneStates[0] | laneStates[1] << 2;
+  updateLanes();
+  #endif
+
+  // A recurring non-person signature (a door swinging through a zone) is reported as clear - the baselines and idle count still see it
+  int deviation[2] = {zoneSignalPerSpad[0] - zoneDecision.getBaseline(0), zoneSignalPerSpad[1] - zoneDecision.getBaseline(1)};
+  if (SignatureMask::instance().frame(deviation, decidedState)) {
+    occupancyState = 0;
+    laneStates[0] = laneStates[1] = 0;
   }
 
-  occupancyState += (zoneSignalPerSpad[0] >= (zoneBaselines[0] + PERSON_THRESHOLD) || (zoneSignalPerSpad[0] <= (zoneBaselines[0] - (PERSON_THRESHOLD)))) ? 0 : 1;
-  occupancyState += (zoneSignalPerSpad[1] >= (zoneBaselines[1] + PERSON_THRESHOLD) || (zoneSignalPerSpad[1] <= (zoneBaselines[1] - (PERSON_THRESHOLD)))) ? 0 : 2;
+  #if LATERAL_SPLIT
+  bool lanesChanged = (oldLaneStates != (laneStates[0] | laneStates[1] << 2));
+  #else
+  bool lanesChanged = false;
+  #endif
+
+  if (decidedState == 0) {
+    if (idleFrames < VHV_IDLE_FRAMES) idleFrames++;
+  }
+  else idleFrames = 0;
+  endFrame(myTofSensor, decidedState);
 
   #if PEOPLECOUNTER_DEBUG
-  if (occupancyState != oldOccupancyState) Log.info("Occupancy state changed from %d to %d (%ikcps/SPAD / %ikcps/SPAD)", oldOccupancyState, occupancyState, zoneSignalPerSpad[0], zoneSignalPerSpad[1]);
+  if (occupancyState != oldOccupancyState) EventLog::instance().record(EVENT_OCCUPANCY_STATE, oldOccupancyState, occupancyState, zoneSignalPerSpad[0], zoneSignalPerSpad[1]);
   #endif
 
-  return (occupancyState != oldOccupancyState);     // Let us know if the occupancy state has progressed in the algorithm.
+  return (occupancyState != oldOccupancyState) || lanesChanged;     // Let us know if the occupancy state has progressed in the algorithm.
 }
 
 int TofSensor::getZone1() {
@@ -129,9 +842,173 @@ int TofSensor::getZone2() {
   return zoneSignalPerSpad[1];
 }
 
+int TofSensor::getZoneBaseline(int zone) {
+  return zoneDecision.getBaseline(zone);
+}
+
 int TofSensor::getOccupancyState() {
   return occupancyState;
 }
 
+unsigned long TofSensor::getFrameTimestamp() {
+  return frameTimestamp;
+}
+
+unsigned long TofSensor::getZoneTimestamp(int zone) {
+  return zoneTimestamps[zone & 1];
+}
+
+unsigned long TofSensor::getFrameInterval() {
+  return frameInterval;
+}
+
+unsigned long TofSensor::getNextResultAt() {
+  if (vhvRunning || scanning || placing) return 0;
+  const ProfileValues &profile = PowerProfile::instance().get();
+  if (armedRoi == 0) return armedAt + profile.timingBudgetMs;
+  if (profile.framePeriodMs) return frameStartedAt + profile.framePeriodMs;   // Resting until the next periodic frame
+  return 0;
+}
+
+int TofSensor::getLaneState(int lane) {
+  return laneStates[lane & 1];
+}
+
+int TofSensor::getLaneDeviation(int zone, int lane) {
+  return abs(laneSignalPerSpad[zone & 1][lane & 1] - laneBaselines[zone & 1][lane & 1]);
+}
+
+bool TofSensor::startDepthScan(uint8_t size) {
+  if ((size != 4 && size != 8) || calibrationJob.type != JOB_NONE || placing) return false;
+  memset(&depthImage, 0, sizeof(depthImage));
+  depthImage.size = size;
+  scanCursor = 0;
+  scanChanged = 0;
+  scanPickChanged = false;
+  scanning = true;
+  return true;
+}
+
+void TofSensor::stopDepthScan() {
+  scanning = false;
+}
+
+bool TofSensor::isDepthScanning() {
+  return scanning;
+}
+
+const TofSensor::DepthImage &TofSensor::getDepthImage() {
+  return depthImage;
+}
+
+uint64_t TofSensor::getObstructionMask() {
+  uint16_t valid[64];
+  uint8_t count = 0;
+  uint64_t mask = 0;
+  if (depthImage.sweeps == 0) return 0;
+
+  for (uint8_t row = 0; row < depthImage.size; row++) {           // Insertion sort of the valid ranges for the median - 64 at most
+    for (uint8_t column = 0; column < depthImage.size; column++) {
+      if (depthImage.status[row][column] != 0) continue;
+      uint16_t distance = depthImage.distance[row][column];
+      uint8_t i = count++;
+      for (; i > 0 && valid[i - 1] > distance; i--) valid[i] = valid[i - 1];
+      valid[i] = distance;
+    }
+  }
+  if (count == 0) return 0;
+
+  uint32_t limit = (uint32_t)valid[count / 2] * (100 - SCAN_OBSTRUCTION_PERCENT) / 100;
+  for (uint8_t row = 0; row < depthImage.size; row++) {
+    for (uint8_t column = 0; column < depthImage.size; column++) {
+      if (depthImage.status[row][column] == 0 && depthImage.distance[row][column] < limit) mask |= 1ULL << (row * depthImage.size + column);
+    }
+  }
+  return mask;
+}
+
+// True if the ROI (width SPADs through the door, height across it) around center touches an obstructed tile
+static bool roiIsObstructed(uint8_t center, int width, int height, uint64_t obstructions) {
+  int row, column;
+  spadPosition(center, row, column);
+  int top = row - (height / 2 - 1), left = column - width / 2;           // The center is right of and above the true center
+  int stride = 16 / depthImage.size;
+
+  for (uint8_t tileRow = 0; tileRow < depthImage.size; tileRow++) {
+    for (uint8_t tileColumn = 0; tileColumn < depthImage.size; tileColumn++) {
+      if (!(obstructions & (1ULL << (tileRow * depthImage.size + tileColumn)))) continue;
+      int tileTop = constrain(tileRow * stride + stride / 2 - 1, 1, 13) - 1;
+      int tileLeft = constrain(tileColumn * stride + stride / 2, 2, 14) - 2;
+      if (tileTop < top + height && top < tileTop + 4 && tileLeft < left + width && left < tileLeft + 4) return true;
+    }
+  }
+  return false;
+}
+
+bool TofSensor::suggestZoneCenters(uint8_t &front, uint8_t &back) {
+  if (depthImage.sweeps == 0) return false;
+  uint64_t obstructions = getObstructionMask();
+  int row, column;
+  spadPosition(opticalCenters[0], row, column);                  // Keep the zones on the current row band across the door
+
+  const ConfigValues &config = ConfigStore::instance().get();
+  for (int near = config.zoneWidth / 2; 16 - near - near >= config.zoneWidth; near++) {   // Widest pair first - non-overlapping ROIs
+    uint8_t candidateFront = spadCenter(row, near);
+    uint8_t candidateBack = spadCenter(row, 16 - near);
+    if (roiIsObstructed(candidateFront, config.zoneWidth, config.zoneHeight, obstructions)) continue;
+    if (roiIsObstructed(candidateBack, config.zoneWidth, config.zoneHeight, obstructions)) continue;
+    front = candidateFront;
+    back = candidateBack;
+    return true;
+  }
+  return false;
+}
+
+bool TofSensor::setZoneCenters(uint8_t front, uint8_t back) {
+  return setZoneLayout(front, back, ConfigStore::instance().get().zoneWidth);
+}
+
+// Staged through ConfigStore so the layout changes between frames and is persisted with the other settings
+// All three in one call - ConfigStore checks the layout as a whole, and a half moved layout could overlap
+bool TofSensor::setZoneLayout(uint8_t front, uint8_t back, uint8_t width) {
+  char assignments[64];
+  snprintf(assignments, sizeof(assignments), "frontCenter=%u,backCenter=%u,zoneWidth=%u", front, back, width);
+  return ConfigStore::instance().set(assignments) == 0;
+}
+
+bool TofSensor::startZonePlacement() {
+  if (calibrationJob.type != JOB_NONE || scanning) return false;
+  int row, column;
+  spadPosition(opticalCenters[0], row, column);                  // Candidates stay on the current row band across the door
+  ZonePlacement::instance().start(row);
+  placing = true;
+  return true;
+}
+
+bool TofSensor::isZonePlacementRunning() {
+  return placing;
+}
+
+void TofSensor::logDepthImage() {
+  char line[8 * 6 + 1];
+  uint64_t obstructions = getObstructionMask();
+
+  Log.info("Depth image %dx%d after %lu sweeps (mm, * obstruction, - no target)", depthImage.size, depthImage.size, (unsigned long)depthImage.sweeps);
+  for (uint8_t row = 0; row < depthImage.size; row++) {
+    int used = 0;
+    for (uint8_t column = 0; column < depthImage.size; column++) {
+      if (depthImage.status[row][column] != 0) used += snprintf(line + used, sizeof(line) - used, "    - ");
+      else used += snprintf(line + used, sizeof(line) - used, "%5u%c", depthImage.distance[row][column], (obstructions & (1ULL << (row * depthImage.size + column))) ? '*' : ' ');
+    }
+    Log.info("%s", line);
+  }
+}
+
+float TofSensor::getZoneSeparationSpads() {
+  int row[2], column[2];
+  for (byte zone = 0; zone < 2; zone++) spadPosition(opticalCenters[zone], row[zone], column[zone]);
+  return sqrtf((float)((row[1] - row[0]) * (row[1] - row[0]) + (column[1] - column[0]) * (column[1] - column[0])));
+}
+
 
 
@@ -3,15 +3,17 @@
 // Date: May 2023
 // License: GPL3
 // This is the class for the ST Micro VL53L1X Time of Flight Sensor
-// We are using the Sparkfun library which has some shortcomgings
+// We started with the Sparkfun library which has some shortcomgings
 // - It does not implement distance mode medium
 // - It does not give access to the factory calibration of the optical center
+// The sensor is now reached through Vl53l1xDevice, which binds the bus, address and pins at compile time
 
 #ifndef __TOFSENSOR_H
 #define __TOFSENSOR_H
 
 #include "Particle.h"
-#include "SparkFun_VL53L1X.h" //Click here to get the library: http://librarymanager/All#SparkFun_VL53L1X
+#include "TofSensorConfig.h"
+#include "Vl53l1xDevice.h"
 
 /**
  * This class is a singleton; you do not create one as a global, on the stack, or with new.
@@ -24,6 +26,11 @@
  */
 class TofSensor {
 public:
+    /**
+     * @brief The sensor driver - no heap, no virtual dispatch (see TofSensorConfig.h for the binding)
+     */
+    typedef Vl53l1xDevice<TOF_SENSOR_BUS, TOF_SENSOR_I2C_ADDRESS, TOF_SENSOR_SHUTDOWN_PIN, TOF_SENSOR_INTERRUPT_PIN, TOF_SENSOR_SHUTDOWN_LEVEL> Device;
+
     /**
      * @brief Gets the singleton instance of this class, allocating it if necessary
      * 
@@ -41,6 +48,7 @@ public:
     /**
      * @brief Perform application loop operations; call this from global application loop()
      * This function will test for any change in occupancy in zone1 or zone2 and return true or false if there is a change
+     * Negative values are errors (ErrorCodes.h) - SENSOR_RECOVERING while SensorHealth is bringing the sensor back
      * 
      * You typically use TofSensor::instance().update();
      */
@@ -60,6 +68,11 @@ public:
     */
     int getZone2();
 
+    /**
+     * @brief The baseline (empty doorway) signal a zone is compared against, kcps/SPAD
+    */
+    int getZoneBaseline(int zone);
+
     /**
      * @brief Function to return the current occupancy state
      * 
@@ -69,13 +82,186 @@ public:
     int getOccupancyState();
 
     /**
-     * @brief This function is called as part of the startup process to ensure the sensor does not see any obstructions
+     * @brief Frame timing in millis() - the frame is stamped when its last zone completes, each zone when its result is ready
+     * 
+     * getFrameInterval() is the time between the last two frames, which bounds how finely a transition can be timed
+    */
+    unsigned long getFrameTimestamp();
+    unsigned long getZoneTimestamp(int zone);
+    unsigned long getFrameInterval();
+
+    /**
+     * @brief When, in millis(), the next frame's first result will be ready - loop() waits for it if called sooner
+     * 
+     * 0 if nothing of ours is integrating - a recalibration, scan or recovery polls instead, and is not on a cadence.
+     * The main loop's scheduler only starts other work between frames if it will be done by then.
+    */
+    unsigned long getNextResultAt();
+
+    /**
+     * @brief With LATERAL_SPLIT - the occupancy state of one lane (0 left, 1 right) in the same encoding as getOccupancyState()
+    */
+    int getLaneState(int lane);
+
+    /**
+     * @brief With LATERAL_SPLIT - how far a lane's signal is from its baseline in kcps/SPAD (a whole body is about twice half of one)
+    */
+    int getLaneDeviation(int zone, int lane);
+
+    /**
+     * @brief A coarse picture of the doorway from 4x4 SPAD tiles - 4x4 tiles side by side or 8x8 overlapping at a 2 SPAD pitch
+     * 
+     * Indexed [row][column] in the orientation of the optical center table (columns run through the door)
+    */
+    struct DepthImage {
+        uint8_t size;                       // Tiles per side (4 or 8) - 0 if no scan has run
+        uint16_t distance[8][8];            // mm
+        uint16_t signal[8][8];              // kcps/SPAD
+        uint8_t status[8][8];               // Range status - 0 is valid
+        uint32_t sweeps;                    // Completed round-robin passes over the image
+    };
+
+    /**
+     * @brief Starts (or restarts) the depth scan - counting is paused while it runs
+     * 
+     * loop() ranges SCAN_TILES_PER_LOOP tiles per call. Tiles that changed, and their neighbours, are refreshed ahead of
+     * the round-robin so a moving person or a door shows up without waiting for a full sweep.
+     * Returns false if size is not 4 or 8 or a calibration job is running.
+    */
+    bool startDepthScan(uint8_t size);
+    void stopDepthScan();
+    bool isDepthScanning();
+    const DepthImage &getDepthImage();
+
+    /**
+     * @brief Tiles (bit row * size + column) with a valid range at least SCAN_OBSTRUCTION_PERCENT closer than the image median
+    */
+    uint64_t getObstructionMask();
+
+    /**
+     * @brief Picks the widest pair of zone centers, symmetric about the middle of the array, whose ROIs miss every obstruction
+     * 
+     * Needs at least one complete sweep. Returns false (leaving front and back alone) if no pair is clear.
+    */
+    bool suggestZoneCenters(uint8_t &front, uint8_t &back);
+
+    /**
+     * @brief Moves the zones - the baselines belong to the old position so calibration starts again
+     * 
+     * Staged in ConfigStore - it takes effect at the next frame boundary and is persisted with the other settings.
+     * Returns false (nothing moves) if the zones would overlap or run off the SPAD array.
+    */
+    bool setZoneCenters(uint8_t front, uint8_t back);
+    bool setZoneLayout(uint8_t front, uint8_t back, uint8_t width);
+
+    /**
+     * @brief Starts an installation window - counting pauses while loop() ranges the candidate ROIs (see ZonePlacement.h)
+     * 
+     * Walk through the door ZONE_PLACEMENT_PASSES times. The best scoring layout is applied and persisted when it ends.
+     * Returns false if a calibration job or depth scan is running.
+    */
+    bool startZonePlacement();
+    bool isZonePlacementRunning();
+
+    /**
+     * @brief Writes the depth image to the log - one line per row of tiles
+    */
+    void logDepthImage();
+
+    /**
+     * @brief Distance between the two zone centers in SPADs (multiply by SPAD_PITCH_DEGREES for the angle)
+    */
+    float getZoneSeparationSpads();
+
+    /**
+     * @brief Calibration progress - calibration runs in the background as part of loop()
      * 
-     * Protected as this should only be called from the TofSensor setup process.
+     * CALIBRATION_WARMING_UP - no baselines yet, counting is held off (loop() returns SENSOR_BUFFRER_NOT_FULL)
+     * CALIBRATION_PROVISIONAL - counting with the baselines persisted before the last restart while we collect a clean window
+     * CALIBRATION_COMPLETE - baselines come from a clear warm-up window and are refined as clean samples arrive
+    */
+    enum CalibrationState {
+        CALIBRATION_WARMING_UP,
+        CALIBRATION_PROVISIONAL,
+        CALIBRATION_COMPLETE
+    };
+
+    /**
+     * @brief Restarts the warm-up window so the baselines are re-learned from fresh samples
      * 
+     * This does not block - the existing baselines (if any) stay in use until loop() has collected a clear window.
+     * Returns true if counting can continue provisionally in the meantime.
     */
     bool performCalibration();
 
+    /**
+     * @brief Returns the current calibration state (see CalibrationState)
+    */
+    CalibrationState getCalibrationState();
+
+    /**
+     * @brief Bookkeeping for the temperature (VHV) recalibrations scheduled by loop()
+     * 
+     * Counting is paused while an update runs - these record how often and for how long.
+    */
+    struct RecalibrationStats {
+        uint32_t count;                     // Updates performed
+        uint32_t timeouts;                  // Updates abandoned after VHV_TIMEOUT_MS
+        uint32_t lastPauseMs;               // Counting pause for the most recent update
+        uint32_t maxPauseMs;
+        uint32_t totalPauseMs;
+    };
+
+    /**
+     * @brief Returns the temperature recalibration statistics
+    */
+    const RecalibrationStats &getRecalibrationStats();
+
+    /**
+     * @brief How the zone results of counting frames were judged before they reached the occupancy decision
+     *
+     * Degraded results (sigma or signal fail, wrap around...) are decided but kept out of baseline learning. Invalid ones are
+     * measured again and, if still invalid, dropped - the zone keeps its last signal for that frame.
+    */
+    struct ValidationStats {
+        uint32_t valid[2];                  // By zone
+        uint32_t degraded[2];
+        uint32_t dropped[2];
+        uint32_t remeasured[2];             // Extra measurements - invalid, or degraded and would have changed the state
+    };
+
+    /**
+     * @brief Returns the sample validation statistics
+    */
+    const ValidationStats &getValidationStats();
+
+    /**
+     * @brief Starts a per-zone offset calibration against a target targetMm away (ST recommends 100mm, grey 17%)
+     * 
+     * The job runs frame by frame inside loop() - counting continues - and each zone gets its own offset.
+     * Returns false if another calibration job is already running.
+    */
+    bool startOffsetCalibration(uint16_t targetMm);
+
+    /**
+     * @brief Starts a per-zone crosstalk calibration against a target at the inflection distance targetMm
+     * 
+     * Cover glass crosstalk varies across the SPAD array so each zone gets its own value.
+     * Returns false if another calibration job is already running.
+    */
+    bool startXTalkCalibration(uint16_t targetMm);
+
+    /**
+     * @brief Returns true while an offset or crosstalk calibration job is running
+    */
+    bool isCalibrationJobRunning();
+
+    /**
+     * @brief Offset (mm) and crosstalk (cps) applied when ranging on a zone - zone is 0 or 1
+    */
+    int16_t getZoneOffset(int zone);
+    uint16_t getZoneXTalk(int zone);
+
 
 protected:
     /**
@@ -107,7 +293,7 @@ protected:
      */
     static TofSensor *_instance;
 
-    SFEVL53L1X myTofSensor;                 // Only called from this class
+    Device myTofSensor;                     // Only called from this class
 
 };
 #endif  /* __TOFSENSOR_H */
@@ -2,8 +2,72 @@
 #define TOFSENSOR_CONFIG_H
 
 /***   Mounting Parameters   ***/
+// PERSON_THRESHOLD, NUM_CALIBRATION_LOOPS, SENSOR_TIMEOUT, the zone size and centers are defaults - ConfigStore holds the
+// live values and can change them at runtime. NUM_CALIBRATION_LOOPS is also the most a configured warm-up window can be.
 #define PERSON_THRESHOLD 12                        // Readings that are PERSON_THRESHOLD above (or below) the baseline will trigger an occupancy change
-#define NUM_CALIBRATION_LOOPS 20                   // How many samples to take during calibration.
+#define NUM_CALIBRATION_LOOPS 20                   // How many samples to take during calibration (size of the warm-up sample buffer).
+#define CALIBRATION_MAX_STDDEV 4                   // A warm-up window is only "clear" if each zone's signal varies less than this (kcps/SPAD)
+#define BASELINE_REFINE_SHIFT 2                    // Once calibrated, clean windows move the baseline 1/(2^shift) of the way to the new mean
+#define BASELINE_RELEARN_WINDOWS 30                // Stable windows that disagree with the baseline (drift / new static object) needed before we adopt them
+
+
+/***   Temperature (VHV) Recalibration   ***/
+#define VHV_RECAL_INTERVAL_MS (30UL * 60UL * 1000UL)   // Recalibrate at least this often - the driver wants one per 8C of drift
+#define VHV_DRIFT_THRESHOLD 6                      // Or sooner if a baseline has drifted this far (kcps/SPAD) since the last one
+#define VHV_IDLE_FRAMES 10                         // Only slot the update in after this many consecutive frames with both zones clear
+#define VHV_TIMEOUT_MS 100                         // Give up on the update (and resume counting) after this long
+
+
+/***   Offset and Crosstalk Calibration   ***/
+#define CALIBRATION_JOB_FRAMES 50                  // Frames averaged per zone by an offset or crosstalk calibration job
+#define CALIBRATION_JOB_TIMEOUT_MS 10000           // Abandon the job (keeping the previous values) if it has not finished by then
+
+
+/***   Health Monitor (see SensorHealth.h)   ***/
+#define HEALTH_FAULT_LIMIT 3                       // Failed measurements in a row before the next recovery step
+#define HEALTH_STUCK_MEASUREMENTS 200              // Bit-identical results on one ROI this many times in a row - the sensor is frozen
+#define HEALTH_RECOVERED_MEASUREMENTS 20           // Good measurements after a step before the fault is over
+#define HEALTH_STEP_TIMEOUT_MS 200                 // Longest a recovery step may take - the XSHUT hold, boot and first measurement share it
+#define HEALTH_REINIT_RETRY_MS 30000UL             // With every step tried, ranging is suspended and the reinit retried this often
+
+
+/***   Signature Mask (see SignatureMask.h)   ***/
+#define SIGNATURE_FRAMES 24                        // Frames of an episode a signature covers - about a second of frames
+#define SIGNATURE_SLOTS 6                          // Signatures kept at once - candidates and masking templates share the slots
+#define SIGNATURE_SCALE_SHIFT 2                    // Deviations are kept as int8 in steps of 4 kcps/SPAD
+#define SIGNATURE_MIN_FRAMES 3                     // Shorter episodes are not learned
+#define SIGNATURE_CLUSTER_ERROR 4                  // Mean absolute difference (steps) for an episode to join a signature
+#define SIGNATURE_MIN_OCCURRENCES 6                // Episodes a signature needs before it masks
+#define SIGNATURE_MAX_SPREAD 15                    // Mean difference of the episodes joining a signature for it to mask - % of its deviation
+#define SIGNATURE_MIN_SHARE 16                     // ... and at least one in this many of the episodes learned from since it started
+#define SIGNATURE_QUIET_FRAMES 24                  // Clear frames before an episode for it to teach a signature
+#define SIGNATURE_MATCH_FRAMES 6                   // Frames of an episode before a signature can match it - before a door reaches the second zone
+#define SIGNATURE_MATCH_ERROR 4                    // Mean absolute difference (steps) to match - beyond it the mask lets go
+
+
+/***   Power Profiles (see PowerProfile.h)   ***/
+#define PROFILE_ACTIVE_HOLD_MS 20000UL             // High-traffic until nobody has been in a zone for this long
+#define PROFILE_IDLE_MS (5UL * 60UL * 1000UL)      // Low-power after this long without anyone - balanced in between
+#define PROFILE_BALANCED_PERIOD_MS 100             // One frame per period - 10 a second, still two or three per crossing
+#define PROFILE_LOW_POWER_PERIOD_MS 250            // Enough to catch the first frame of someone arriving
+#define PROFILE_CALIBRATION_BUDGET_MS 50           // Quieter samples while the baselines warm up
+
+
+/***   Depth Image Scan (installation / diagnostics)   ***/
+#define SCAN_TILES_PER_LOOP 1                      // 4x4 tiles ranged per call to loop() while scanning - each takes a timing budget
+#define SCAN_CHANGE_MM 100                         // A tile that moved more than this is re-measured (with its neighbours) ahead of the round-robin
+#define SCAN_OBSTRUCTION_PERCENT 30                // A tile this much closer than the median of the image is an obstruction
+
+
+/***   Sensor Binding - resolved at compile time, see Vl53l1xDevice.h   ***/
+#ifndef TOF_SENSOR_BUS
+#define TOF_SENSOR_BUS vl53l1x::ParticleWireBus    // Bus policy - a host build can substitute its own
+#endif
+#define TOF_SENSOR_I2C_ADDRESS 0x29                // 7 bit address (0x52 in ST's 8 bit notation)
+#define TOF_SENSOR_SHUTDOWN_PIN D2                 // XSHUT
+#define TOF_SENSOR_SHUTDOWN_LEVEL HIGH             // Level on XSHUT that shuts the module down - setup() drives the other one to turn it on
+#define TOF_SENSOR_SHUTDOWN_HOLD_MS 5              // How long recovery holds the module in shutdown - comfortably past the datasheet minimum
+#define TOF_SENSOR_INTERRUPT_PIN D3                // GPIO1
 
 
 /***   Debugging   ***/
@@ -13,6 +77,21 @@
 // Detection zone dimensions and optical centers
 #define COLUMNS_OF_SPADS 8                         // This is the width (accross the door with the sensor long axis perpendicular to the threshold) of the active SPADS
 #define ROWS_OF_SPADS    6                         // This is the depth (Through the door - when sensor mounted on the inside doorframe)
+#define SPAD_PITCH_DEGREES (27.0f / 16.0f)         // 27 degree field of view across the 16x16 SPAD array
+
+// Side by side detection - each zone is measured as a left and a right half (COLUMNS_OF_SPADS / 2 wide) so PeopleCounter
+// can follow two people through the door at once. Four ROIs per frame instead of two, so the frame rate roughly halves.
+#ifndef LATERAL_SPLIT                              // A host build can pick the algorithm with -DLATERAL_SPLIT=1
+#define LATERAL_SPLIT 0
+#endif
+
+// Zone pipeline - the next ROI starts ranging as soon as a result is ready, so reading and deciding it hide behind integration
+// A result left waiting longer than this (the application was busy) is measured again - a frame must describe one moment
+#define ZONE_RESULT_MAX_AGE_MS 50
+
+// Sample validation - each zone result is judged by range status, sigma and SPAD count before it reaches the decision
+#define SAMPLE_MAX_SIGMA_MM 1000                   // Beyond this the sensor is reporting noise, whatever the status says
+#define SAMPLE_REMEASURE_LIMIT 1                   // Extra measurements for an invalid result, or a degraded one that would change the state
 
 // Will focus on the SPAD array of 6 rows and 8 columns
 #define FRONT_ZONE_CENTER     159
@@ -0,0 +1,449 @@
+// VL53L1X Device Template
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This is a header-only driver for the ST Micro VL53L1X bound to its bus, address and pins at compile time
+// It implements the subset of the ULD API that TofSensor uses with the same names as the SparkFun SFEVL53L1X class,
+// but with no virtual dispatch and no heap - every register access inlines down to the bus policy
+//
+// A bus policy is any type with these static members (see ParticleWireBus below):
+//   static uint8_t write(uint8_t address7, uint16_t reg, const uint8_t *data, uint8_t count);   // 0 on success
+//   static uint8_t read(uint8_t address7, uint16_t reg, uint8_t *data, uint8_t count);          // 0 on success
+//   static void reset();                                     // Free a bus a slave is holding (only if resetBus() is used)
+
+#ifndef __VL53L1XDEVICE_H
+#define __VL53L1XDEVICE_H
+
+#include "Particle.h"
+
+namespace vl53l1x {
+
+// Register map - same names as vl53l1x_class.h with a REG_ prefix (so both headers can be included together)
+enum Register : uint16_t {
+    REG_I2C_SLAVE__DEVICE_ADDRESS                       = 0x0001,
+    REG_VHV_CONFIG__TIMEOUT_MACROP_LOOP_BOUND           = 0x0008,
+    REG_VHV_CONFIG__INIT                                = 0x000B,
+    REG_ALGO__CROSSTALK_COMPENSATION_PLANE_OFFSET_KCPS  = 0x0016,
+    REG_ALGO__CROSSTALK_COMPENSATION_X_PLANE_GRADIENT   = 0x0018,
+    REG_ALGO__CROSSTALK_COMPENSATION_Y_PLANE_GRADIENT   = 0x001A,
+    REG_ALGO__PART_TO_PART_RANGE_OFFSET_MM              = 0x001E,
+    REG_MM_CONFIG__INNER_OFFSET_MM                      = 0x0020,
+    REG_MM_CONFIG__OUTER_OFFSET_MM                      = 0x0022,
+    REG_DEFAULT_CONFIGURATION_START                     = 0x002D,
+    REG_GPIO_HV_MUX__CTRL                               = 0x0030,
+    REG_GPIO__TIO_HV_STATUS                             = 0x0031,
+    REG_PHASECAL_CONFIG__TIMEOUT_MACROP                 = 0x004B,
+    REG_RANGE_CONFIG__TIMEOUT_MACROP_A_HI               = 0x005E,
+    REG_RANGE_CONFIG__VCSEL_PERIOD_A                    = 0x0060,
+    REG_RANGE_CONFIG__TIMEOUT_MACROP_B_HI               = 0x0061,
+    REG_RANGE_CONFIG__VCSEL_PERIOD_B                    = 0x0063,
+    REG_RANGE_CONFIG__SIGMA_THRESH                      = 0x0064,
+    REG_RANGE_CONFIG__MIN_COUNT_RATE_RTN_LIMIT_MCPS     = 0x0066,
+    REG_RANGE_CONFIG__VALID_PHASE_HIGH                  = 0x0069,
+    REG_SYSTEM__INTERMEASUREMENT_PERIOD                 = 0x006C,
+    REG_SD_CONFIG__WOI_SD0                              = 0x0078,
+    REG_SD_CONFIG__INITIAL_PHASE_SD0                    = 0x007A,
+    REG_ROI_CONFIG__USER_ROI_CENTRE_SPAD                = 0x007F,
+    REG_ROI_CONFIG__USER_ROI_REQUESTED_GLOBAL_XY_SIZE   = 0x0080,
+    REG_SYSTEM__INTERRUPT_CLEAR                         = 0x0086,
+    REG_SYSTEM__MODE_START                              = 0x0087,
+    REG_RESULT__RANGE_STATUS                            = 0x0089,
+    REG_RESULT__DSS_ACTUAL_EFFECTIVE_SPADS_SD0          = 0x008C,
+    REG_RESULT__AMBIENT_COUNT_RATE_MCPS_SD0             = 0x0090,
+    REG_RESULT__SIGMA_SD0                               = 0x0092,
+    REG_RESULT__FINAL_CROSSTALK_CORRECTED_RANGE_MM_SD0  = 0x0096,
+    REG_RESULT__PEAK_SIGNAL_COUNT_RATE_CROSSTALK_CORRECTED_MCPS_SD0 = 0x0098,
+    REG_RESULT__OSC_CALIBRATE_VAL                       = 0x00DE,
+    REG_FIRMWARE__SYSTEM_STATUS                         = 0x00E5,
+    REG_IDENTIFICATION__MODEL_ID                        = 0x010F
+};
+
+// Registers 0x2D to 0x87 as loaded by VL53L1X_SensorInit() - see vl53l1x_class.cpp for the per-register notes
+static const uint8_t defaultConfiguration[] = {
+    0x00, 0x01, 0x01, 0x01, 0x02, 0x00, 0x02, 0x08, 0x00, 0x08, 0x10, 0x01, 0x01, 0x00, 0x00, 0x00,
+    0x00, 0xff, 0x00, 0x0F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x0b, 0x00, 0x00, 0x02, 0x0a, 0x21,
+    0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0xc8, 0x00, 0x00, 0x38, 0xff, 0x01, 0x00, 0x08, 0x00,
+    0x00, 0x01, 0xdb, 0x0f, 0x01, 0xf1, 0x0d, 0x01, 0x68, 0x00, 0x80, 0x08, 0xb8, 0x00, 0x00, 0x00,
+    0x00, 0x0f, 0x89, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0f, 0x0d, 0x0e, 0x0e, 0x00,
+    0x00, 0x02, 0xc7, 0xff, 0x9B, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00
+};
+
+// Raw range status (low 5 bits of RESULT__RANGE_STATUS) to the ULD status codes - 255 is "not a valid status"
+static const uint8_t rangeStatusMap[24] = {
+    255, 255, 255, 5, 2, 4, 1, 7, 3, 0, 255, 255, 9, 13, 255, 255, 255, 255, 10, 6, 255, 255, 11, 12
+};
+
+/**
+ * @brief Everything from one ranging result, read in a single 17 byte burst
+ */
+struct Results {
+    uint8_t rangeStatus;                // ULD range status (0 = valid, 1 = sigma fail, 2 = signal fail, 7 = wrap around ...)
+    uint8_t spads;                      // Effective SPADs used for the measurement
+    uint16_t distance;                  // mm
+    uint16_t signalPerSpad;             // kcps/SPAD - same scaling as SFEVL53L1X::getSignalPerSpad()
+    uint16_t ambientPerSpad;            // kcps/SPAD
+    uint16_t sigma;                     // mm
+};
+
+/**
+ * @brief Bus policy for the Particle Wire object
+ */
+struct ParticleWireBus {
+    static inline uint8_t write(uint8_t address, uint16_t reg, const uint8_t *data, uint8_t count) {
+        Wire.beginTransmission(address);
+        Wire.write((uint8_t)(reg >> 8));
+        Wire.write((uint8_t)(reg & 0xFF));
+        Wire.write(data, count);
+        return Wire.endTransmission(true);
+    }
+
+    static inline uint8_t read(uint8_t address, uint16_t reg, uint8_t *data, uint8_t count) {
+        Wire.beginTransmission(address);
+        Wire.write((uint8_t)(reg >> 8));
+        Wire.write((uint8_t)(reg & 0xFF));
+        uint8_t status = Wire.endTransmission(false);
+        if (status) return status;
+        if (Wire.requestFrom(address, count) != count) return 4;                // 4 - "other error" in endTransmission() terms
+        for (uint8_t i = 0; i < count; i++) data[i] = Wire.read();
+        return 0;
+    }
+
+    // Device OS clocks SCL (up to 9 pulses) until a slave holding SDA low lets go, sends a STOP and restarts the peripheral
+    static inline void reset() {
+        Wire.reset();
+    }
+};
+
+} // namespace vl53l1x
+
+/**
+ * @brief VL53L1X driver bound at compile time
+ *
+ * Bus - bus policy (see above), Address - 7 bit I2C address, ShutdownPin / InterruptPin - XSHUT and GPIO1 (-1 if not connected),
+ * ShutdownLevel - the level on ShutdownPin that holds the sensor in shutdown (LOW for XSHUT wired straight to the pin)
+ */
+template <class Bus, uint8_t Address = 0x29, int ShutdownPin = -1, int InterruptPin = -1, int ShutdownLevel = LOW>
+class Vl53l1xDevice {
+public:
+    /**
+     * @brief Checks the model id and loads the default configuration - returns 0 on success (as SFEVL53L1X::begin())
+     *
+     * timeoutMs bounds the wait for the first measurement in sensorInit()
+     */
+    int begin(uint16_t timeoutMs = 150) {
+        if (ShutdownPin >= 0) pinMode(ShutdownPin, OUTPUT);
+        if (InterruptPin >= 0) pinMode(InterruptPin, INPUT);
+        if (getSensorID() != 0xEACC) return -1;
+        return sensorInit(timeoutMs);
+    }
+
+    int sensorInit(uint16_t timeoutMs = 150) {
+        for (uint8_t i = 0; i < sizeof(vl53l1x::defaultConfiguration); i++) {
+            writeByte(vl53l1x::REG_DEFAULT_CONFIGURATION_START + i, vl53l1x::defaultConfiguration[i]);
+        }
+        startRanging();
+        // We need to wait for the first measurement (at most the default intermeasurement period of 103ms) before the VHV settings take
+        for (unsigned long startedAt = millis(); !checkForDataReady(); ) {
+            if (millis() - startedAt > timeoutMs) return -7;            // VL53L1_ERROR_TIME_OUT
+            delay(1);
+        }
+        clearInterrupt();
+        stopRanging();
+        writeByte(vl53l1x::REG_VHV_CONFIG__TIMEOUT_MACROP_LOOP_BOUND, 0x09);   // two bounds VHV
+        writeByte(vl53l1x::REG_VHV_CONFIG__INIT, 0);                           // start VHV from the previous temperature
+        return 0;
+    }
+
+    void sensorOn() {
+        if (ShutdownPin >= 0) digitalWrite(ShutdownPin, !ShutdownLevel);
+        delay(10);
+    }
+
+    void sensorOff() {
+        if (ShutdownPin >= 0) digitalWrite(ShutdownPin, ShutdownLevel);
+        delay(10);
+    }
+
+    /**
+     * @brief Holds XSHUT at the shutdown level for holdMs then releases it - the sensor reboots with its default registers
+     *
+     * Returns false (and does nothing) if XSHUT is not connected. Poll checkBootState() before talking to the sensor again.
+     */
+    bool powerCycle(uint16_t holdMs) {
+        if (ShutdownPin < 0) return false;
+        digitalWrite(ShutdownPin, ShutdownLevel);
+        delay(holdMs);
+        digitalWrite(ShutdownPin, !ShutdownLevel);
+        polarity = -1;                                                  // Back to the default after the reset
+        return true;
+    }
+
+    /**
+     * @brief Frees the bus if a slave (this sensor part way through a transfer) is holding SDA - see the bus policy
+     */
+    void resetBus() {
+        Bus::reset();
+        polarity = -1;                                                  // Read it again from the sensor
+    }
+
+    uint16_t getSensorID() { return readWord(vl53l1x::REG_IDENTIFICATION__MODEL_ID); }
+    bool checkBootState() { return readByte(vl53l1x::REG_FIRMWARE__SYSTEM_STATUS) != 0; }
+
+    inline void clearInterrupt() { writeByte(vl53l1x::REG_SYSTEM__INTERRUPT_CLEAR, 0x01); }
+    inline void startRanging() { writeByte(vl53l1x::REG_SYSTEM__MODE_START, 0x40); }
+    inline void stopRanging() { writeByte(vl53l1x::REG_SYSTEM__MODE_START, 0x00); }
+
+    /**
+     * @brief clearInterrupt() and startRanging() in one transaction - the two registers are adjacent
+     */
+    inline void clearInterruptAndStartRanging() {
+        const uint8_t values[2] = {0x01, 0x40};
+        write(vl53l1x::REG_SYSTEM__INTERRUPT_CLEAR, values, sizeof(values));
+    }
+
+    /**
+     * @brief Data ready - the interrupt polarity is cached so this is a single byte read
+     */
+    inline bool checkForDataReady() {
+        if (polarity < 0) polarity = (readByte(vl53l1x::REG_GPIO_HV_MUX__CTRL) & 0x10) ? 0 : 1;
+        return (readByte(vl53l1x::REG_GPIO__TIO_HV_STATUS) & 1) == polarity;
+    }
+
+    void setInterruptPolarityHigh() { setInterruptPolarity(1); }
+    void setInterruptPolarityLow() { setInterruptPolarity(0); }
+
+    void setDistanceModeShort() { setDistanceMode(1); }
+    void setDistanceModeLong() { setDistanceMode(2); }
+
+    uint8_t getDistanceMode() {
+        uint8_t phase = readByte(vl53l1x::REG_PHASECAL_CONFIG__TIMEOUT_MACROP);
+        return (phase == 0x14) ? 1 : (phase == 0x0A) ? 2 : 0;
+    }
+
+    /**
+     * @brief Timing budget in ms - 15 (short mode only), 20, 33, 50, 100, 200 or 500. Returns false for other values
+     */
+    bool setTimingBudgetInMs(uint16_t budget) {
+        static const uint16_t budgets[] = {15, 20, 33, 50, 100, 200, 500};
+        static const uint16_t shortA[] = {0x001D, 0x0051, 0x00D6, 0x01AE, 0x02E1, 0x03E1, 0x0591};
+        static const uint16_t shortB[] = {0x0027, 0x006E, 0x006E, 0x01E8, 0x0388, 0x0496, 0x05C1};
+        static const uint16_t longA[] = {0, 0x001E, 0x0060, 0x00AD, 0x01CC, 0x02D9, 0x048F};
+        static const uint16_t longB[] = {0, 0x0022, 0x006E, 0x00C6, 0x01EA, 0x02F8, 0x04A4};
+        uint8_t mode = getDistanceMode();
+        for (uint8_t i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++) {
+            if (budgets[i] != budget) continue;
+            if (mode == 1) {
+                writeWord(vl53l1x::REG_RANGE_CONFIG__TIMEOUT_MACROP_A_HI, shortA[i]);
+                writeWord(vl53l1x::REG_RANGE_CONFIG__TIMEOUT_MACROP_B_HI, shortB[i]);
+                return true;
+            }
+            if (mode == 2 && longA[i]) {
+                writeWord(vl53l1x::REG_RANGE_CONFIG__TIMEOUT_MACROP_A_HI, longA[i]);
+                writeWord(vl53l1x::REG_RANGE_CONFIG__TIMEOUT_MACROP_B_HI, longB[i]);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint16_t getTimingBudgetInMs() {
+        switch (readWord(vl53l1x::REG_RANGE_CONFIG__TIMEOUT_MACROP_A_HI)) {
+            case 0x001D: return 15;
+            case 0x0051: case 0x001E: return 20;
+            case 0x00D6: case 0x0060: return 33;
+            case 0x01AE: case 0x00AD: return 50;
+            case 0x02E1: case 0x01CC: return 100;
+            case 0x03E1: case 0x02D9: return 200;
+            case 0x0591: case 0x048F: return 500;
+            default: return 0;
+        }
+    }
+
+    /**
+     * @brief Time between measurements in ms - must be at least the timing budget
+     */
+    void setIntermeasurementPeriod(uint16_t period) {
+        uint16_t clockPLL = readWord(vl53l1x::REG_RESULT__OSC_CALIBRATE_VAL) & 0x3FF;
+        writeDWord(vl53l1x::REG_SYSTEM__INTERMEASUREMENT_PERIOD, (uint32_t)(clockPLL * period * 1.075));
+    }
+
+    void setSigmaThreshold(uint16_t sigma) {
+        if (sigma <= (0xFFFF >> 2)) writeWord(vl53l1x::REG_RANGE_CONFIG__SIGMA_THRESH, sigma << 2);
+    }
+
+    void setSignalThreshold(uint16_t signal) { writeWord(vl53l1x::REG_RANGE_CONFIG__MIN_COUNT_RATE_RTN_LIMIT_MCPS, signal >> 3); }
+
+    /**
+     * @brief ROI size and optical center (see the table in TofSensorConfig.h) - two byte writes
+     */
+    inline void setROI(uint8_t x, uint8_t y, uint8_t opticalCenter) {
+        if (x > 16) x = 16;
+        if (y > 16) y = 16;
+        if (x > 10 || y > 10) opticalCenter = 199;
+        writeByte(vl53l1x::REG_ROI_CONFIG__USER_ROI_CENTRE_SPAD, opticalCenter);
+        writeByte(vl53l1x::REG_ROI_CONFIG__USER_ROI_REQUESTED_GLOBAL_XY_SIZE, (y - 1) << 4 | (x - 1));
+    }
+
+    /**
+     * @brief Moves the ROI without changing its size - a single byte write
+     */
+    inline void setROICenter(uint8_t opticalCenter) { writeByte(vl53l1x::REG_ROI_CONFIG__USER_ROI_CENTRE_SPAD, opticalCenter); }
+
+    inline uint16_t getDistance() { return readWord(vl53l1x::REG_RESULT__FINAL_CROSSTALK_CORRECTED_RANGE_MM_SD0); }
+
+    inline uint16_t getSignalPerSpad() {
+        uint16_t signal = readWord(vl53l1x::REG_RESULT__PEAK_SIGNAL_COUNT_RATE_CROSSTALK_CORRECTED_MCPS_SD0);
+        uint16_t spads = readWord(vl53l1x::REG_RESULT__DSS_ACTUAL_EFFECTIVE_SPADS_SD0);
+        return spads ? (uint16_t)((2000UL * signal) / spads) : 0;
+    }
+
+    inline uint16_t getAmbientPerSpad() {
+        uint16_t ambient = readWord(vl53l1x::REG_RESULT__AMBIENT_COUNT_RATE_MCPS_SD0);
+        uint16_t spads = readWord(vl53l1x::REG_RESULT__DSS_ACTUAL_EFFECTIVE_SPADS_SD0);
+        return spads ? (uint16_t)((2000UL * ambient) / spads) : 0;
+    }
+
+    inline uint16_t getSignalRate() { return readWord(vl53l1x::REG_RESULT__PEAK_SIGNAL_COUNT_RATE_CROSSTALK_CORRECTED_MCPS_SD0) * 8; }
+    inline uint16_t getSpadNb() { return readWord(vl53l1x::REG_RESULT__DSS_ACTUAL_EFFECTIVE_SPADS_SD0) >> 8; }
+
+    inline uint8_t getRangeStatus() {
+        uint8_t raw = readByte(vl53l1x::REG_RESULT__RANGE_STATUS) & 0x1F;
+        return (raw < sizeof(vl53l1x::rangeStatusMap)) ? vl53l1x::rangeStatusMap[raw] : 255;
+    }
+
+    /**
+     * @brief Reads status, SPADs, ambient, sigma, distance and signal in one 17 byte transaction
+     *
+     * Returns false (leaving results untouched) if the bus transaction failed.
+     */
+    inline bool readResults(vl53l1x::Results &results) {
+        uint8_t raw[17];
+        if (read(vl53l1x::REG_RESULT__RANGE_STATUS, raw, sizeof(raw))) return false;
+        uint8_t status = raw[0] & 0x1F;
+        uint16_t spads = (uint16_t)(raw[3] << 8 | raw[4]);
+        results.rangeStatus = (status < sizeof(vl53l1x::rangeStatusMap)) ? vl53l1x::rangeStatusMap[status] : 255;
+        results.spads = raw[3];
+        results.ambientPerSpad = spads ? (uint16_t)((2000UL * (uint16_t)(raw[7] << 8 | raw[8])) / spads) : 0;
+        results.sigma = (uint16_t)(raw[9] << 8 | raw[10]) >> 2;
+        results.distance = (uint16_t)(raw[13] << 8 | raw[14]);
+        results.signalPerSpad = spads ? (uint16_t)((2000UL * (uint16_t)(raw[15] << 8 | raw[16])) / spads) : 0;
+        return true;
+    }
+
+    void setOffset(int16_t offset) {
+        writeWord(vl53l1x::REG_ALGO__PART_TO_PART_RANGE_OFFSET_MM, (uint16_t)(offset * 4));
+        writeWord(vl53l1x::REG_MM_CONFIG__INNER_OFFSET_MM, 0);
+        writeWord(vl53l1x::REG_MM_CONFIG__OUTER_OFFSET_MM, 0);
+    }
+
+    /**
+     * @brief Offset in mm - the register holds 11 bits with two fractional bits, so values above 1024 are negative
+     */
+    int16_t getOffset() {
+        uint16_t raw = readWord(vl53l1x::REG_ALGO__PART_TO_PART_RANGE_OFFSET_MM);
+        int16_t offset = (int16_t)((uint16_t)(raw << 3) >> 5);
+        if (offset > 1024) offset -= 2048;
+        return offset;
+    }
+
+    /**
+     * @brief Crosstalk in cps - same conversion as SFEVL53L1X::setXTalk()
+     */
+    void setXTalk(uint16_t xtalk) {
+        writeWord(vl53l1x::REG_ALGO__CROSSTALK_COMPENSATION_X_PLANE_GRADIENT, 0);
+        writeWord(vl53l1x::REG_ALGO__CROSSTALK_COMPENSATION_Y_PLANE_GRADIENT, 0);
+        writeWord(vl53l1x::REG_ALGO__CROSSTALK_COMPENSATION_PLANE_OFFSET_KCPS, (uint16_t)(((uint32_t)xtalk << 9) / 1000));
+    }
+
+    uint16_t getXTalk() { return (uint16_t)(((uint32_t)readWord(vl53l1x::REG_ALGO__CROSSTALK_COMPENSATION_PLANE_OFFSET_KCPS) * 1000) >> 9); }
+
+    /**
+     * @brief Non-blocking temperature update - stop ranging first, poll checkForDataReady() then call endTemperatureUpdate()
+     */
+    void beginTemperatureUpdate() {
+        writeByte(vl53l1x::REG_VHV_CONFIG__TIMEOUT_MACROP_LOOP_BOUND, 0x81);      // full VHV
+        writeByte(vl53l1x::REG_VHV_CONFIG__INIT, 0x92);
+        startRanging();
+    }
+
+    void endTemperatureUpdate() {
+        clearInterrupt();
+        stopRanging();
+        writeByte(vl53l1x::REG_VHV_CONFIG__TIMEOUT_MACROP_LOOP_BOUND, 0x09);      // two bounds VHV
+        writeByte(vl53l1x::REG_VHV_CONFIG__INIT, 0);                              // start VHV from the previous temperature
+    }
+
+    /**
+     * @brief Number of failed bus transactions since boot - used by the health monitor
+     */
+    uint32_t getBusErrors() const { return busErrors; }
+
+    // Register access - public so higher layers can add ULD functions without another class
+    inline uint8_t readByte(uint16_t reg) {
+        uint8_t value = 0;
+        read(reg, &value, 1);
+        return value;
+    }
+
+    inline uint16_t readWord(uint16_t reg) {
+        uint8_t buffer[2] = {0, 0};
+        read(reg, buffer, 2);
+        return (uint16_t)(buffer[0] << 8 | buffer[1]);
+    }
+
+    inline void writeByte(uint16_t reg, uint8_t value) { write(reg, &value, 1); }
+
+    inline void writeWord(uint16_t reg, uint16_t value) {
+        uint8_t buffer[2] = {(uint8_t)(value >> 8), (uint8_t)(value & 0xFF)};
+        write(reg, buffer, 2);
+    }
+
+    inline void writeDWord(uint16_t reg, uint32_t value) {
+        uint8_t buffer[4] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value};
+        write(reg, buffer, 4);
+    }
+
+private:
+    inline uint8_t read(uint16_t reg, uint8_t *data, uint8_t count) {
+        uint8_t status = Bus::read(Address, reg, data, count);
+        if (status) busErrors++;
+        return status;
+    }
+
+    inline uint8_t write(uint16_t reg, const uint8_t *data, uint8_t count) {
+        uint8_t status = Bus::write(Address, reg, data, count);
+        if (status) busErrors++;
+        return status;
+    }
+
+    void setInterruptPolarity(uint8_t high) {
+        uint8_t mux = readByte(vl53l1x::REG_GPIO_HV_MUX__CTRL) & 0xEF;
+        writeByte(vl53l1x::REG_GPIO_HV_MUX__CTRL, mux | (!(high & 1)) << 4);
+        polarity = high & 1;
+    }
+
+    void setDistanceMode(uint8_t mode) {
+        uint16_t budget = getTimingBudgetInMs();
+        if (mode == 1) {
+            writeByte(vl53l1x::REG_PHASECAL_CONFIG__TIMEOUT_MACROP, 0x14);
+            writeByte(vl53l1x::REG_RANGE_CONFIG__VCSEL_PERIOD_A, 0x07);
+            writeByte(vl53l1x::REG_RANGE_CONFIG__VCSEL_PERIOD_B, 0x05);
+            writeByte(vl53l1x::REG_RANGE_CONFIG__VALID_PHASE_HIGH, 0x38);
+            writeWord(vl53l1x::REG_SD_CONFIG__WOI_SD0, 0x0705);
+            writeWord(vl53l1x::REG_SD_CONFIG__INITIAL_PHASE_SD0, 0x0606);
+        }
+        else if (mode == 2) {
+            writeByte(vl53l1x::REG_PHASECAL_CONFIG__TIMEOUT_MACROP, 0x0A);
+            writeByte(vl53l1x::REG_RANGE_CONFIG__VCSEL_PERIOD_A, 0x0F);
+            writeByte(vl53l1x::REG_RANGE_CONFIG__VCSEL_PERIOD_B, 0x0D);
+            writeByte(vl53l1x::REG_RANGE_CONFIG__VALID_PHASE_HIGH, 0xB8);
+            writeWord(vl53l1x::REG_SD_CONFIG__WOI_SD0, 0x0F0D);
+            writeWord(vl53l1x::REG_SD_CONFIG__INITIAL_PHASE_SD0, 0x0E0E);
+        }
+        setTimingBudgetInMs(budget);
+    }
+
+    int8_t polarity = -1;                       // Interrupt polarity, read once and cached (-1 until then)
+    uint32_t busErrors = 0;
+};
+#endif  /* __VL53L1XDEVICE_H */
@@ -0,0 +1,156 @@
+// Zone Decision Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class turns each frame's zone signals into the occupancy state (zone 1 ones, zone 2 twos)
+// Baselines come from a steady, clear warm-up window, are refined by later clean windows and re-learned when a zone has
+// disagreed with its baseline for BASELINE_RELEARN_WINDOWS steady windows. A zone is occupied when its signal is
+// personThreshold or more either side of its baseline.
+
+#include "Particle.h"
+#include "ZoneDecision.h"
+
+ZoneDecision::ZoneDecision() {
+  reset(NULL);
+}
+
+bool ZoneDecision::reset(const int *savedBaselines) {
+  sampleIndex = 0;
+  for (byte zone = 0; zone < 2; zone++) {
+    sawOccupancy[zone] = false;
+    sawDegraded[zone] = false;
+    relearnCount[zone] = 0;
+  }
+
+  if (savedBaselines) {
+    baselines[0] = savedBaselines[0];
+    baselines[1] = savedBaselines[1];
+    state = PROVISIONAL;
+  }
+  else {
+    baselines[0] = baselines[1] = 0;
+    state = WARMING_UP;
+  }
+  return (state != WARMING_UP);
+}
+
+// Statistical clear-zone test - a window is clear when the samples are steady (low standard deviation)
+static bool windowIsSteady(const int16_t *samples, int count, int maxStddev, int *mean) {
+  int32_t sum = 0;
+  for (int i = 0; i < count; i++) sum += samples[i];
+  *mean = sum / count;
+
+  int32_t sumOfSquares = 0;
+  for (int i = 0; i < count; i++) {
+    int32_t deviation = samples[i] - *mean;
+    sumOfSquares += deviation * deviation;
+  }
+  return (sumOfSquares / count) <= (maxStddev * maxStddev);
+}
+
+// The threshold test - shared by update() and updateBatch() so the two cannot drift apart
+static inline uint8_t occupiedBit(int signal, int baseline, int threshold, uint8_t bit) {
+  return (signal >= baseline + threshold || signal <= baseline - threshold) ? bit : 0;
+}
+
+int ZoneDecision::update(const int signal[2], const ZoneDecisionParams &params, uint8_t &events, uint8_t degraded) {
+  int occupancy = 0;
+  events = 0;
+
+  if (state != WARMING_UP) {                        // No baselines to compare against while warming up - just fill the window
+    for (byte zone = 0; zone < 2; zone++) occupancy |= occupiedBit(signal[zone], baselines[zone], params.personThreshold, 1 << zone);
+  }
+
+  for (byte zone = 0; zone < 2; zone++) {
+    samples[zone][sampleIndex] = (int16_t)signal[zone];
+    if (occupancy & (1 << zone)) sawOccupancy[zone] = true;
+    if (degraded & (1 << zone)) sawDegraded[zone] = true;
+  }
+  if (++sampleIndex >= params.calibrationLoops) closeWindow(params, events);
+  return occupancy;
+}
+
+void ZoneDecision::updateBatch(const ZoneFrameBlock &block, const ZoneDecisionParams &params, uint8_t *occupancy, uint8_t *events) {
+  if (events) memset(events, 0, block.count);
+
+  for (size_t done = 0; done < block.count; ) {
+    // Frames until the current window closes - the baselines cannot move before then (a window shortened at runtime closes at once)
+    size_t run = (sampleIndex < params.calibrationLoops) ? (size_t)(params.calibrationLoops - sampleIndex) : 1;
+    if (run > block.count - done) run = block.count - done;
+
+    const uint16_t * __restrict signal0 = block.signal[0] + done;
+    const uint16_t * __restrict signal1 = block.signal[1] + done;
+    uint8_t * __restrict out = occupancy + done;
+    uint8_t seen = 0;
+    if (state != WARMING_UP) {
+      const int baseline0 = baselines[0], baseline1 = baselines[1], threshold = params.personThreshold;
+      for (size_t i = 0; i < run; i++) {
+        out[i] = occupiedBit(signal0[i], baseline0, threshold, 1) | occupiedBit(signal1[i], baseline1, threshold, 2);
+        seen |= out[i];
+      }
+    }
+    else memset(out, 0, run);
+
+    for (size_t i = 0; i < run; i++) {
+      samples[0][sampleIndex + i] = (int16_t)signal0[i];
+      samples[1][sampleIndex + i] = (int16_t)signal1[i];
+    }
+    if (seen & 1) sawOccupancy[0] = true;
+    if (seen & 2) sawOccupancy[1] = true;
+    sampleIndex += run;
+    done += run;
+
+    if (sampleIndex >= params.calibrationLoops) {
+      uint8_t closed = 0;
+      closeWindow(params, closed);
+      if (events) events[done - 1] = closed;
+    }
+  }
+}
+
+// Evaluates a full warm-up window
+void ZoneDecision::closeWindow(const ZoneDecisionParams &params, uint8_t &events) {
+  int windowLength = params.calibrationLoops;
+  sampleIndex = 0;
+  events |= DECISION_WINDOW_CLOSED;
+
+  int mean[2];
+  bool steady[2];
+  for (byte zone = 0; zone < 2; zone++) steady[zone] = windowIsSteady(samples[zone], windowLength, params.maxStddev, &mean[zone]) && !sawDegraded[zone];
+
+  if (state != COMPLETE) {
+    // The first clear window sets the baselines outright - both zones must be clear so the pair is consistent
+    if (steady[0] && steady[1] && !sawOccupancy[0] && !sawOccupancy[1]) {
+      baselines[0] = mean[0];
+      baselines[1] = mean[1];
+      state = COMPLETE;
+      events |= DECISION_CALIBRATED;
+    }
+    else if (steady[0] && steady[1] && ++relearnCount[0] >= params.relearnWindows) {
+      // Steady but "occupied" for a long time - the saved baselines are stale (drift or something new in the field of view)
+      baselines[0] = mean[0];
+      baselines[1] = mean[1];
+      state = COMPLETE;
+      events |= DECISION_RELEARNED;
+    }
+    else if (!steady[0] || !steady[1]) relearnCount[0] = 0;
+  }
+  else {
+    // Refine each zone independently as clean windows arrive
+    for (byte zone = 0; zone < 2; zone++) {
+      if (!steady[zone]) relearnCount[zone] = 0;
+      else if (!sawOccupancy[zone]) {
+        baselines[zone] += (mean[zone] - baselines[zone]) / (1 << params.refineShift);
+        relearnCount[zone] = 0;
+      }
+      else if (++relearnCount[zone] >= params.relearnWindows) {
+        baselines[zone] = mean[zone];
+        relearnCount[zone] = 0;
+        events |= (zone == 0) ? DECISION_ZONE1_RELEARNED : DECISION_ZONE2_RELEARNED;
+      }
+    }
+  }
+
+  sawOccupancy[0] = sawOccupancy[1] = false;
+  sawDegraded[0] = sawDegraded[1] = false;
+}
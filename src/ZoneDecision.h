@@ -0,0 +1,104 @@
+// Zone Decision Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class turns each frame's zone signals into the occupancy state (zone 1 ones, zone 2 twos)
+// Baselines come from a steady, clear warm-up window, are refined by later clean windows and re-learned when a zone has
+// disagreed with its baseline for BASELINE_RELEARN_WINDOWS steady windows. A zone is occupied when its signal is
+// personThreshold or more either side of its baseline.
+// Unlike the other classes this is plain state - no hardware, no singletons - so TofSensor runs one on the device and the
+// host tools run one per configuration over recorded frames, making exactly the same decisions
+
+#ifndef __ZONEDECISION_H
+#define __ZONEDECISION_H
+
+#include "Particle.h"
+#include "TofSensorConfig.h"
+
+/**
+ * @brief The tunable parts of the decision - TofSensor fills these from ConfigStore and TofSensorConfig.h every frame
+ */
+struct ZoneDecisionParams {
+    int personThreshold;                    // kcps/SPAD either side of the baseline
+    int calibrationLoops;                   // Frames per warm-up window - 1 to NUM_CALIBRATION_LOOPS
+    int maxStddev;                          // A window is steady if each zone varies less than this (CALIBRATION_MAX_STDDEV)
+    int refineShift;                        // Clean windows move the baseline 1/(2^shift) of the way (BASELINE_REFINE_SHIFT)
+    int relearnWindows;                     // Steady windows that disagree before the baseline is replaced (BASELINE_RELEARN_WINDOWS)
+};
+
+/**
+ * @brief A block of frames as structure of arrays (one array per field and zone) for updateBatch()
+ *
+ * Only the signal arrays are needed - ambient and distance may be NULL and are carried for the analyses that replay them.
+ */
+struct ZoneFrameBlock {
+    const uint16_t *signal[2];              // kcps/SPAD, as Vl53l1xDevice::readResults() reports it
+    const uint16_t *ambient[2];
+    const uint16_t *distance[2];            // mm
+    size_t count;
+};
+
+/**
+ * @brief What closing a warm-up window did - update() reports these as bits so the caller can log and persist
+ */
+enum ZoneDecisionEvent : uint8_t {
+    DECISION_WINDOW_CLOSED = 0x01,          // A warm-up window was evaluated (the baselines may have moved)
+    DECISION_CALIBRATED = 0x02,             // First clear window - baselines set
+    DECISION_RELEARNED = 0x04,              // Stale provisional baselines replaced after a long steady stretch
+    DECISION_ZONE1_RELEARNED = 0x08,        // One zone's baseline replaced after a long steady stretch
+    DECISION_ZONE2_RELEARNED = 0x10
+};
+
+class ZoneDecision {
+public:
+    /**
+     * @brief Calibration progress - in the same order as TofSensor::CalibrationState
+     */
+    enum State : uint8_t {
+        WARMING_UP,                         // No baselines - update() returns 0 while the first window fills
+        PROVISIONAL,                        // Counting with restored baselines until a clean window arrives
+        COMPLETE
+    };
+
+    ZoneDecision();
+
+    /**
+     * @brief Starts a fresh warm-up window - with saved baselines (from before a restart) counting continues provisionally
+     *
+     * Pass NULL to start from nothing. Returns true if counting can continue in the meantime.
+     */
+    bool reset(const int *savedBaselines);
+
+    /**
+     * @brief Decides one frame - returns the occupancy state and sets events to the ZoneDecisionEvent bits for this frame
+     *
+     * degraded has a bit per zone (ones, twos) whose sample the sensor flagged (sigma or signal fail, wrap around...) - it
+     * is still decided, but a window holding one is not steady for that zone, so it neither sets nor moves its baseline.
+     */
+    int update(const int signal[2], const ZoneDecisionParams &params, uint8_t &events, uint8_t degraded = 0);
+
+    /**
+     * @brief Decides a block of frames - the same decisions, baselines and events as calling update() frame by frame
+     *
+     * occupancy gets the state for each frame and events (if not NULL) the ZoneDecisionEvent bits for each frame.
+     * For replaying recorded data on the host: the baselines only move when a warm-up window closes, so each window's
+     * frames are tested against fixed baselines in a branch-free loop the compiler vectorizes (-O3, or -O2 with GCC 12+).
+     */
+    void updateBatch(const ZoneFrameBlock &block, const ZoneDecisionParams &params, uint8_t *occupancy, uint8_t *events);
+
+    State getState() const { return state; }
+    int getBaseline(int zone) const { return baselines[zone & 1]; }
+
+protected:
+    void closeWindow(const ZoneDecisionParams &params, uint8_t &events);
+
+    State state;
+    int baselines[2];
+    int16_t samples[2][NUM_CALIBRATION_LOOPS];
+    uint8_t sampleIndex;
+    bool sawOccupancy[2];                   // Was the zone judged occupied (against the current baseline) during this window
+    bool sawDegraded[2];                    // Did the zone have a degraded sample during this window
+    uint16_t relearnCount[2];               // Consecutive steady windows that disagree with the baseline
+};
+
+#endif  /* __ZONEDECISION_H */
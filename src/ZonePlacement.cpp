@@ -0,0 +1,165 @@
+// Zone Placement Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class picks the zone centers and ROI width for a door from a short window of installation walk-throughs
+// TofSensor ranges every candidate ROI each frame and hands the signals over - this class only keeps the books and scores
+// Each candidate pair is scored on signal contrast (peak change against its own noise) and on whether the two zones
+// saw the person in different frames (separation) - the best pair is applied by TofSensor and persisted
+
+#include <math.h>
+#include "Particle.h"
+#include "TofSensorConfig.h"
+#include "EventLog.h"
+#include "ConfigStore.h"
+#include "ZonePlacement.h"
+
+// Candidate geometries - width through the door and the near column of each symmetric pair (the far one is 16 - near)
+static const uint8_t phaseWidths[ZONE_PLACEMENT_PHASES] = {6, 4};
+static const uint8_t pairNearColumns[ZONE_PLACEMENT_PHASES][ZONE_PLACEMENT_PAIRS] = {{3, 4, 5}, {2, 4, 6}};
+
+// Same table as TofSensorConfig.h - rows 0-7 count up from 128, rows 8-15 count down from 127
+static uint8_t roiCenter(int row, int column) {
+  return (row < 8) ? (uint8_t)(128 + column * 8 + row) : (uint8_t)(127 - column * 8 - (row - 8));
+}
+
+ZonePlacement *ZonePlacement::_instance;
+
+// [static]
+ZonePlacement &ZonePlacement::instance() {
+  if (!_instance) {
+      _instance = new ZonePlacement();
+  }
+  return *_instance;
+}
+
+ZonePlacement::ZonePlacement() {
+  memset(&result, 0, sizeof(result));
+}
+
+ZonePlacement::~ZonePlacement() {
+}
+
+void ZonePlacement::start(int zoneRow) {
+  row = constrain(zoneRow, 0, 15);
+  phase = 0;
+  memset(settleFrames, 0, sizeof(settleFrames));
+  memset(stats, 0, sizeof(stats));
+  memset(pairScores, 0, sizeof(pairScores));
+  memset(pairContrasts, 0, sizeof(pairContrasts));
+  memset(phasePasses, 0, sizeof(phasePasses));
+  memset(&result, 0, sizeof(result));
+  inPass = false;
+  quietFrames = 0;
+  lastFrameAt = 0;
+  frameInterval = 0;
+  startedAt = millis();
+  running = true;
+}
+
+void ZonePlacement::getRoi(uint8_t index, uint8_t &width, uint8_t &center) const {
+  uint8_t near = pairNearColumns[phase][index % ZONE_PLACEMENT_PAIRS];
+  width = phaseWidths[phase];
+  center = roiCenter(row, (index < ZONE_PLACEMENT_PAIRS) ? near : 16 - near);
+}
+
+bool ZonePlacement::addFrame(const uint16_t signals[ZONE_PLACEMENT_ROIS], const unsigned long timestamps[ZONE_PLACEMENT_ROIS]) {
+  if (!running) return false;
+  RoiStats *roi = stats[phase];
+
+  if (lastFrameAt) frameInterval = timestamps[0] - lastFrameAt;
+  lastFrameAt = timestamps[0];
+
+  if (settleFrames[phase] < ZONE_PLACEMENT_SETTLE_FRAMES) {        // Learn the empty doorway for this width first
+    for (uint8_t i = 0; i < ZONE_PLACEMENT_ROIS; i++) {
+      int32_t sample = (int32_t)signals[i] << 4;
+      if (settleFrames[phase] == 0) roi[i].baseline = sample;
+      else {
+        roi[i].noise += (abs(sample - roi[i].baseline) - roi[i].noise) / 4;
+        roi[i].baseline += (sample - roi[i].baseline) / 4;
+      }
+    }
+    settleFrames[phase]++;
+  }
+  else {
+    bool anyOccupied = false;
+    int threshold = ConfigStore::instance().get().personThreshold;
+    for (uint8_t i = 0; i < ZONE_PLACEMENT_ROIS; i++) {
+      int32_t deviation = abs(((int32_t)signals[i] << 4) - roi[i].baseline) >> 4;
+      if (deviation >= threshold) anyOccupied = true;
+      if (inPass || deviation >= threshold) {
+        if (deviation > roi[i].peak) {
+          roi[i].peak = (uint16_t)deviation;
+          roi[i].peakAt = timestamps[i];
+        }
+      }
+      else {                                                         // Clear - keep tracking the empty doorway
+        int32_t sample = (int32_t)signals[i] << 4;
+        roi[i].noise += (abs(sample - roi[i].baseline) - roi[i].noise) / 16;
+        roi[i].baseline += (sample - roi[i].baseline) / 16;
+      }
+    }
+
+    if (anyOccupied) {
+      inPass = true;
+      quietFrames = 0;
+    }
+    else if (inPass && ++quietFrames >= ZONE_PLACEMENT_QUIET_FRAMES) {
+      scorePass();
+      inPass = false;
+      phase = (phase + 1) % ZONE_PLACEMENT_PHASES;                   // Next walk-through tries the other width
+      lastFrameAt = 0;
+    }
+  }
+
+  uint16_t passes = 0;
+  for (uint8_t p = 0; p < ZONE_PLACEMENT_PHASES; p++) passes += phasePasses[p];
+  if (passes >= ZONE_PLACEMENT_PASSES || millis() - startedAt > ZONE_PLACEMENT_TIMEOUT_MS) finish();
+  return !running;
+}
+
+// Scores each pair for the walk-through just finished - a pair that missed the person in either zone scores nothing
+// Contrast is compressed with log2 rather than capped, so a pair with twice the contrast always scores higher
+void ZonePlacement::scorePass() {
+  RoiStats *roi = stats[phase];
+  uint16_t threshold = ConfigStore::instance().get().personThreshold;
+
+  for (uint8_t pair = 0; pair < ZONE_PLACEMENT_PAIRS; pair++) {
+    RoiStats &near = roi[pair];
+    RoiStats &far = roi[pair + ZONE_PLACEMENT_PAIRS];
+    if (near.peak >= threshold && far.peak >= threshold) {
+      uint32_t nearContrast = ((uint32_t)near.peak * 160) / (uint32_t)((near.noise > 16) ? near.noise : 16);   // x10 - noise floor of 1 kcps/SPAD
+      uint32_t farContrast = ((uint32_t)far.peak * 160) / (uint32_t)((far.noise > 16) ? far.noise : 16);
+      uint32_t contrast = (nearContrast < farContrast) ? nearContrast : farContrast;
+      uint32_t score = (uint32_t)(10.0f * log2f(1.0f + contrast / 10.0f));
+      unsigned long apart = (near.peakAt > far.peakAt) ? near.peakAt - far.peakAt : far.peakAt - near.peakAt;
+      pairScores[phase][pair] += (apart >= frameInterval) ? 2 * score : score;
+      pairContrasts[phase][pair] += contrast;
+    }
+  }
+  for (uint8_t i = 0; i < ZONE_PLACEMENT_ROIS; i++) roi[i].peak = 0;
+  phasePasses[phase]++;
+}
+
+void ZonePlacement::finish() {
+  running = false;
+  result.valid = false;
+  uint32_t bestContrast = 0;
+
+  for (uint8_t p = 0; p < ZONE_PLACEMENT_PHASES; p++) {
+    result.passes += phasePasses[p];
+    if (phasePasses[p] == 0) continue;
+    for (uint8_t pair = 0; pair < ZONE_PLACEMENT_PAIRS; pair++) {
+      uint16_t score = (uint16_t)(pairScores[p][pair] / phasePasses[p]);
+      uint32_t contrast = pairContrasts[p][pair] / phasePasses[p];
+      if (score == 0 || (result.valid && (score < result.score || (score == result.score && contrast <= bestContrast)))) continue;
+      bestContrast = contrast;
+      result.valid = true;
+      result.score = score;
+      result.width = phaseWidths[p];
+      result.front = roiCenter(row, pairNearColumns[p][pair]);
+      result.back = roiCenter(row, 16 - pairNearColumns[p][pair]);
+    }
+  }
+  EventLog::instance().record(EVENT_ZONE_PLACEMENT, result.valid ? result.front : 0, result.valid ? result.back : 0, result.width, result.score);
+}
@@ -0,0 +1,125 @@
+// Zone Placement Class
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// This class picks the zone centers and ROI width for a door from a short window of installation walk-throughs
+// TofSensor ranges every candidate ROI each frame and hands the signals over - this class only keeps the books and scores
+// Each candidate pair is scored on signal contrast (peak change against its own noise) and on whether the two zones
+// saw the person in different frames (separation) - the best pair is applied by TofSensor and persisted
+
+#ifndef __ZONEPLACEMENT_H
+#define __ZONEPLACEMENT_H
+
+#include "Particle.h"
+
+#define ZONE_PLACEMENT_PASSES 10                    // Walk-throughs to collect before choosing
+#define ZONE_PLACEMENT_TIMEOUT_MS (5UL * 60UL * 1000UL)   // Choose from whatever we have after this long
+#define ZONE_PLACEMENT_SETTLE_FRAMES 20             // Clear frames per phase to learn each ROI's baseline and noise
+#define ZONE_PLACEMENT_QUIET_FRAMES 5               // Clear frames that end a walk-through
+#define ZONE_PLACEMENT_PHASES 2                     // ROI widths tried - alternated walk-through by walk-through
+#define ZONE_PLACEMENT_PAIRS 3                      // Symmetric center pairs per width
+#define ZONE_PLACEMENT_ROIS (2 * ZONE_PLACEMENT_PAIRS)   // ROIs ranged per frame - the near zones then the far zones
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * It is driven by TofSensor - use TofSensor::instance().startZonePlacement() to begin.
+ */
+class ZonePlacement {
+public:
+    /**
+     * @brief The chosen layout - valid is false until a run has finished with at least one scored walk-through
+     */
+    struct Result {
+        bool valid;
+        uint8_t front;                      // Optical centers
+        uint8_t back;
+        uint8_t width;                      // SPADs through the door
+        uint16_t score;                     // Mean per walk-through, x10 (log2 of 1 + contrast, doubled when the zones separated)
+        uint8_t passes;
+    };
+
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use ZonePlacement::instance() to instantiate the singleton.
+     */
+    static ZonePlacement &instance();
+
+    /**
+     * @brief Clears the books and starts an installation window with the zones on the given row across the door
+     */
+    void start(int row);
+
+    bool isRunning() const { return running; }
+
+    /**
+     * @brief The ROI TofSensor should range at position index (0 - ZONE_PLACEMENT_ROIS-1) in the current phase
+     */
+    void getRoi(uint8_t index, uint8_t &width, uint8_t &center) const;
+
+    /**
+     * @brief Hands over one frame - signals[i] is kcps/SPAD for getRoi(i), timestamps[i] when it was ready
+     *
+     * @return true when the run has finished (see getResult())
+     */
+    bool addFrame(const uint16_t signals[ZONE_PLACEMENT_ROIS], const unsigned long timestamps[ZONE_PLACEMENT_ROIS]);
+
+    const Result &getResult() const { return result; }
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use ZonePlacement::instance() to instantiate the singleton.
+     */
+    ZonePlacement();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~ZonePlacement();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    ZonePlacement(const ZonePlacement&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    ZonePlacement& operator=(const ZonePlacement&) = delete;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static ZonePlacement *_instance;
+
+    void scorePass();
+    void finish();
+
+    struct RoiStats {
+        int32_t baseline;                   // kcps/SPAD x16
+        int32_t noise;                      // Mean absolute deviation while clear, kcps/SPAD x16
+        uint16_t peak;                      // Largest deviation this walk-through, kcps/SPAD
+        unsigned long peakAt;
+    };
+
+    bool running = false;
+    int row = 7;
+    uint8_t phase = 0;
+    uint16_t settleFrames[ZONE_PLACEMENT_PHASES];
+    RoiStats stats[ZONE_PLACEMENT_PHASES][ZONE_PLACEMENT_ROIS];
+    uint32_t pairScores[ZONE_PLACEMENT_PHASES][ZONE_PLACEMENT_PAIRS];   // x10
+    uint32_t pairContrasts[ZONE_PLACEMENT_PHASES][ZONE_PLACEMENT_PAIRS];   // Raw peak / noise, x10 - breaks ties between scores
+    uint8_t phasePasses[ZONE_PLACEMENT_PHASES];
+    bool inPass = false;
+    uint8_t quietFrames = 0;
+    unsigned long lastFrameAt = 0;
+    unsigned long frameInterval = 0;
+    unsigned long startedAt = 0;
+    Result result;
+};
+#endif  /* __ZONEPLACEMENT_H */
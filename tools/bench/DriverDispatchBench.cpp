@@ -0,0 +1,72 @@
+// Driver Dispatch Benchmark
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// Compares the per-call cost of the SparkFun driver (SFEVL53L1X -> heap VL53L1X -> TwoWire* / virtual methods)
+// with the compile-time bound Vl53l1xDevice template on the register calls TofSensor makes every zone.
+// Both go through the same host Wire (one byte at a time into a register file in memory) so the difference is the
+// call path, not the bus.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=gnu++17 -Itools/host -Isrc -Ilib/SparkFun_VL53L1X_Arduino_Library/src
+//       tools/bench/DriverDispatchBench.cpp tools/host/HostParticle.cpp
+//       lib/SparkFun_VL53L1X_Arduino_Library/src/*.cpp -o driver_bench && ./driver_bench
+
+#include <chrono>
+#include "Particle.h"
+#include "SparkFun_VL53L1X.h"
+#include "Vl53l1xDevice.h"
+
+static uint8_t registers[0x200];
+
+static volatile uint32_t sink;
+
+template <class Body>
+static double nanosecondsPerCall(const char *name, uint32_t calls, Body body) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < calls; i++) body(i);
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+  printf("  %-44s %8.1f ns/call\n", name, ns);
+  return ns;
+}
+
+int main() {
+  const uint32_t calls = 2000000;
+
+  // A ranging result - 0x98 signal, 0x8C effective SPADs (8.8), data ready with active high polarity
+  registers[0x0098] = 0x01; registers[0x0099] = 0x40;
+  registers[0x008C] = 0x30; registers[0x008D] = 0x00;
+  registers[0x0030] = 0x01;
+  registers[0x0031] = 0x01;
+  Wire.attachRegisters(registers, sizeof(registers));
+
+  SFEVL53L1X legacy(Wire);
+  Vl53l1xDevice<vl53l1x::ParticleWireBus, 0x29> device;
+
+  if (legacy.getSignalPerSpad() != device.getSignalPerSpad()) {
+    printf("Mismatch: legacy %u template %u\n", legacy.getSignalPerSpad(), device.getSignalPerSpad());
+    return 1;
+  }
+
+  printf("Per zone register path, %lu calls each\n", (unsigned long)calls);
+  double legacyZone = nanosecondsPerCall("SFEVL53L1X setROI+ready+signal", calls, [&](uint32_t i) {
+    legacy.setROI(6, 8, (i & 1) ? 239 : 159);
+    sink += legacy.checkForDataReady();
+    sink += legacy.getSignalPerSpad();
+  });
+  double templateZone = nanosecondsPerCall("Vl53l1xDevice setROI+ready+signal", calls, [&](uint32_t i) {
+    device.setROI(6, 8, (i & 1) ? 239 : 159);
+    sink += device.checkForDataReady();
+    sink += device.getSignalPerSpad();
+  });
+  double burstZone = nanosecondsPerCall("Vl53l1xDevice setROICenter+ready+burst read", calls, [&](uint32_t i) {
+    vl53l1x::Results results = {};
+    device.setROICenter((i & 1) ? 239 : 159);
+    sink += device.checkForDataReady();
+    device.readResults(results);
+    sink += results.signalPerSpad;
+  });
+
+  printf("\nTemplate path is %.1fx faster (%.1fx with the burst read)\n", legacyZone / templateZone, legacyZone / burstZone);
+  return 0;
+}
@@ -0,0 +1,108 @@
+// Zone Decision Benchmark
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// Runs ZoneDecision frame by frame (update(), as TofSensor does on the device) and a block at a time (updateBatch(), as
+// the replay tools do) over the same frames, checks every occupancy state, event and baseline matches, and times both.
+// Frames come from a crowd_sim trace if one is given, otherwise from a synthetic door with drift and passers-by.
+//
+// Build and run from the repository root:
+//   g++ -O3 -std=gnu++17 -Itools/host -Isrc tools/bench/ZoneDecisionBench.cpp tools/host/HostParticle.cpp
+//       src/ZoneDecision.cpp -o zone_decision_bench && ./zone_decision_bench [frames.csv]
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include "Particle.h"
+#include "ZoneDecision.h"
+
+#define BENCH_BLOCK_FRAMES 4096
+
+static std::vector<uint16_t> signals[2];
+
+static void loadFrames(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) return;
+  char line[160];
+  unsigned long ms, signal1, signal2;
+  while (fgets(line, sizeof(line), file)) {
+    if (sscanf(line, "%lu,%lu,%lu", &ms, &signal1, &signal2) != 3) continue;
+    signals[0].push_back((uint16_t)signal1);
+    signals[1].push_back((uint16_t)signal2);
+  }
+  fclose(file);
+}
+
+// A slowly drifting floor with noise, people walking zone 2 then zone 1 (or back) and now and then a parked cart
+static void syntheticFrames(size_t count) {
+  std::mt19937 random(1);
+  std::normal_distribution<double> noise(0, 1.5);
+  std::uniform_real_distribution<double> unit(0, 1);
+  double drift = 0;
+  size_t personAt = 0, cartUntil = 0;
+  int direction = 1;
+  for (size_t frame = 0; frame < count; frame++) {
+    drift += 0.001 * (unit(random) - 0.5);
+    if (frame >= personAt + 40 && unit(random) < 0.01) {
+      personAt = frame;
+      direction = (unit(random) < 0.5) ? 1 : -1;
+    }
+    if (frame > cartUntil && unit(random) < 0.00002) cartUntil = frame + 2000;
+    for (int zone = 0; zone < 2; zone++) {
+      double value = 14 + drift + noise(random);
+      int lead = (direction > 0) ? (zone == 1) : (zone == 0);      // The zone the person reaches first
+      size_t into = frame - personAt;
+      if (into < 30 && into >= (size_t)(lead ? 0 : 8) && into < (size_t)(lead ? 22 : 30)) value += 60;
+      if (frame <= cartUntil && zone == 0) value += 25;
+      signals[zone].push_back((uint16_t)(value < 1 ? 1 : value));
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) loadFrames(argv[1]);
+  if (signals[0].empty()) syntheticFrames(2000000);
+  size_t count = signals[0].size();
+
+  static const ZoneDecisionParams settings[] = {
+    {PERSON_THRESHOLD, NUM_CALIBRATION_LOOPS, CALIBRATION_MAX_STDDEV, BASELINE_REFINE_SHIFT, BASELINE_RELEARN_WINDOWS},
+    {8, 10, 2, 1, 5},
+    {20, 7, 6, 3, 60}
+  };
+
+  std::vector<uint8_t> scalarStates(count), scalarEvents(count), batchStates(count), batchEvents(count);
+  bool allMatch = true;
+  printf("%zu frames\n\n  setting  update() ns/frame  updateBatch() ns/frame  speedup  match\n", count);
+
+  for (size_t s = 0; s < sizeof(settings) / sizeof(settings[0]); s++) {
+    const ZoneDecisionParams &params = settings[s];
+    ZoneDecision scalar, batch;
+    int saved[2] = {signals[0][0], signals[1][0]};
+    if (s == 2) {                                     // Start one provisionally, as after a restart
+      scalar.reset(saved);
+      batch.reset(saved);
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < count; frame++) {
+      int signal[2] = {signals[0][frame], signals[1][frame]};
+      scalarStates[frame] = (uint8_t)scalar.update(signal, params, scalarEvents[frame]);
+    }
+    double scalarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    started = std::chrono::steady_clock::now();
+    for (size_t start = 0; start < count; start += BENCH_BLOCK_FRAMES) {
+      size_t frames = (count - start < BENCH_BLOCK_FRAMES) ? count - start : BENCH_BLOCK_FRAMES;
+      ZoneFrameBlock block = {{&signals[0][start], &signals[1][start]}, {NULL, NULL}, {NULL, NULL}, frames};
+      batch.updateBatch(block, params, &batchStates[start], &batchEvents[start]);
+    }
+    double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    bool match = (scalarStates == batchStates) && (scalarEvents == batchEvents) && (scalar.getState() == batch.getState()) &&
+                 (scalar.getBaseline(0) == batch.getBaseline(0)) && (scalar.getBaseline(1) == batch.getBaseline(1));
+    allMatch &= match;
+    printf("  %7zu  %16.2f  %22.2f  %6.1fx  %s\n", s + 1, scalarSeconds * 1e9 / count, batchSeconds * 1e9 / count,
+           scalarSeconds / batchSeconds, match ? "yes" : "NO");
+  }
+  return allMatch ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+// History Decoder
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// Turns CrossingHistory batches back into one line per pass - the desktop end of the "occupancy-history" event.
+// Reads lines from the files given (or stdin) and decodes the last word of each: a bare base64 batch, the output of the
+// console's "history batch", or a FilePublishSink log. Lines that are not a batch (the "occupancy" count events) are skipped.
+// Batches are checked against each other - if one does not start where the one before ended, records were lost between them.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=gnu++17 -Itools/host -Isrc tools/history/HistoryDecode.cpp tools/host/HostParticle.cpp
+//       src/CrossingHistory.cpp -o history_decode && ./history_decode [--json] [events.log ...]
+//
+// Output is CSV - time,kind,confidence,count - or with --json the same passes as one JSON object each, which is what
+// publishing a pass at a time would have cost. The totals, and bytes per pass each way, go to stderr.
+
+#include <string.h>
+#include <time.h>
+#include "Particle.h"
+#include "CrossingHistory.h"
+
+static const char * const kindNames[] = {"aborted", "entered", "exited", "count set"};
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static bool json = false;
+static uint32_t batches = 0, records = 0, skipped = 0, gaps = 0;
+static uint64_t base64Bytes = 0, binaryBytes = 0, outputBytes = 0;
+static bool haveLast = false;
+static HistoryRecord last;
+static uint32_t lastEpoch = 0;
+
+// Returns the decoded length, or -1 if the text is not base64
+static long unbase64(const char *text, uint8_t *out, size_t length) {
+  size_t written = 0;
+  uint32_t group = 0;
+  int bits = 0;
+  for (const char *c = text; *c && *c != '='; c++) {
+    const char *found = strchr(alphabet, *c);
+    if (!found) return -1;
+    group = (group << 6) | (uint32_t)(found - alphabet);
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      if (written >= length) return -1;
+      out[written++] = (uint8_t)(group >> bits);
+    }
+  }
+  return (long)written;
+}
+
+static void formatTime(uint32_t epoch, uint32_t ticks, char *out, size_t length) {
+  uint64_t ms = (uint64_t)ticks * HISTORY_TICK_MS;
+  if (epoch < 1000000000UL) {                       // Uptime - the clock was not set yet
+    snprintf(out, length, "+%llu.%llu", (unsigned long long)(epoch + ms / 1000), (unsigned long long)(ms % 1000) / 100);
+    return;
+  }
+  time_t seconds = (time_t)(epoch + ms / 1000);
+  struct tm utc;
+  gmtime_r(&seconds, &utc);
+  size_t used = strftime(out, length, "%Y-%m-%dT%H:%M:%S", &utc);
+  snprintf(out + used, length - used, ".%lluZ", (unsigned long long)(ms % 1000) / 100);
+}
+
+static void decodeBatch(const char *text) {
+  static uint8_t bytes[4096];
+  long length = unbase64(text, bytes, sizeof(bytes));
+  if (length <= 0) {
+    skipped++;
+    return;
+  }
+
+  HistoryDecoder decoder;
+  decoder.startBatch();
+  uint32_t found = 0;
+  bool anchored = false;
+  for (long i = 0; i < length; i++) {
+    bool complete = decoder.feed(bytes[i]);
+    if (decoder.failed()) break;
+    if (!anchored && decoder.atRecordBoundary()) {  // The header is in - is this where the last batch ended?
+      anchored = true;
+      const HistoryRecord &anchor = decoder.get();
+      if (haveLast && (decoder.getEpoch() != lastEpoch || anchor.ticks != last.ticks || anchor.count != last.count)) {
+        gaps++;
+        fprintf(stderr, "Batch %lu does not follow on from the one before - records were lost or a batch is missing\n", (unsigned long)batches + 1);
+      }
+    }
+    if (!complete) continue;
+
+    const HistoryRecord &record = decoder.get();
+    char when[40], line[128];
+    formatTime(decoder.getEpoch(), record.ticks, when, sizeof(when));
+    int lineLength = json ? snprintf(line, sizeof(line), "{\"t\":\"%s\",\"e\":\"%s\",\"c\":%u,\"n\":%ld}", when, kindNames[record.kind], record.confidence, (long)record.count)
+                          : snprintf(line, sizeof(line), "%s,%s,%u,%ld", when, kindNames[record.kind], record.confidence, (long)record.count);
+    puts(line);
+    outputBytes += lineLength;
+    found++;
+  }
+
+  if (decoder.failed() || !decoder.atRecordBoundary()) {
+    if (!found) {                                   // Base64, but not a history - some other event
+      skipped++;
+      return;
+    }
+    fprintf(stderr, "Batch %lu is cut short after %lu records\n", (unsigned long)batches + 1, (unsigned long)found);
+  }
+
+  batches++;
+  records += found;
+  base64Bytes += strlen(text);
+  binaryBytes += length;
+  haveLast = true;
+  last = decoder.get();
+  lastEpoch = decoder.getEpoch();
+}
+
+static void decodeFile(FILE *file) {
+  char line[2048];
+  while (fgets(line, sizeof(line), file)) {
+    char *end = line + strlen(line);
+    while (end > line && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ')) *--end = '\0';
+    char *word = strrchr(line, ' ');
+    decodeBatch(word ? word + 1 : line);
+  }
+}
+
+int main(int argc, char **argv) {
+  int files = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--json")) json = true;
+  }
+  if (!json) puts("time,kind,confidence,count");
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--json")) continue;
+    FILE *file = fopen(argv[i], "r");
+    if (!file) {
+      fprintf(stderr, "Cannot read %s\n", argv[i]);
+      return 2;
+    }
+    decodeFile(file);
+    fclose(file);
+    files++;
+  }
+  if (!files) decodeFile(stdin);
+
+  fprintf(stderr, "%lu records from %lu batches (%lu lines skipped, %lu gaps) - %llu bytes binary, %llu base64, %llu as %s",
+          (unsigned long)records, (unsigned long)batches, (unsigned long)skipped, (unsigned long)gaps, (unsigned long long)binaryBytes,
+          (unsigned long long)base64Bytes, (unsigned long long)outputBytes, json ? "JSON" : "CSV");
+  if (records) fprintf(stderr, " - %.2f / %.2f / %.1f bytes per record", (double)binaryBytes / records, (double)base64Bytes / records, (double)outputBytes / records);
+  fprintf(stderr, "\n");
+  return gaps ? 1 : 0;
+}
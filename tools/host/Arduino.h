@@ -0,0 +1,2 @@
+// Host Stand-in - the Arduino API is the Particle API on host builds
+#include "Particle.h"
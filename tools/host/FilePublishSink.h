@@ -0,0 +1,31 @@
+// File Publish Sink
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// PublishSink that appends each event to a file as "<millis> <event> <data>" - one line per publish
+// Use: static FilePublishSink cloud("events.log"); CloudPublisher::instance().setSink(&cloud); before setup()
+
+#ifndef __FILEPUBLISHSINK_H
+#define __FILEPUBLISHSINK_H
+
+#include "CloudPublisher.h"
+
+class FilePublishSink : public PublishSink {
+public:
+    explicit FilePublishSink(const char *path) { file = fopen(path, "a"); }
+    ~FilePublishSink() { if (file) fclose(file); }
+
+    bool connected() override { return file != NULL; }
+
+    bool publish(const char *event, const char *data) override {
+        if (!file) return false;
+        fprintf(file, "%lu %s %s\n", millis(), event, data);
+        fflush(file);
+        return true;
+    }
+
+private:
+    FILE *file;
+};
+
+#endif  /* __FILEPUBLISHSINK_H */
@@ -0,0 +1,44 @@
+// File Storage Backend
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// PersistenceBackend over a fixed size file so PersistentStore survives host runs the way flash survives a power cycle
+// Use: static FileStorageBackend storage("state.bin"); PersistentStore::instance().setBackend(&storage); before setup()
+
+#ifndef __FILESTORAGEBACKEND_H
+#define __FILESTORAGEBACKEND_H
+
+#include "PersistentStore.h"
+
+class FileStorageBackend : public PersistenceBackend {
+public:
+    explicit FileStorageBackend(const char *path, size_t bytes = 4096) : length(bytes) {
+        file = fopen(path, "r+b");
+        if (!file) {                                // New file - erased like fresh flash
+            file = fopen(path, "w+b");
+            for (size_t i = 0; file && i < length; i++) fputc(0xFF, file);
+        }
+    }
+    ~FileStorageBackend() { if (file) fclose(file); }
+
+    size_t size() override { return file ? length : 0; }
+
+    void read(size_t offset, uint8_t *data, size_t count) override {
+        memset(data, 0xFF, count);
+        if (!file || fseek(file, (long)offset, SEEK_SET) != 0) return;
+        size_t got = fread(data, 1, count, file);
+        (void)got;                                  // Short reads past the end stay erased
+    }
+
+    void write(size_t offset, const uint8_t *data, size_t count) override {
+        if (!file || fseek(file, (long)offset, SEEK_SET) != 0) return;
+        fwrite(data, 1, count, file);
+        fflush(file);
+    }
+
+private:
+    FILE *file;
+    size_t length;
+};
+
+#endif  /* __FILESTORAGEBACKEND_H */
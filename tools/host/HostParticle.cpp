@@ -0,0 +1,155 @@
+// Host Stand-in for the Particle Device OS API
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// Implementation of the pieces of tools/host/Particle.h that are not inline
+
+#include <stdarg.h>
+#include <chrono>
+#include <thread>
+#include "Particle.h"
+
+Logger Log;
+LogLevel Logger::level = LOG_LEVEL_INFO;
+USBSerial Serial;
+SystemClass System;
+TimeClass Time;
+TwoWire Wire;
+EEPROMClass EEPROM;
+CloudClass Particle;
+
+static bool manualClock = false;
+static uint64_t manualMicros = 0;
+static const std::chrono::steady_clock::time_point hostStart = std::chrono::steady_clock::now();
+static uint8_t pinValues[32];
+
+unsigned long millis() {
+  if (manualClock) return (unsigned long)(manualMicros / 1000);
+  return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - hostStart).count();
+}
+
+unsigned long micros() {
+  if (manualClock) return (unsigned long)manualMicros;
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - hostStart).count();
+}
+
+void delay(unsigned long ms) {
+  if (manualClock) manualMicros += (uint64_t)ms * 1000;
+  else std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+  if (manualClock) manualMicros += us;
+  else std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void hostSetMillis(unsigned long ms) {
+  manualClock = true;
+  manualMicros = (uint64_t)ms * 1000;
+}
+
+void hostAdvanceMillis(unsigned long ms) {
+  manualClock = true;
+  manualMicros += (uint64_t)ms * 1000;
+}
+
+void hostAdvanceMicros(unsigned long us) {
+  manualClock = true;
+  manualMicros += us;
+}
+
+void pinMode(uint16_t pin, PinMode mode) {
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint16_t pin, uint8_t value) {
+  if (pin < sizeof(pinValues)) pinValues[pin] = value;
+}
+
+int32_t digitalRead(uint16_t pin) {
+  return (pin < sizeof(pinValues)) ? pinValues[pin] : 0;
+}
+
+static void hostLog(LogLevel level, const char *label, const char *format, va_list args) {
+  if (level < Logger::level) return;
+  printf("%010lu [app] %s: ", millis(), label);
+  vprintf(format, args);
+  printf("\n");
+}
+
+void Logger::trace(const char *format, ...) const { va_list args; va_start(args, format); hostLog(LOG_LEVEL_TRACE, "TRACE", format, args); va_end(args); }
+void Logger::info(const char *format, ...) const { va_list args; va_start(args, format); hostLog(LOG_LEVEL_INFO, "INFO", format, args); va_end(args); }
+void Logger::warn(const char *format, ...) const { va_list args; va_start(args, format); hostLog(LOG_LEVEL_WARN, "WARN", format, args); va_end(args); }
+void Logger::error(const char *format, ...) const { va_list args; va_start(args, format); hostLog(LOG_LEVEL_ERROR, "ERROR", format, args); va_end(args); }
+
+size_t Print::printf(const char *format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  return write((const uint8_t *)buffer, (length < (int)sizeof(buffer)) ? length : sizeof(buffer) - 1);
+}
+
+size_t Print::printlnf(const char *format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  size_t written = write((const uint8_t *)buffer, (length < (int)sizeof(buffer)) ? length : sizeof(buffer) - 1);
+  return written + println();
+}
+
+// The first two bytes of every transaction are the 16 bit register index, the rest is data
+size_t TwoWire::write(uint8_t c) {
+  if (txLength >= sizeof(txBuffer)) return 0;
+  txBuffer[txLength++] = c;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *buffer, size_t size) {
+  size_t written = 0;
+  while (written < size && write(buffer[written])) written++;
+  return written;
+}
+
+// On a manual clock a transaction takes as long as it would on the wire - 9 clocks a byte, address byte included
+void TwoWire::chargeBusTime(size_t bytes) {
+  if (manualClock) manualMicros += (uint64_t)(bytes + 1) * 9 * 1000000 / speed;
+}
+
+uint8_t TwoWire::endTransmission(bool stop) {
+  (void)stop;
+  chargeBusTime(txLength);
+  if (!registers) return 2;                         // NACK on address - nothing attached
+  if (held) {                                       // Bus error - SDA never went high, reported after the bus timeout
+    delay(1);
+    return 4;
+  }
+  if (txLength >= 2) pointer = (uint16_t)(txBuffer[0] << 8 | txBuffer[1]);
+  for (uint8_t i = 2; i < txLength; i++) {
+    if (pointer < registerCount) registers[pointer] = txBuffer[i];
+    if (writeHook) writeHook(pointer, txBuffer[i]);
+    pointer++;
+  }
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t stop) {
+  (void)address;
+  (void)stop;
+  if (!registers) return 0;
+  if (held) {
+    delay(1);
+    return 0;
+  }
+  if (quantity > sizeof(rxBuffer)) quantity = sizeof(rxBuffer);
+  chargeBusTime(quantity);
+  if (readHook) readHook(pointer, quantity);
+  for (uint8_t i = 0; i < quantity; i++) rxBuffer[i] = (pointer + i < registerCount) ? registers[pointer + i] : 0;
+  rxLength = quantity;
+  rxIndex = 0;
+  return quantity;
+}
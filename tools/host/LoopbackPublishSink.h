@@ -0,0 +1,58 @@
+// Loopback Publish Sink
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// PublishSink that keeps the last few events in memory so a test or simulation can look at what would have gone to the cloud
+// The connection and the outcome of the next publishes can be set to exercise the queue, rate limit and backoff
+// Use: static LoopbackPublishSink cloud; CloudPublisher::instance().setSink(&cloud); before setup()
+
+#ifndef __LOOPBACKPUBLISHSINK_H
+#define __LOOPBACKPUBLISHSINK_H
+
+#include "CloudPublisher.h"
+
+class LoopbackPublishSink : public PublishSink {
+public:
+    static const int HISTORY = 8;
+
+    bool connected() override { return online; }
+    void connect() override { connectRequests++; if (connectOnRequest) online = true; }
+
+    bool publish(const char *event, const char *data) override {
+        attempts++;
+        if (failNext) {
+            failNext--;
+            return false;
+        }
+        Event &slot = history[published % HISTORY];
+        snprintf(slot.name, sizeof(slot.name), "%s", event);
+        snprintf(slot.data, sizeof(slot.data), "%s", data);
+        slot.at = millis();
+        published++;
+        return true;
+    }
+
+    /**
+     * @brief An event by age - 0 is the newest, NULL if it has been overwritten or never happened
+     */
+    const char *getData(int age) const {
+        if (age < 0 || age >= HISTORY || age >= (int)published) return NULL;
+        return history[(published - 1 - age) % HISTORY].data;
+    }
+
+    struct Event {
+        char name[64];
+        char data[PUBLISH_DATA_LENGTH];
+        unsigned long at;
+    };
+
+    bool online = true;
+    bool connectOnRequest = true;           // connect() succeeds at once
+    int failNext = 0;                       // The next publishes that fail
+    uint32_t attempts = 0;
+    uint32_t published = 0;
+    uint32_t connectRequests = 0;
+    Event history[HISTORY];
+};
+
+#endif  /* __LOOPBACKPUBLISHSINK_H */
@@ -0,0 +1,211 @@
+// Host Stand-in for the Particle Device OS API
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// Just enough of Particle.h for the firmware sources in /src to compile and run on a desktop for benchmarks and tools
+// The clock can run in real time (default) or be driven by the caller with hostSetMillis() for simulations
+
+#ifndef __HOST_PARTICLE_H
+#define __HOST_PARTICLE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef uint16_t pin_t;
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+#define HIGH 1
+#define LOW 0
+
+enum PinMode { INPUT, OUTPUT, INPUT_PULLUP, INPUT_PULLDOWN, OUTPUT_OPEN_DRAIN };
+enum { D0, D1, D2, D3, D4, D5, D6, D7, D8, A0 = 19, A1, A2, A3, A4, A5 };
+#define LED_BUILTIN D7
+#define SDA D0
+#define SCL D1
+
+#define retained                                    // Host memory is never retained across runs
+#define STARTUP(x)
+#define SYSTEM_MODE(x)
+#define SYSTEM_THREAD(x)
+#define waitFor(condition, timeout) (void)0
+
+// Time - real time unless the caller takes control with hostSetMillis()
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void hostSetMillis(unsigned long ms);               // Switches the clock to manual and sets it
+void hostAdvanceMillis(unsigned long ms);
+void hostAdvanceMicros(unsigned long us);
+
+// GPIO - outputs are recorded so tools can look at them
+void pinMode(uint16_t pin, PinMode mode);
+void digitalWrite(uint16_t pin, uint8_t value);
+int32_t digitalRead(uint16_t pin);
+
+template <class T> T constrain(T x, T low, T high) { return (x < low) ? low : ((x > high) ? high : x); }
+
+enum LogLevel { LOG_LEVEL_ALL = 1, LOG_LEVEL_TRACE = 1, LOG_LEVEL_INFO = 30, LOG_LEVEL_WARN = 40, LOG_LEVEL_ERROR = 50, LOG_LEVEL_NONE = 70 };
+
+class Logger {
+public:
+    void trace(const char *format, ...) const __attribute__((format(printf, 2, 3)));
+    void info(const char *format, ...) const __attribute__((format(printf, 2, 3)));
+    void warn(const char *format, ...) const __attribute__((format(printf, 2, 3)));
+    void error(const char *format, ...) const __attribute__((format(printf, 2, 3)));
+    static LogLevel level;                          // Messages below this level are discarded (LOG_LEVEL_INFO by default)
+};
+extern Logger Log;
+
+class SerialLogHandler {
+public:
+    SerialLogHandler(LogLevel level = LOG_LEVEL_INFO) { Logger::level = level; }
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+    virtual size_t write(const uint8_t *buffer, size_t size) { return fwrite(buffer, 1, size, stdout); }
+    size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t println(const char *s) { return print(s) + print("\r\n"); }
+    size_t println() { return print("\r\n"); }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    size_t printlnf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+};
+
+class USBSerial : public Stream {
+public:
+    void begin(long baud = 9600) { (void)baud; }
+    bool isConnected() { return true; }
+    int availableForWrite() { return 64; }
+};
+extern USBSerial Serial;
+
+class SystemClass {
+public:
+    void reset() { fprintf(stderr, "System.reset() called on host\n"); exit(1); }
+    uint32_t uptime() { return millis() / 1000; }
+    uint32_t freeMemory() { return 0; }
+    int resetReason() { return 0; }
+};
+extern SystemClass System;
+
+class TimeClass {
+public:
+    bool isValid() { return true; }
+    time_t now() { return hostEpoch + millis() / 1000; }
+    time_t hostEpoch = 1685577600;                  // 2023-06-01 - simulations start on a known day
+};
+extern TimeClass Time;
+
+/**
+ * @brief Wiring String - only what the cloud function handlers use
+ */
+class String {
+public:
+    String(const char *s = "") : text(s ? s : "") {}
+    const char *c_str() const { return text.c_str(); }
+    unsigned int length() const { return text.length(); }
+    long toInt() const { return atol(text.c_str()); }
+private:
+    std::string text;
+};
+
+enum PublishFlag { PUBLIC = 0, PRIVATE = 1, NO_ACK = 2, WITH_ACK = 8 };
+
+/**
+ * @brief The cloud is never connected on a host - functions and variables register, publishes print to stdout
+ *
+ * Code that publishes through a replaceable sink (CloudPublisher) should be given a sink from tools/host instead
+ */
+class CloudClass {
+public:
+    bool connected() { return false; }
+    void connect() {}
+    void disconnect() {}
+    void process() {}
+    template <class... Args> bool function(const char *name, Args...) { (void)name; return true; }
+    template <class... Args> bool variable(const char *name, Args...) { (void)name; return true; }
+    bool publish(const char *name, const char *data = "", int flags = 0) { (void)flags; printf("%010lu [publish] %s: %s\n", millis(), name, data); return true; }
+};
+extern CloudClass Particle;
+
+/**
+ * @brief EEPROM emulation in host memory - starts erased (0xFF) on every run
+ */
+class EEPROMClass {
+public:
+    size_t length() { return sizeof(bytes); }
+    uint8_t read(int address) { return (address >= 0 && address < (int)sizeof(bytes)) ? bytes[address] : 0xFF; }
+    void write(int address, uint8_t value) { if (address >= 0 && address < (int)sizeof(bytes)) bytes[address] = value; }
+    EEPROMClass() { memset(bytes, 0xFF, sizeof(bytes)); }
+private:
+    uint8_t bytes[4096];
+};
+extern EEPROMClass EEPROM;
+
+/**
+ * @brief I2C master that talks to a register file in host memory instead of a device
+ *
+ * Point it at a buffer with attachRegisters() - writes land in the buffer, reads come from it (16 bit register index).
+ * A write hook sees every register byte after it is stored, so a device model can react (start a measurement, clear an interrupt),
+ * and a read hook runs before a read is answered, so it can post a result that has become due.
+ * On a manual clock every transaction advances the clock by its time on the wire at setSpeed() (100kHz, as Device OS).
+ * holdBus() models a slave holding SDA low - every transaction fails until reset() clocks it free.
+ */
+class TwoWire : public Stream {
+public:
+    void begin() {}
+    void end() {}
+    void setSpeed(uint32_t clockSpeed) { speed = clockSpeed ? clockSpeed : 100000; }
+    bool isEnabled() { return true; }
+    void reset() { held = false; }
+    void holdBus() { held = true; }
+    void attachRegisters(uint8_t *buffer, size_t size) { registers = buffer; registerCount = size; }
+    void setWriteHook(void (*hook)(uint16_t reg, uint8_t value)) { writeHook = hook; }
+    void setReadHook(void (*hook)(uint16_t reg, uint8_t count)) { readHook = hook; }
+
+    void beginTransmission(uint8_t address) { (void)address; txLength = 0; }
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    uint8_t endTransmission(bool stop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t stop = true);
+    int available() override { return rxLength - rxIndex; }
+    int read() override { return (rxIndex < rxLength) ? rxBuffer[rxIndex++] : -1; }
+
+private:
+    uint8_t *registers = NULL;
+    bool held = false;
+    size_t registerCount = 0;
+    void (*writeHook)(uint16_t reg, uint8_t value) = NULL;
+    void (*readHook)(uint16_t reg, uint8_t count) = NULL;
+    uint32_t speed = 100000;
+    uint16_t pointer = 0;
+    uint8_t txBuffer[34];
+    uint8_t txLength = 0;
+    uint8_t rxBuffer[32];
+    uint8_t rxLength = 0;
+    uint8_t rxIndex = 0;
+
+    void chargeBusTime(size_t bytes);
+};
+extern TwoWire Wire;
+
+#endif  /* __HOST_PARTICLE_H */
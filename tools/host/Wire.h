@@ -0,0 +1,2 @@
+// Host Stand-in - TwoWire lives in Particle.h on host builds
+#include "Particle.h"
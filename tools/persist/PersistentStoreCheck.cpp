@@ -0,0 +1,139 @@
+// Persistent Store Check
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// Runs PersistentStore against FileStorageBackend and checks that a torn or corrupted flash write falls back to the
+// record before it - for the rotating state slots and for the two-slot configuration blocks.
+// Each boot is a forked child process so it starts from nothing but the file, as a cold boot starts from nothing but flash.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=gnu++17 -Itools/host -Isrc tools/persist/PersistentStoreCheck.cpp tools/host/HostParticle.cpp
+//       src/PersistentStore.cpp -o persist_check && ./persist_check [state.bin]
+//
+// Exits 0 if every check passed, 1 otherwise.
+
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Particle.h"
+#include "PersistentStore.h"
+#include "FileStorageBackend.h"
+
+#define CHECK_SAVES 11                              // More than PERSIST_FLASH_SLOTS so the slots have rotated
+#define CHECK_BLOCK 0
+#define CHECK_BLOCK_SAVES 3
+
+static const char *path = "persist-check.bin";
+static int failures = 0;
+
+struct CheckBlock {                                 // Stands in for the configuration block
+  uint32_t value;
+  uint8_t filler[40];
+};
+
+static void check(bool passed, const char *what) {
+  printf("  %-60s %s\n", what, passed ? "ok" : "FAILED");
+  if (!passed) failures++;
+}
+
+// Runs one boot in a child process - true if it returned true
+template <class Boot>
+static bool boot(Boot body) {
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0) {
+    static FileStorageBackend storage(path);
+    PersistentStore::instance().setBackend(&storage);
+    PersistentStore::instance().setup();
+    bool passed = body(PersistentStore::instance());
+    fflush(stdout);
+    _exit(passed ? 0 : 1);
+  }
+  int status = 0;
+  if (child < 0 || waitpid(child, &status, 0) != child) return false;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Flips bytes in the middle of a slot - what a write cut off by a power loss leaves behind
+static bool corrupt(size_t offset, size_t length) {
+  FILE *file = fopen(path, "r+b");
+  if (!file) return false;
+  uint8_t bytes[PERSIST_BLOCK_SIZE];
+  bool ok = fseek(file, (long)offset, SEEK_SET) == 0 && fread(bytes, 1, length, file) == length;
+  for (size_t i = length / 4; i < length / 2; i++) bytes[i] ^= 0x5A;
+  ok = ok && fseek(file, (long)offset, SEEK_SET) == 0 && fwrite(bytes, 1, length, file) == length;
+  fclose(file);
+  return ok;
+}
+
+static size_t stateOffset(uint32_t sequence) {
+  return PERSIST_FLASH_OFFSET + (sequence % PERSIST_FLASH_SLOTS) * PERSIST_SLOT_SIZE;
+}
+
+static size_t blockOffset(uint8_t block, uint8_t slot) {
+  return PERSIST_FLASH_OFFSET + PERSIST_FLASH_SLOTS * PERSIST_SLOT_SIZE + (block * 2 + slot) * PERSIST_BLOCK_SIZE;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) path = argv[1];
+  remove(path);
+  Logger::level = LOG_LEVEL_WARN;
+
+  printf("Rotating state slots (%d slots, %d saves)\n", PERSIST_FLASH_SLOTS, CHECK_SAVES);
+  check(boot([](PersistentStore &store) {
+    if (store.getRestoreSource() != PersistentStore::RESTORE_NONE) return false;
+    for (int i = 1; i <= CHECK_SAVES; i++) {
+      store.state().occupancyCount = i * 10;
+      store.save();
+    }
+    return true;
+  }), "fresh file starts from defaults and takes every save");
+
+  check(boot([](PersistentStore &store) {
+    return store.getRestoreSource() == PersistentStore::RESTORE_FLASH && store.state().occupancyCount == CHECK_SAVES * 10;
+  }), "cold boot restores the newest record");
+
+  check(corrupt(stateOffset(CHECK_SAVES), PERSIST_SLOT_SIZE), "newest slot corrupted");
+  check(boot([](PersistentStore &store) {
+    if (store.getRestoreSource() != PersistentStore::RESTORE_FLASH || store.state().occupancyCount != (CHECK_SAVES - 1) * 10) return false;
+    store.state().occupancyCount = 500;             // The next save goes over the corrupted slot, not the one we fell back to
+    store.save();
+    return true;
+  }), "cold boot falls back to the record before it");
+
+  check(boot([](PersistentStore &store) {
+    return store.state().occupancyCount == 500;
+  }), "a save after the fallback is the newest again");
+
+  printf("Two-slot configuration block (%d saves)\n", CHECK_BLOCK_SAVES);
+  check(boot([](PersistentStore &store) {
+    CheckBlock block = {};
+    for (uint32_t i = 1; i <= CHECK_BLOCK_SAVES; i++) {
+      block.value = i;
+      if (!store.saveBlock(CHECK_BLOCK, &block, sizeof(block))) return false;
+    }
+    return true;
+  }), "block saves");
+
+  check(boot([](PersistentStore &store) {
+    CheckBlock block = {};
+    return store.loadBlock(CHECK_BLOCK, &block, sizeof(block)) && block.value == CHECK_BLOCK_SAVES;
+  }), "cold boot loads the newest block");
+
+  check(corrupt(blockOffset(CHECK_BLOCK, CHECK_BLOCK_SAVES & 1), PERSIST_BLOCK_SIZE), "newest block slot corrupted");
+  check(boot([](PersistentStore &store) {
+    CheckBlock block = {};
+    return store.loadBlock(CHECK_BLOCK, &block, sizeof(block)) && block.value == CHECK_BLOCK_SAVES - 1;
+  }), "cold boot falls back to the block before it");
+
+  check(corrupt(blockOffset(CHECK_BLOCK, (CHECK_BLOCK_SAVES - 1) & 1), PERSIST_BLOCK_SIZE), "other block slot corrupted");
+  check(boot([](PersistentStore &store) {
+    CheckBlock block = {};
+    block.value = 77;
+    return !store.loadBlock(CHECK_BLOCK, &block, sizeof(block)) && block.value == 77;
+  }), "with both slots bad the caller's defaults are left alone");
+
+  remove(path);
+  printf("\n%s\n", failures ? "FAILED" : "All checks passed");
+  return failures ? 1 : 0;
+}
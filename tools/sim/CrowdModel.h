@@ -0,0 +1,368 @@
+// Crowd Model
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// People walking through the doorway under the sensor, and what a ROI sees of them
+// Each person is a box (shoulder width x body depth x height) with a reflectivity, walking straight through at a constant speed
+// (or turning back part way). A ROI is sampled as a grid of rays from the sensor - a ray returns from the first person it
+// meets on the way down, otherwise from the floor - and the returns are averaged into a signal per SPAD and a distance.
+//
+// Coordinates are mm with the sensor at the origin looking down: x runs through the door (positive toward the outer / back zone,
+// which is SPAD column 15), y runs across it. Entering is walking from +x to -x, so the outer zone fills first.
+// A door can be added: a leaf hinged in the door frame beyond the outer zone that swings into the room, sweeping through both
+// zones on the way open and again on the way closed, now and then and with nobody walking through.
+
+#ifndef __CROWDMODEL_H
+#define __CROWDMODEL_H
+
+#include <math.h>
+#include <random>
+#include <vector>
+#include "TofSensorConfig.h"
+#include "PeopleCounterConfig.h"
+
+namespace crowd {
+
+/**
+ * @brief How people arrive
+ */
+enum Pattern {
+    PATTERN_POISSON,                        // Independent arrivals, direction by inboundShare
+    PATTERN_BURST,                          // Groups of burstSize walking in file (a class letting out)
+    PATTERN_BIDIRECTIONAL,                  // Two opposing streams, keeping to their own side of the door
+    PATTERN_TAILGATE                        // Poisson, and each person may have someone close behind
+};
+
+struct Workload {
+    Pattern pattern = PATTERN_POISSON;
+    double peoplePerMinute = 10;
+    double inboundShare = 0.5;              // Fraction walking in
+    int burstSize = 5;
+    double tailgateProbability = 0.3;
+    double tailgateGapMm = 500;             // Chest to back of the person in front
+    double abortProbability = 0.05;         // Walks in under the zones and turns back
+    double walkingSpeed = 1300;             // mm/s, mean - spread is 20%
+};
+
+struct Person {
+    double spawnedAt;                       // ms
+    double x0, y;                           // Start position
+    double speed;                           // mm/s along x, signed
+    double turnAt;                          // ms after spawning that the person turns back (0 - walks through)
+    double height, width, depth;
+    double reflectivity;
+    int direction;                          // 1 in, -1 out
+    bool overlapped;                        // Someone else was under the sensor at the same time
+};
+
+struct Sample {
+    uint16_t signalPerSpad;                 // kcps/SPAD
+    uint16_t distance;                      // mm
+    uint16_t ambientPerSpad;
+    uint8_t spadCount;
+};
+
+struct Truth {
+    uint32_t arrivals = 0;
+    uint32_t entries = 0;
+    uint32_t exits = 0;
+    uint32_t aborted = 0;
+    uint32_t overlapped = 0;                // Entries and exits that shared the field of view with someone else
+    uint32_t doorSwings = 0;
+};
+
+static const double WALK_START_MM = 1500;   // People appear and leave this far either side of the sensor
+static const double SIGNAL_SCALE = 220;     // kcps/SPAD for a reflectivity of 1 at 1m
+static const double FLOOR_REFLECTIVITY = 0.3;
+static const double QUEUE_SPACING_MM = 1200; // Walking in file - a stride and a body behind the person in front, center to center
+static const double DOOR_FRAME_X_MM = 600;  // The closed leaf lies across the door here - outside the field of view
+static const double DOOR_WIDTH_MM = 900;    // Hinged at y = -DOOR_WIDTH_MM / 2
+static const double DOOR_HEIGHT_MM = 2000;
+static const double DOOR_THICKNESS_MM = 40;
+static const double DOOR_REFLECTIVITY = 0.6;
+static const int DOOR_SEGMENTS = 6;         // The leaf is traced as this many axis aligned boxes
+static const double DOOR_OPENING_MS = 1200; // Pushed open, held while nobody walks through, then pulled shut by the closer
+static const double DOOR_OPEN_MS = 2000;
+static const double DOOR_CLOSING_MS = 2500;
+
+class Crowd {
+public:
+    explicit Crowd(uint32_t seed = 1) : random(seed), doorRandom(seed + 1000), noiseRandom(seed + 2000) {}
+
+    void setWorkload(const Workload &newWorkload) { workload = newWorkload; }
+    void setArrivals(bool enabled) { arriving = enabled; }
+    void setDoorSwings(double perMinute) { doorSwingsPerMinute = perMinute; }
+    void start(double now) {
+        nextArrival = now + interarrival();
+        nextSwing = now + swingInterval();
+    }
+
+    /**
+     * @brief Spawns arrivals that are due and retires people who have left - call as simulated time moves
+     */
+    void update(double now) {
+        while (arriving && now >= nextArrival) {
+            arrive(nextArrival);
+            nextArrival += interarrival();
+        }
+        int inView = 0;                                                   // Two under the sensor at once - the zones see one shape
+        for (const Person &person : people) if (underSensor(person, now)) inView++;
+        if (inView > 1) {
+            for (Person &person : people) if (underSensor(person, now)) person.overlapped = true;
+        }
+        if (arriving && doorSwingsPerMinute > 0 && now >= nextSwing && swingStarted < 0) {
+            swingStarted = nextSwing;
+            truth.doorSwings++;
+        }
+        if (swingStarted >= 0 && now - swingStarted >= DOOR_OPENING_MS + DOOR_OPEN_MS + DOOR_CLOSING_MS) {
+            nextSwing = swingStarted + DOOR_OPENING_MS + DOOR_OPEN_MS + DOOR_CLOSING_MS + swingInterval();
+            swingStarted = -1;
+        }
+        for (size_t i = 0; i < people.size(); ) {
+            const Person &person = people[i];
+            double x = position(person, now);
+            bool turned = person.turnAt && now - person.spawnedAt > person.turnAt;
+            bool gone = turned ? (fabs(x) >= WALK_START_MM) : (person.direction * x <= -WALK_START_MM);
+            if (!gone) { i++; continue; }
+            if (turned) truth.aborted++;
+            else if (person.direction > 0) truth.entries++;
+            else truth.exits++;
+            if (!turned && person.overlapped) truth.overlapped++;
+            people[i] = people.back();
+            people.pop_back();
+        }
+    }
+
+    /**
+     * @brief What the ROI at opticalCenter (columns x rows SPADs) sees at time now
+     */
+    Sample sample(uint8_t opticalCenter, int columns, int rows, double now) {
+        int row, column;
+        spadPosition(opticalCenter, row, column);
+        int columnLow = column - columns / 2, rowLow = row - rows / 2;     // The center SPAD is right of and above the middle
+
+        double sum = 0, hitDistance = 0;
+        int hits = 0, rays = 0;
+        for (int i = 0; i < columns * 2; i++) {
+            double tanX = tan(((columnLow + (i + 0.5) / 2.0) - 8.0) * SPAD_PITCH_DEGREES * M_PI / 180.0);
+            for (int j = 0; j < rows * 2; j++) {
+                double tanY = tan(((rowLow + (j + 0.5) / 2.0) - 8.0) * SPAD_PITCH_DEGREES * M_PI / 180.0);
+                double range = SENSOR_MOUNT_HEIGHT_MM, reflectivity = FLOOR_REFLECTIVITY;
+                for (const Person &person : people) {
+                    double t = rayHit(person, tanX, tanY, now);
+                    if (t > 0 && t < range) {
+                        range = t;
+                        reflectivity = person.reflectivity;
+                    }
+                }
+                double t = (swingStarted >= 0) ? doorHit(doorAngle(now), tanX, tanY) : 0;
+                if (t > 0 && t < range) {
+                    range = t;
+                    reflectivity = DOOR_REFLECTIVITY;
+                }
+                double meters = range / 1000.0;
+                double ray = SIGNAL_SCALE * reflectivity / (meters * meters);
+                sum += (ray > 400) ? 400 : ray;
+                if (range < SENSOR_MOUNT_HEIGHT_MM) {
+                    hits++;
+                    hitDistance += range;
+                }
+                rays++;
+            }
+        }
+
+        std::normal_distribution<double> noise(0.0, 1.0);
+        double signal = (sum / rays) * (1.0 + 0.03 * noise(noiseRandom)) + 0.5 * noise(noiseRandom);
+        Sample result;
+        result.signalPerSpad = (signal < 1) ? 1 : (uint16_t)signal;
+        result.distance = (hits * 10 >= rays * 3) ? (uint16_t)(hitDistance / hits) : (uint16_t)SENSOR_MOUNT_HEIGHT_MM;    // The person dominates from 30% cover
+        result.ambientPerSpad = 2;
+        result.spadCount = (uint8_t)(columns * rows);
+        return result;
+    }
+
+    // Same optical center table as TofSensorConfig.h
+    static void spadPosition(uint8_t center, int &row, int &column) {
+        if (center >= 128) {
+            column = (center - 128) / 8;
+            row = (center - 128) % 8;
+        }
+        else {
+            column = (127 - center) / 8;
+            row = 8 + (127 - center) % 8;
+        }
+    }
+
+    const Truth &getTruth() const { return truth; }
+    size_t getPresent() const { return people.size(); }
+
+private:
+    double interarrival() {
+        double rate = workload.peoplePerMinute / 60000.0;                 // per ms
+        if (workload.pattern == PATTERN_BURST) rate /= workload.burstSize;
+        std::exponential_distribution<double> gap(rate);
+        return gap(random);
+    }
+
+    double swingInterval() {
+        if (doorSwingsPerMinute <= 0) return 1e18;
+        std::exponential_distribution<double> gap(doorSwingsPerMinute / 60000.0);
+        return gap(doorRandom);
+    }
+
+    // Radians open - 0 is shut, pi/2 flat against the wall - easing in and out of each movement
+    double doorAngle(double now) const {
+        double elapsed = now - swingStarted, fraction;
+        if (elapsed < DOOR_OPENING_MS) fraction = elapsed / DOOR_OPENING_MS;
+        else if (elapsed < DOOR_OPENING_MS + DOOR_OPEN_MS) fraction = 1;
+        else fraction = 1 - fmin((elapsed - DOOR_OPENING_MS - DOOR_OPEN_MS) / DOOR_CLOSING_MS, 1.0);
+        return M_PI / 2 * (1 - cos(M_PI * fraction)) / 2;
+    }
+
+    // Distance along the ray to the nearest of the leaf's segment boxes - 0 for a miss
+    static double doorHit(double angle, double tanX, double tanY) {
+        double nearest = 0;
+        double stepX = -sin(angle) * DOOR_WIDTH_MM / DOOR_SEGMENTS, stepY = cos(angle) * DOOR_WIDTH_MM / DOOR_SEGMENTS;
+        for (int i = 0; i < DOOR_SEGMENTS; i++) {
+            double x = DOOR_FRAME_X_MM + stepX * (i + 0.5), y = -DOOR_WIDTH_MM / 2 + stepY * (i + 0.5);
+            double halfX = (fabs(stepX) + DOOR_THICKNESS_MM) / 2, halfY = (fabs(stepY) + DOOR_THICKNESS_MM) / 2;
+            double low = SENSOR_MOUNT_HEIGHT_MM - DOOR_HEIGHT_MM, high = SENSOR_MOUNT_HEIGHT_MM;
+            if (!slab(tanX, x - halfX, x + halfX, low, high)) continue;
+            if (!slab(tanY, y - halfY, y + halfY, low, high)) continue;
+            if (!nearest || low < nearest) nearest = low;
+        }
+        return nearest;
+    }
+
+    Person makePerson(double now, int direction) {
+        std::normal_distribution<double> speed(workload.walkingSpeed, workload.walkingSpeed * 0.2);
+        std::normal_distribution<double> height(1700, 100);
+        std::normal_distribution<double> lateral(0, 150);
+        std::uniform_real_distribution<double> unit(0, 1);
+
+        Person person;
+        person.spawnedAt = now;
+        person.direction = direction;
+        person.x0 = direction * WALK_START_MM;
+        person.speed = -direction * fmin(fmax(speed(random), 600), 2500);
+        person.y = lateral(random);
+        if (workload.pattern == PATTERN_BIDIRECTIONAL) person.y = direction * 200 + lateral(random) / 3;    // Keep to your side
+        person.height = fmin(fmax(height(random), 1450), 1950);
+        person.width = 400 + 100 * unit(random);
+        double room = (DOOR_WIDTH_MM - person.width) / 2;                 // Shoulders inside the door frame
+        person.y = fmin(fmax(person.y, -room), room);
+        person.depth = 250 + 80 * unit(random);
+        person.reflectivity = 0.05 + 0.45 * unit(random);               // Dark hair to a light hat
+        person.turnAt = 0;
+        person.overlapped = false;
+        if (unit(random) < workload.abortProbability) {                   // Turns back somewhere between the two zones
+            person.turnAt = (WALK_START_MM + 150 * (unit(random) - 0.5)) / fabs(person.speed) * 1000.0;
+        }
+        return person;
+    }
+
+    // Walking the same way close enough across the door that one has to follow the other
+    bool sameFile(const Person &person, const Person &other) const {
+        return other.direction == person.direction && (workload.pattern == PATTERN_BIDIRECTIONAL || fabs(other.y - person.y) < 400);
+    }
+
+    // People queue rather than walk through each other - a new arrival waits for room at the start line
+    bool roomAtStart(const Person &person, double now) {
+        for (const Person &other : people) {
+            if (sameFile(person, other) && fabs(position(other, now) - person.x0) < QUEUE_SPACING_MM) return false;
+        }
+        return true;
+    }
+
+    // Nor, once walking, do they catch up with the person in front
+    void keepPace(Person &person) {
+        for (const Person &other : people) {
+            if (!sameFile(person, other) || other.turnAt || other.spawnedAt > person.spawnedAt) continue;
+            if (person.direction * position(other, person.spawnedAt) <= -WALK_START_MM) continue;      // Already through
+            if (fabs(other.speed) < fabs(person.speed)) person.speed = other.speed;
+        }
+    }
+
+    void add(Person person) {
+        while (!roomAtStart(person, person.spawnedAt)) person.spawnedAt += 50;
+        keepPace(person);
+        people.push_back(person);
+        truth.arrivals++;
+    }
+
+    void arrive(double now) {
+        std::uniform_real_distribution<double> unit(0, 1);
+        int direction = (unit(random) < workload.inboundShare) ? 1 : -1;
+
+        if (workload.pattern == PATTERN_BURST) {
+            double at = now;
+            for (int i = 0; i < workload.burstSize; i++) {
+                add(makePerson(at, direction));
+                at += 800 + 700 * unit(random);                          // In file, a step or two apart
+            }
+            return;
+        }
+        Person leader = makePerson(now, direction);
+        add(leader);
+        if (workload.pattern == PATTERN_TAILGATE && unit(random) < workload.tailgateProbability) {
+            Person follower = makePerson(now, direction);
+            follower.speed = leader.speed;                               // Keeps pace
+            follower.turnAt = 0;
+            follower.y = leader.y + 50 * (unit(random) - 0.5);
+            follower.spawnedAt = now + (leader.depth / 2 + workload.tailgateGapMm + follower.depth / 2) / fabs(leader.speed) * 1000.0;
+            people.push_back(follower);                                  // Right behind - not held back by the queue rule
+            truth.arrivals++;
+        }
+    }
+
+    // Some of the person is inside the field of view's footprint on the floor
+    static bool underSensor(const Person &person, double now) {
+        static const double footprint = SENSOR_MOUNT_HEIGHT_MM * tan(8 * SPAD_PITCH_DEGREES * M_PI / 180.0);
+        return now >= person.spawnedAt && fabs(position(person, now)) - person.depth / 2 < footprint;
+    }
+
+    static double position(const Person &person, double now) {
+        double elapsed = now - person.spawnedAt;
+        if (elapsed < 0) return person.x0;
+        if (person.turnAt && elapsed > person.turnAt) return person.x0 + person.speed * (2 * person.turnAt - elapsed) / 1000.0;
+        return person.x0 + person.speed * elapsed / 1000.0;
+    }
+
+    // Distance along the ray (mm from the sensor) to the first point inside the person's box - 0 for a miss
+    static double rayHit(const Person &person, double tanX, double tanY, double now) {
+        if (now < person.spawnedAt) return 0;
+        double x = position(person, now);
+        double low = SENSOR_MOUNT_HEIGHT_MM - person.height, high = SENSOR_MOUNT_HEIGHT_MM;
+        if (!slab(tanX, x - person.depth / 2, x + person.depth / 2, low, high)) return 0;
+        if (!slab(tanY, person.y - person.width / 2, person.y + person.width / 2, low, high)) return 0;
+        return low;
+    }
+
+    // Narrows [low, high] to the depths at which t * slope lies between from and to
+    static bool slab(double slope, double from, double to, double &low, double &high) {
+        if (fabs(slope) < 1e-9) return from <= 0 && to >= 0;
+        double a = from / slope, b = to / slope;
+        if (a > b) { double swap = a; a = b; b = swap; }
+        if (a > low) low = a;
+        if (b < high) high = b;
+        return low <= high;
+    }
+
+    // Separate streams so one cannot shift another - how often the firmware samples (its profile, its timing budget)
+    // changes how much noise is drawn, and must not change who walks through or when the door swings
+    std::mt19937 random;                     // Arrivals and the people themselves
+    std::mt19937 doorRandom;
+    std::mt19937 noiseRandom;
+    Workload workload;
+    std::vector<Person> people;
+    double nextArrival = 0;
+    bool arriving = true;
+    double doorSwingsPerMinute = 0;
+    double nextSwing = 0;
+    double swingStarted = -1;                // -1 - the door is shut
+    Truth truth;
+};
+
+} // namespace crowd
+
+#endif  /* __CROWDMODEL_H */
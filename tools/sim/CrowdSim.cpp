@@ -0,0 +1,298 @@
+// Crowd Simulator
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// Runs the unchanged TofSensor and PeopleCounter against a simulated sensor and a synthetic crowd at rising arrival rates,
+// and reports how accurately each rate is counted and what each frame costs - to find the people per minute a timing
+// budget and algorithm can keep up with before it goes on a busy door
+//
+// Build and run from the repository root (add -DLATERAL_SPLIT=1 for the side by side algorithm):
+//   g++ -O2 -std=gnu++17 -Itools/host -Itools/sim -Isrc tools/sim/CrowdSim.cpp tools/host/HostParticle.cpp
+//       src/TofSensor.cpp src/ZoneDecision.cpp src/PeopleCounter.cpp src/PassSequence.cpp src/ConfigStore.cpp
+//       src/PersistentStore.cpp src/EventLog.cpp src/OccupancySeries.cpp src/OccupancyLimit.cpp src/CloudPublisher.cpp
+//       src/ZonePlacement.cpp src/SensorHealth.cpp src/SignatureMask.cpp src/PowerProfile.cpp src/CrossingHistory.cpp -o crowd_sim
+//   ./crowd_sim --pattern poisson --rates 5,10,20,40,60 --minutes 5 --budget 20 [--trace frames.csv]
+//
+// Options: --pattern poisson|burst|bidirectional|tailgate, --rates <people per minute,...>, --minutes <per rate>,
+// --budget <timing budget ms>, --inbound <share walking in>, --burst <group size>, --tailgate <probability>,
+// --abort <probability>, --seed <n>, --target <accuracy for the summary, default 0.95>, --trace <file>,
+// --bus-fault <seconds> (a slave holds the I2C bus this often - SensorHealth has to recover it),
+// --glitch <probability> (a result is a flagged spike - TofSensor's sample validation has to catch it),
+// --door <swings per minute> (a door swings through both zones with nobody there - SignatureMask has to learn to ignore it),
+// --profile auto|high-traffic|balanced|low-power|calibration (PowerProfile - auto follows the traffic, the default),
+// --history <file> (CloudPublisher publishes to the file - the crossing history batches in it decode with tools/history)
+//
+// Exits 1 if SignatureMask masked anything with no door swinging - people are all it could have hidden.
+//
+// The trace is one line per frame: ms,signal1,signal2,distance1,distance2,ambient1,ambient2,trueEntries,trueExits
+// (zone 1 is the front / inner zone) - the input format for the replay tools
+
+#include <chrono>
+#include <vector>
+#include "Particle.h"
+#include "TofSensor.h"
+#include "PeopleCounter.h"
+#include "ConfigStore.h"
+#include "PersistentStore.h"
+#include "EventLog.h"
+#include "OccupancySeries.h"
+#include "SensorHealth.h"
+#include "SignatureMask.h"
+#include "PowerProfile.h"
+#include "CloudPublisher.h"
+#include "CrossingHistory.h"
+#include "FilePublishSink.h"
+#include "CrowdModel.h"
+#include "SimulatedVl53l1x.h"
+
+struct Options {
+    crowd::Workload workload;
+    std::vector<double> rates = {5, 10, 20, 40, 60};
+    double minutes = 5;
+    int budget = 20;
+    uint32_t seed = 1;
+    double target = 0.95;
+    const char *trace = NULL;
+    double busFaultSeconds = 0;
+    double glitch = 0;
+    double doorSwings = 0;
+    ProfileId profile = PROFILE_AUTO;
+    const char *history = NULL;
+};
+
+struct Counted {
+    uint32_t entries;
+    uint32_t exits;
+};
+
+static Counted counted() {
+  OccupancyBin total;
+  OccupancySeries::instance().getTotal(OccupancySeries::SERIES_DAY, SERIES_DAY_BINS, total);
+  return {total.entries, total.exits};
+}
+
+static bool parse(int argc, char **argv, Options &options) {
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *name = argv[i], *value = argv[i + 1];
+    if (!strcmp(name, "--pattern")) {
+      static const char * const patterns[] = {"poisson", "burst", "bidirectional", "tailgate"};
+      int found = -1;
+      for (int p = 0; p < 4; p++) if (!strcmp(value, patterns[p])) found = p;
+      if (found < 0) return false;
+      options.workload.pattern = (crowd::Pattern)found;
+    }
+    else if (!strcmp(name, "--rates")) {
+      options.rates.clear();
+      for (char *cursor = argv[i + 1]; *cursor; ) {
+        options.rates.push_back(strtod(cursor, &cursor));
+        if (*cursor == ',') cursor++;
+        else if (*cursor) return false;
+      }
+    }
+    else if (!strcmp(name, "--minutes")) options.minutes = atof(value);
+    else if (!strcmp(name, "--budget")) options.budget = atoi(value);
+    else if (!strcmp(name, "--inbound")) options.workload.inboundShare = atof(value);
+    else if (!strcmp(name, "--burst")) options.workload.burstSize = atoi(value);
+    else if (!strcmp(name, "--tailgate")) options.workload.tailgateProbability = atof(value);
+    else if (!strcmp(name, "--abort")) options.workload.abortProbability = atof(value);
+    else if (!strcmp(name, "--seed")) options.seed = strtoul(value, NULL, 0);
+    else if (!strcmp(name, "--target")) options.target = atof(value);
+    else if (!strcmp(name, "--trace")) options.trace = value;
+    else if (!strcmp(name, "--bus-fault")) options.busFaultSeconds = atof(value);
+    else if (!strcmp(name, "--glitch")) options.glitch = atof(value);
+    else if (!strcmp(name, "--door")) options.doorSwings = atof(value);
+    else if (!strcmp(name, "--history")) options.history = value;
+    else if (!strcmp(name, "--profile")) {
+      options.profile = PowerProfile::find(value);
+      if (options.profile == PROFILE_COUNT) return false;
+    }
+    else return false;
+  }
+  return (argc % 2) == 1 && !options.rates.empty();
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse(argc, argv, options)) {
+    fprintf(stderr, "usage: %s [--pattern poisson|burst|bidirectional|tailgate] [--rates 5,10,20] [--minutes 5] [--budget 20]\n"
+                    "       [--inbound 0.5] [--burst 5] [--tailgate 0.3] [--abort 0.05] [--seed 1] [--target 0.95] [--trace file]\n"
+                    "       [--bus-fault seconds] [--glitch probability] [--door swings per minute] [--profile auto|high-traffic|...]\n"
+                    "       [--history file]\n", argv[0]);
+    return 2;
+  }
+
+  hostSetMillis(0);
+  Logger::level = LOG_LEVEL_WARN;                   // The firmware's own logging would swamp the report
+
+  static crowd::Crowd people(options.seed);
+  people.setDoorSwings(options.doorSwings);
+  static SimulatedVl53l1x sensor(people);
+  sensor.setTimingBudget(options.budget);
+  sensor.setGlitchProbability(options.glitch);
+  sensor.attach();
+
+  char budget[48];
+  snprintf(budget, sizeof(budget), "timingBudget=%d,profile=%d", options.budget, options.profile);
+  PersistentStore::instance().setup();
+  ConfigStore::instance().setup();
+  if (ConfigStore::instance().set(budget) != 0) {
+    fprintf(stderr, "Timing budget %d is not one the sensor accepts\n", options.budget);
+    return 2;
+  }
+  ConfigStore::instance().apply();
+  EventLog::instance().setup();
+  TofSensor::instance().setup();
+  PeopleCounter::instance().setup();
+  OccupancySeries::instance().setup(PeopleCounter::instance().getCount());
+  CrossingHistory::instance().setup(PeopleCounter::instance().getCount());
+
+  static FilePublishSink *cloud = NULL;
+  if (options.history) {
+    cloud = new FilePublishSink(options.history);
+    if (!cloud->connected()) {
+      fprintf(stderr, "Cannot write %s\n", options.history);
+      return 2;
+    }
+    CloudPublisher::instance().setSink(cloud);
+    CloudPublisher::instance().setup(PeopleCounter::instance().getCount());
+  }
+
+  FILE *trace = options.trace ? fopen(options.trace, "w") : NULL;
+  if (options.trace && !trace) {
+    fprintf(stderr, "Cannot write %s\n", options.trace);
+    return 2;
+  }
+
+  unsigned long lastFrame = 0, lastBusFault = 0;
+  uint32_t frames = 0, busFaults = 0, stateChanges = 0;
+  double firmwareSeconds = 0;
+
+  // One pass of the application loop - the firmware's share of the host time is what runs outside the crowd model
+  auto step = [&]() {
+    unsigned long before = millis();
+    double modelBefore = sensor.getModelSeconds();
+    if (options.busFaultSeconds > 0 && millis() - lastBusFault >= options.busFaultSeconds * 1000.0) {
+      lastBusFault = millis();
+      if (millis() > 10000) {                       // Not while the baselines are learned
+        Wire.holdBus();
+        busFaults++;
+      }
+    }
+    auto started = std::chrono::steady_clock::now();
+    if (TofSensor::instance().loop() > 0) {
+      PeopleCounter::instance().loop();
+      stateChanges++;
+    }
+    EventLog::instance().loop();
+    if (cloud) CloudPublisher::instance().loop();
+    firmwareSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count() - (sensor.getModelSeconds() - modelBefore);
+    if (millis() == before) hostAdvanceMillis(1);   // Nothing measured (an error path) - time still moves
+
+    unsigned long frame = TofSensor::instance().getFrameTimestamp();
+    if (frame != lastFrame) {
+      lastFrame = frame;
+      frames++;
+      if (trace) {
+        const crowd::Sample &front = sensor.getLast(0), &back = sensor.getLast(1);
+        const crowd::Truth &truth = people.getTruth();
+        fprintf(trace, "%lu,%u,%u,%u,%u,%u,%u,%lu,%lu\n", frame, front.signalPerSpad, back.signalPerSpad, front.distance, back.distance,
+                front.ambientPerSpad, back.ambientPerSpad, (unsigned long)truth.entries, (unsigned long)truth.exits);
+      }
+    }
+  };
+
+  people.setArrivals(false);                        // An empty doorway while the baselines are learned
+  while (millis() < 10000) step();
+
+  printf("Pattern %d, timing budget %dms, %s, %.1f minutes per rate, seed %lu\n\n", options.workload.pattern, options.budget,
+         LATERAL_SPLIT ? "lateral split" : "single track", options.minutes, (unsigned long)options.seed);
+  printf("  rate/min  arrived  true in/out  counted in/out  turned back  overlapped  accuracy  frame ms  firmware us/frame\n");
+
+  double bestRate = 0;
+  bool allAbove = true;
+  for (double rate : options.rates) {
+    crowd::Workload workload = options.workload;
+    workload.peoplePerMinute = rate;
+    people.setWorkload(workload);
+
+    crowd::Truth truthBefore = people.getTruth();
+    Counted countedBefore = counted();
+    uint32_t framesBefore = frames;
+    double firmwareBefore = firmwareSeconds;
+    unsigned long startedAt = millis();
+
+    people.start(millis());
+    people.setArrivals(true);
+    while (millis() - startedAt < options.minutes * 60000.0) step();
+    people.setArrivals(false);
+    unsigned long drainStarted = millis();
+    while ((people.getPresent() || millis() - drainStarted < 5000) && millis() - drainStarted < 60000) step();    // Let everyone through
+
+    const crowd::Truth &truth = people.getTruth();
+    Counted now = counted();
+    uint32_t trueIn = truth.entries - truthBefore.entries, trueOut = truth.exits - truthBefore.exits;
+    uint32_t countedIn = now.entries - countedBefore.entries, countedOut = now.exits - countedBefore.exits;
+    uint32_t errors = (uint32_t)abs((int)countedIn - (int)trueIn) + (uint32_t)abs((int)countedOut - (int)trueOut);
+    double accuracy = (trueIn + trueOut) ? 1.0 - (double)errors / (trueIn + trueOut) : 1.0;
+    uint32_t rateFrames = frames - framesBefore;
+
+    printf("  %8.1f  %7lu  %5lu/%-5lu  %6lu/%-7lu  %11lu  %10lu  %7.1f%%  %8.1f  %17.2f\n", rate, (unsigned long)(truth.arrivals - truthBefore.arrivals),
+           (unsigned long)trueIn, (unsigned long)trueOut, (unsigned long)countedIn, (unsigned long)countedOut,
+           (unsigned long)(truth.aborted - truthBefore.aborted), (unsigned long)(truth.overlapped - truthBefore.overlapped), accuracy * 100.0,
+           rateFrames ? (double)(millis() - startedAt) / rateFrames : 0.0,
+           rateFrames ? (firmwareSeconds - firmwareBefore) * 1e6 / rateFrames : 0.0);
+
+    if (accuracy >= options.target && allAbove) bestRate = rate;
+    else allAbove = false;
+  }
+
+  if (bestRate > 0) printf("\nCounted at least %.0f%% correctly up to %.1f people per minute\n", options.target * 100.0, bestRate);
+  else printf("\nNo rate was counted at least %.0f%% correctly\n", options.target * 100.0);
+  if (options.glitch > 0) {
+    const TofSensor::ValidationStats &samples = TofSensor::instance().getValidationStats();
+    printf("%lu glitches - samples degraded %lu, dropped %lu, re-measured %lu; %lu state changes for PeopleCounter\n",
+           (unsigned long)sensor.getGlitches(), (unsigned long)(samples.degraded[0] + samples.degraded[1]),
+           (unsigned long)(samples.dropped[0] + samples.dropped[1]), (unsigned long)(samples.remeasured[0] + samples.remeasured[1]),
+           (unsigned long)stateChanges);
+  }
+  printf("Power profiles:");
+  for (int profile = PROFILE_HIGH_TRAFFIC; profile < PROFILE_COUNT; profile++) {
+    printf(" %s %.0f%%", PowerProfile::getName((ProfileId)profile), 100.0 * PowerProfile::instance().getTimeInMs((ProfileId)profile) / millis());
+  }
+  printf(", %lu switches\n", (unsigned long)PowerProfile::instance().getSwitches());
+  const SignatureMask::Stats &signatures = SignatureMask::instance().getStats();
+  if (options.doorSwings > 0) {
+    printf("Door swung %lu times - %u signatures learned, %lu episodes masked (%lu frames); %lu state changes for PeopleCounter\n",
+           (unsigned long)people.getTruth().doorSwings, signatures.templates, (unsigned long)signatures.maskedEpisodes,
+           (unsigned long)signatures.maskedFrames, (unsigned long)stateChanges);
+  }
+  else {                                         // Nothing but people went by - masking any of them hid a real pass
+    printf("No door - %u signatures learned, %lu episodes masked%s\n", signatures.templates, (unsigned long)signatures.maskedEpisodes,
+           signatures.maskedEpisodes ? " - FAILED, people were masked" : "");
+  }
+
+  // What the passes cost to send - the unsent tail goes out now so the file holds the whole run
+  const CrossingHistory::HistoryStats &history = CrossingHistory::instance().getStats();
+  printf("Crossing history: %lu records in %lu bytes (%.2f per record), %lu pushed out of the ring (%lu before upload)",
+         (unsigned long)history.written, (unsigned long)history.writtenBytes, history.written ? (double)history.writtenBytes / history.written : 0.0,
+         (unsigned long)history.dropped, (unsigned long)history.lost);
+  if (cloud) {
+    static char payload[PUBLISH_DATA_LENGTH];
+    for (uint16_t records; (records = CrossingHistory::instance().format(payload, sizeof(payload))) != 0; ) {
+      cloud->publish(PUBLISH_HISTORY_EVENT_NAME, payload);
+      CrossingHistory::instance().markSent(records);
+    }
+    printf(" - %lu events to %s", (unsigned long)CloudPublisher::instance().getPublished(), options.history);
+  }
+  printf("\n");
+  if (busFaults) {
+    const SensorHealth::Stats &health = SensorHealth::instance().getStats();
+    uint32_t steps = 0;
+    for (int step = RECOVERY_CLEAR_INTERRUPT; step < RECOVERY_STEP_COUNT; step++) steps += health.steps[step];
+    printf("Bus held %lu times - %lu recovery steps (%lu bus resets, %lu failed), %lu outages, longest %lums\n", (unsigned long)busFaults,
+           (unsigned long)steps, (unsigned long)health.steps[RECOVERY_BUS_RESET], (unsigned long)health.failedSteps,
+           (unsigned long)health.outages, (unsigned long)health.longestOutageMs);
+  }
+  if (trace) fclose(trace);
+  return (options.doorSwings <= 0 && signatures.maskedEpisodes) ? 1 : 0;
+}
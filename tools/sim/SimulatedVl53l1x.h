@@ -0,0 +1,133 @@
+// Simulated VL53L1X
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// A register level stand-in for the sensor on the host Wire bus, so TofSensor runs unchanged against a crowd::Crowd
+// Starting a measurement (SYSTEM__MODE_START = 0x40) latches the programmed ROI; once the timing budget has passed on the host
+// clock the next read samples the crowd at the middle of the integration and fills the result registers read by
+// Vl53l1xDevice::readResults(). Results stay put until the next measurement completes, as on the sensor; stopping cancels.
+// setGlitchProbability() makes some results bad - a spike in the signal flagged as a hardware fail, wrap around or sigma fail
+// Use: static SimulatedVl53l1x sensor(crowd); sensor.attach(); before TofSensor::instance().setup() (the clock must be manual)
+
+#ifndef __SIMULATEDVL53L1X_H
+#define __SIMULATEDVL53L1X_H
+
+#include <chrono>
+#include <random>
+#include "Particle.h"
+#include "Vl53l1xDevice.h"
+#include "CrowdModel.h"
+
+class SimulatedVl53l1x {
+public:
+    explicit SimulatedVl53l1x(crowd::Crowd &model) : crowd(model) {
+        memset(registers, 0, sizeof(registers));
+        registers[vl53l1x::REG_IDENTIFICATION__MODEL_ID] = 0xEA;
+        registers[vl53l1x::REG_IDENTIFICATION__MODEL_ID + 1] = 0xCC;
+        registers[vl53l1x::REG_FIRMWARE__SYSTEM_STATUS] = 0x01;        // Booted
+        registers[vl53l1x::REG_GPIO_HV_MUX__CTRL] = 0x01;              // Interrupt active high
+    }
+
+    void attach() {
+        active = this;
+        Wire.attachRegisters(registers, sizeof(registers));
+        Wire.setWriteHook(&SimulatedVl53l1x::onWrite);
+        Wire.setReadHook(&SimulatedVl53l1x::onRead);
+    }
+
+    /**
+     * @brief Integration time per measurement - the driver's budget registers are not decoded, the tool tells us
+     */
+    void setTimingBudget(uint16_t ms) { budgetMs = ms; }
+
+    /**
+     * @brief The last result for each side of the sensor (0 - columns 0-7, the front zone, 1 - the back zone)
+     */
+    const crowd::Sample &getLast(int zone) const { return last[zone & 1]; }
+
+    void setGlitchProbability(double probability) { glitchProbability = probability; }
+
+    uint32_t getMeasurements() const { return measurements; }
+    uint32_t getGlitches() const { return glitches; }
+    double getModelSeconds() const { return modelSeconds; }        // Host time spent in the crowd model - not firmware cost
+
+private:
+    static void onWrite(uint16_t reg, uint8_t value) {
+        if (!active) return;
+        if (reg == vl53l1x::REG_SYSTEM__MODE_START && value == 0x40) active->start();
+        else if (reg == vl53l1x::REG_SYSTEM__MODE_START && value == 0x00) active->ranging = false;
+        else if (reg == vl53l1x::REG_SYSTEM__INTERRUPT_CLEAR) active->registers[vl53l1x::REG_GPIO__TIO_HV_STATUS] = 0;
+    }
+
+    static void onRead(uint16_t reg, uint8_t count) {
+        (void)reg;
+        (void)count;
+        if (active && active->ranging && micros() - active->startedAt >= active->budgetMs * 1000UL) active->measure();
+    }
+
+    static void putWord(uint8_t *at, uint16_t value) {
+        at[0] = (uint8_t)(value >> 8);
+        at[1] = (uint8_t)(value & 0xFF);
+    }
+
+    void start() {
+        center = registers[vl53l1x::REG_ROI_CONFIG__USER_ROI_CENTRE_SPAD];
+        size = registers[vl53l1x::REG_ROI_CONFIG__USER_ROI_REQUESTED_GLOBAL_XY_SIZE];
+        startedAt = micros();
+        ranging = true;
+    }
+
+    void measure() {
+        auto started = std::chrono::steady_clock::now();
+        int columns = (size & 0x0F) + 1, rows = (size >> 4) + 1;
+        ranging = false;
+
+        crowd::Sample sample = crowd.sample(center, columns, rows, startedAt / 1000.0 + budgetMs / 2.0);
+        crowd.update(millis());
+
+        int row, column;
+        crowd::Crowd::spadPosition(center, row, column);
+        last[(column < 8) ? 0 : 1] = sample;
+
+        uint8_t status = 9;                                                 // Range valid
+        uint32_t signalPerSpad = sample.signalPerSpad;
+        if (glitchProbability > 0 && unit(random) < glitchProbability) {
+            static const uint8_t glitchStatuses[] = {3, 7, 6};              // Raw codes - hardware fail, wrap around, sigma fail
+            status = glitchStatuses[random() % 3];
+            signalPerSpad = (uint32_t)(signalPerSpad * (0.2 + 3.0 * unit(random)));
+            glitches++;
+        }
+
+        uint16_t spads = (uint16_t)sample.spadCount << 8;                   // 8.8 fixed point
+        registers[vl53l1x::REG_RESULT__RANGE_STATUS] = status;
+        putWord(&registers[vl53l1x::REG_RESULT__DSS_ACTUAL_EFFECTIVE_SPADS_SD0], spads);
+        putWord(&registers[vl53l1x::REG_RESULT__AMBIENT_COUNT_RATE_MCPS_SD0], (uint16_t)((uint32_t)sample.ambientPerSpad * spads / 2000));
+        putWord(&registers[vl53l1x::REG_RESULT__SIGMA_SD0], 5 << 2);
+        putWord(&registers[vl53l1x::REG_RESULT__FINAL_CROSSTALK_CORRECTED_RANGE_MM_SD0], sample.distance);
+        uint32_t signal = (signalPerSpad * spads + 1999) / 2000;   // Round up so the driver's division gives the sample back
+        putWord(&registers[vl53l1x::REG_RESULT__PEAK_SIGNAL_COUNT_RATE_CROSSTALK_CORRECTED_MCPS_SD0], (uint16_t)((signal > 65535) ? 65535 : signal));
+        registers[vl53l1x::REG_GPIO__TIO_HV_STATUS] = 1;                    // Data ready
+
+        measurements++;
+        modelSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    static inline SimulatedVl53l1x *active = NULL;
+
+    crowd::Crowd &crowd;
+    uint8_t registers[0x200];
+    uint16_t budgetMs = 20;
+    bool ranging = false;
+    unsigned long startedAt = 0;                    // micros()
+    uint8_t center = 0;                             // The ROI latched when the measurement started
+    uint8_t size = 0;
+    crowd::Sample last[2] = {};
+    uint32_t measurements = 0;
+    double modelSeconds = 0;
+    double glitchProbability = 0;
+    uint32_t glitches = 0;
+    std::mt19937 random{7};                         // Its own stream - glitches do not change what the crowd does
+    std::uniform_real_distribution<double> unit{0, 1};
+};
+
+#endif  /* __SIMULATEDVL53L1X_H */
@@ -0,0 +1,287 @@
+// Parameter Sweep
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// Replays recorded frame traces through the firmware's own zone decision (ZoneDecision, a block of frames at a time) and
+// pass sequence (PassSequence) for a grid or a random sample of settings, on every core, and ranks the settings by how
+// often they miscount.
+// The decision code is the same source the device runs, so a setting that wins here behaves the same on the door.
+//
+// Build and run from the repository root:
+//   g++ -O3 -std=gnu++17 -pthread -Itools/host -Itools/sweep -Isrc tools/sweep/ParameterSweep.cpp
+//       tools/host/HostParticle.cpp src/ZoneDecision.cpp src/PassSequence.cpp -o parameter_sweep
+//   ./parameter_sweep --threshold 6:24:2 --window 10:20:5 --refine 1:4:1 day1.csv day2.csv
+//
+// Ranges are from:to:step (a single value fixes the setting at that value):
+//   --threshold  personThreshold, kcps/SPAD              (default PERSON_THRESHOLD)
+//   --window     calibrationLoops, frames per window     (default NUM_CALIBRATION_LOOPS, at most NUM_CALIBRATION_LOOPS)
+//   --stddev     steady window limit, kcps/SPAD          (default CALIBRATION_MAX_STDDEV)
+//   --refine     baseline filter shift                   (default BASELINE_REFINE_SHIFT)
+//   --relearn    windows before a baseline is replaced   (default BASELINE_RELEARN_WINDOWS)
+// Other options: --random <n> (sample n settings from the grid instead of all of it), --seed <n>, --threads <n>,
+// --top <n> (rows to print), --bucket <seconds> (how finely counts are compared to the truth, default 60), --csv <file>
+//
+// Traces are the CSV crowd_sim --trace writes (tools/sim): ms,signal1,signal2,distance1,distance2,ambient1,ambient2,
+// trueEntries,trueExits with zone 1 the front / inner zone. Lines that do not start with a digit are skipped.
+// Single track only - the lateral lanes (LATERAL_SPLIT) are still decided inside TofSensor.
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "Particle.h"
+#include "TofSensorConfig.h"
+#include "ZoneDecision.h"
+#include "PassSequence.h"
+#include "WorkStealingPool.h"
+
+#define REPLAY_BLOCK_FRAMES 4096            // Frames decided per ZoneDecision::updateBatch() call
+
+// Structure of arrays - the zone decision runs over whole blocks of each field
+struct Trace {
+    std::string name;
+    std::vector<uint32_t> ms;
+    std::vector<uint16_t> signal[2];
+    std::vector<uint16_t> distance[2];
+    std::vector<uint16_t> ambient[2];
+    std::vector<uint32_t> trueEntries;
+    std::vector<uint32_t> trueExits;
+    size_t size() const { return ms.size(); }
+};
+
+struct Range {
+    int from, to, step;
+    int count() const { return (to - from) / step + 1; }
+    int at(int i) const { return from + i * step; }
+};
+
+struct Score {
+    uint32_t entries, exits;                // Counted
+    uint32_t trueEntries, trueExits;
+    uint32_t errors;                        // Summed per bucket over entries and exits
+    uint32_t impossible, aborted;
+};
+
+enum Setting { SET_THRESHOLD, SET_WINDOW, SET_STDDEV, SET_REFINE, SET_RELEARN, SET_COUNT };
+static const char * const settingNames[SET_COUNT] = {"threshold", "window", "stddev", "refine", "relearn"};
+
+static bool loadTrace(const char *path, Trace &trace) {
+  FILE *file = fopen(path, "r");
+  if (!file) return false;
+  trace.name = path;
+  char line[160];
+  while (fgets(line, sizeof(line), file)) {
+    if (line[0] < '0' || line[0] > '9') continue;
+    unsigned long ms, signal1, signal2, distance1, distance2, ambient1, ambient2, entries, exits;
+    if (sscanf(line, "%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu", &ms, &signal1, &signal2, &distance1, &distance2, &ambient1, &ambient2, &entries, &exits) != 9) continue;
+    trace.ms.push_back((uint32_t)ms);
+    trace.signal[0].push_back((uint16_t)signal1);
+    trace.signal[1].push_back((uint16_t)signal2);
+    trace.distance[0].push_back((uint16_t)distance1);
+    trace.distance[1].push_back((uint16_t)distance2);
+    trace.ambient[0].push_back((uint16_t)ambient1);
+    trace.ambient[1].push_back((uint16_t)ambient2);
+    trace.trueEntries.push_back((uint32_t)entries);
+    trace.trueExits.push_back((uint32_t)exits);
+  }
+  fclose(file);
+  return trace.size() > 0;
+}
+
+// As TofSensor::loop() and the single track PeopleCounter::loop() use them - the sequence only moves on a change of state
+static Score replay(const Trace &trace, const ZoneDecisionParams &params, uint32_t bucketMs) {
+  ZoneDecision decision;
+  PassSequence sequence;
+  Score score = {};
+  int state = 0;
+  size_t frames = trace.size();
+  uint32_t bucketEnd = trace.ms[0] + bucketMs;
+  uint32_t bucketEntries = 0, bucketExits = 0, truthEntries = trace.trueEntries[0], truthExits = trace.trueExits[0];
+  uint8_t occupancy[REPLAY_BLOCK_FRAMES];
+
+  for (size_t start = 0; start < frames; start += REPLAY_BLOCK_FRAMES) {
+    size_t count = (frames - start < REPLAY_BLOCK_FRAMES) ? frames - start : REPLAY_BLOCK_FRAMES;
+    ZoneFrameBlock block = {{&trace.signal[0][start], &trace.signal[1][start]}, {&trace.ambient[0][start], &trace.ambient[1][start]},
+                            {&trace.distance[0][start], &trace.distance[1][start]}, count};
+    decision.updateBatch(block, params, occupancy, NULL);
+
+    for (size_t i = 0; i < count; i++) {
+      size_t frame = start + i;
+      if (trace.ms[frame] >= bucketEnd) {             // Compare the bucket with what really happened in it
+        score.errors += abs((int)bucketEntries - (int)(trace.trueEntries[frame] - truthEntries)) + abs((int)bucketExits - (int)(trace.trueExits[frame] - truthExits));
+        truthEntries = trace.trueEntries[frame];
+        truthExits = trace.trueExits[frame];
+        bucketEntries = bucketExits = 0;
+        while (bucketEnd <= trace.ms[frame]) bucketEnd += bucketMs;
+      }
+
+      if (occupancy[i] == state) continue;
+      state = occupancy[i];
+
+      switch (sequence.advance(state)) {
+        case TRACK_ENTERED: score.entries++; bucketEntries++; break;
+        case TRACK_EXITED: score.exits++; bucketExits++; break;
+        case TRACK_ABORTED: score.aborted++; break;
+        case TRACK_IMPOSSIBLE: score.impossible++; break;
+        default: break;
+      }
+    }
+  }
+
+  score.errors += abs((int)bucketEntries - (int)(trace.trueEntries.back() - truthEntries)) + abs((int)bucketExits - (int)(trace.trueExits.back() - truthExits));
+  score.trueEntries = trace.trueEntries.back() - trace.trueEntries[0];
+  score.trueExits = trace.trueExits.back() - trace.trueExits[0];
+  return score;
+}
+
+static bool parseRange(const char *text, Range &range) {
+  int values[3] = {0, 0, 1};
+  int found = sscanf(text, "%d:%d:%d", &values[0], &values[1], &values[2]);
+  if (found < 1 || values[2] <= 0) return false;
+  range.from = values[0];
+  range.to = (found >= 2) ? values[1] : values[0];
+  range.step = values[2];
+  return range.to >= range.from;
+}
+
+int main(int argc, char **argv) {
+  Range ranges[SET_COUNT] = {
+    {PERSON_THRESHOLD, PERSON_THRESHOLD, 1}, {NUM_CALIBRATION_LOOPS, NUM_CALIBRATION_LOOPS, 1}, {CALIBRATION_MAX_STDDEV, CALIBRATION_MAX_STDDEV, 1},
+    {BASELINE_REFINE_SHIFT, BASELINE_REFINE_SHIFT, 1}, {BASELINE_RELEARN_WINDOWS, BASELINE_RELEARN_WINDOWS, 1}
+  };
+  size_t randomSamples = 0, top = 10;
+  uint32_t seed = 1, bucketSeconds = 60;
+  unsigned threads = std::thread::hardware_concurrency();
+  const char *csvPath = NULL;
+  std::vector<Trace> traces;
+
+  for (int i = 1; i < argc; i++) {
+    const char *name = argv[i];
+    bool hasValue = (name[0] == '-' && name[1] == '-' && i + 1 < argc);
+    int setting = -1;
+    for (int s = 0; s < SET_COUNT; s++) if (hasValue && !strcmp(name + 2, settingNames[s])) setting = s;
+
+    if (setting >= 0) {
+      if (!parseRange(argv[++i], ranges[setting])) {
+        fprintf(stderr, "Bad range for %s: %s (from:to:step)\n", name, argv[i]);
+        return 2;
+      }
+    }
+    else if (hasValue && !strcmp(name, "--random")) randomSamples = strtoul(argv[++i], NULL, 0);
+    else if (hasValue && !strcmp(name, "--seed")) seed = strtoul(argv[++i], NULL, 0);
+    else if (hasValue && !strcmp(name, "--threads")) threads = strtoul(argv[++i], NULL, 0);
+    else if (hasValue && !strcmp(name, "--top")) top = strtoul(argv[++i], NULL, 0);
+    else if (hasValue && !strcmp(name, "--bucket")) bucketSeconds = strtoul(argv[++i], NULL, 0);
+    else if (hasValue && !strcmp(name, "--csv")) csvPath = argv[++i];
+    else if (name[0] == '-') {
+      fprintf(stderr, "usage: %s [--threshold 6:24:2] [--window 10:20:5] [--stddev 2:8:1] [--refine 1:4:1] [--relearn 10:60:10]\n"
+                      "       [--random n] [--seed n] [--threads n] [--top n] [--bucket seconds] [--csv file] trace.csv...\n", argv[0]);
+      return 2;
+    }
+    else {
+      traces.emplace_back();
+      if (!loadTrace(name, traces.back())) {
+        fprintf(stderr, "No frames in %s\n", name);
+        return 2;
+      }
+    }
+  }
+  if (traces.empty() || bucketSeconds == 0) {
+    fprintf(stderr, "Give at least one trace (crowd_sim --trace writes them)\n");
+    return 2;
+  }
+  if (ranges[SET_WINDOW].from < 1 || ranges[SET_WINDOW].to > NUM_CALIBRATION_LOOPS || ranges[SET_REFINE].from < 0 || ranges[SET_RELEARN].from < 1) {
+    fprintf(stderr, "window must be 1 to %d, refine 0 or more and relearn 1 or more\n", NUM_CALIBRATION_LOOPS);
+    return 2;
+  }
+
+  // The whole grid, or a sample of it - each setting is an index into its range
+  size_t gridSize = 1;
+  for (const Range &range : ranges) gridSize *= range.count();
+  std::vector<size_t> chosen;
+  if (randomSamples && randomSamples < gridSize) {
+    std::mt19937_64 random(seed);
+    std::uniform_int_distribution<size_t> pick(0, gridSize - 1);
+    std::vector<bool> taken(gridSize, false);
+    while (chosen.size() < randomSamples) {
+      size_t cell = pick(random);
+      if (!taken[cell]) { taken[cell] = true; chosen.push_back(cell); }
+    }
+  }
+  else for (size_t cell = 0; cell < gridSize; cell++) chosen.push_back(cell);
+
+  std::vector<ZoneDecisionParams> configs;
+  for (size_t cell : chosen) {
+    int value[SET_COUNT];
+    for (int s = 0; s < SET_COUNT; s++) {
+      value[s] = ranges[s].at((int)(cell % ranges[s].count()));
+      cell /= ranges[s].count();
+    }
+    configs.push_back({value[SET_THRESHOLD], value[SET_WINDOW], value[SET_STDDEV], value[SET_REFINE], value[SET_RELEARN]});
+  }
+
+  // One job per setting and trace - a slot each for the results, so the jobs share nothing
+  size_t frames = 0;
+  for (const Trace &trace : traces) frames += trace.size();
+  std::vector<Score> scores(configs.size() * traces.size());
+  WorkStealingPool pool(threads);
+  auto started = std::chrono::steady_clock::now();
+  pool.run(scores.size(), [&](size_t job) {
+    scores[job] = replay(traces[job % traces.size()], configs[job / traces.size()], bucketSeconds * 1000);
+  });
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  struct Ranked {
+    size_t config;
+    Score total;
+    double miscount;
+  };
+  std::vector<Ranked> ranked;
+  for (size_t c = 0; c < configs.size(); c++) {
+    Ranked entry = {c, {}, 0};
+    for (size_t t = 0; t < traces.size(); t++) {
+      const Score &score = scores[c * traces.size() + t];
+      entry.total.entries += score.entries;
+      entry.total.exits += score.exits;
+      entry.total.trueEntries += score.trueEntries;
+      entry.total.trueExits += score.trueExits;
+      entry.total.errors += score.errors;
+      entry.total.impossible += score.impossible;
+      entry.total.aborted += score.aborted;
+    }
+    uint32_t truth = entry.total.trueEntries + entry.total.trueExits;
+    entry.miscount = truth ? (double)entry.total.errors / truth : (entry.total.errors ? 1.0 : 0.0);
+    ranked.push_back(entry);
+  }
+  std::stable_sort(ranked.begin(), ranked.end(), [](const Ranked &a, const Ranked &b) { return a.miscount < b.miscount; });
+
+  printf("%zu settings x %zu traces (%zu frames) on %u threads in %.2fs - %.1fM frames/s, %llu jobs stolen\n\n", configs.size(), traces.size(),
+         frames, pool.getThreads(), seconds, (double)frames * configs.size() / seconds / 1e6, (unsigned long long)pool.getSteals());
+  printf("  rank  threshold  window  stddev  refine  relearn  counted in/out  true in/out  impossible  miscount\n");
+  for (size_t r = 0; r < ranked.size() && r < top; r++) {
+    const ZoneDecisionParams &params = configs[ranked[r].config];
+    const Score &total = ranked[r].total;
+    printf("  %4zu  %9d  %6d  %6d  %6d  %7d  %6lu/%-7lu  %5lu/%-5lu  %10lu  %7.1f%%\n", r + 1, params.personThreshold, params.calibrationLoops,
+           params.maxStddev, params.refineShift, params.relearnWindows, (unsigned long)total.entries, (unsigned long)total.exits,
+           (unsigned long)total.trueEntries, (unsigned long)total.trueExits, (unsigned long)total.impossible, ranked[r].miscount * 100.0);
+  }
+
+  if (csvPath) {
+    FILE *csv = fopen(csvPath, "w");
+    if (!csv) {
+      fprintf(stderr, "Cannot write %s\n", csvPath);
+      return 2;
+    }
+    fprintf(csv, "rank,threshold,window,stddev,refine,relearn,entries,exits,trueEntries,trueExits,errors,impossible,aborted,miscount\n");
+    for (size_t r = 0; r < ranked.size(); r++) {
+      const ZoneDecisionParams &params = configs[ranked[r].config];
+      const Score &total = ranked[r].total;
+      fprintf(csv, "%zu,%d,%d,%d,%d,%d,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%.4f\n", r + 1, params.personThreshold, params.calibrationLoops, params.maxStddev,
+              params.refineShift, params.relearnWindows, (unsigned long)total.entries, (unsigned long)total.exits, (unsigned long)total.trueEntries,
+              (unsigned long)total.trueExits, (unsigned long)total.errors, (unsigned long)total.impossible, (unsigned long)total.aborted, ranked[r].miscount);
+    }
+    fclose(csv);
+  }
+  return 0;
+}
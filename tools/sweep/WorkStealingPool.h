@@ -0,0 +1,82 @@
+// Work Stealing Pool
+// Author: Chip McClelland
+// Date: May 2023
+// License: GPL3
+// A fixed set of threads that runs job(index) for every index in a range. Each thread starts with its own contiguous block
+// of indices and works from the front of it; a thread that runs dry takes from the back of another thread's block, so a
+// few long traces do not leave the other cores idle at the end of a sweep.
+
+#ifndef __WORKSTEALINGPOOL_H
+#define __WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads) : queues(threads ? threads : 1) {}
+
+    /**
+     * @brief Runs job(index) for every index in [0, count) across the threads and returns when all of them are done
+     *
+     * Jobs must not touch shared state without their own locking - results are best written to a slot per index.
+     */
+    template<typename Job> void run(size_t count, Job job) {
+        size_t threads = queues.size();
+        for (size_t t = 0; t < threads; t++) {
+            Queue &queue = queues[t];
+            queue.jobs.clear();
+            for (size_t index = count * t / threads; index < count * (t + 1) / threads; index++) queue.jobs.push_back(index);
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([this, t, &job]() {
+                size_t index;
+                while (take(t, index)) job(index);
+            });
+        }
+        for (std::thread &worker : workers) worker.join();
+    }
+
+    unsigned getThreads() const { return (unsigned)queues.size(); }
+    uint64_t getSteals() const { return steals; }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> jobs;
+    };
+
+    // The next job for thread t - its own front first, then the back of the others, starting with its neighbour
+    bool take(size_t t, size_t &index) {
+        {
+            Queue &own = queues[t];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.jobs.empty()) {
+                index = own.jobs.front();
+                own.jobs.pop_front();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < queues.size(); offset++) {
+            Queue &victim = queues[(t + offset) % queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.jobs.empty()) {
+                index = victim.jobs.back();
+                victim.jobs.pop_back();
+                steals++;
+                return true;
+            }
+        }
+        return false;                                   // No job creates another, so empty everywhere means done
+    }
+
+    std::deque<Queue> queues;                           // deque - a Queue holds a mutex and cannot move
+    std::atomic<uint64_t> steals{0};
+};
+
+#endif  /* __WORKSTEALINGPOOL_H */